@@ -0,0 +1,169 @@
+#pragma once
+
+#include <malloc.h>
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * Memory accounting and ceilings for single queries.
+ *
+ * Usage is read from the kernel (peak resident set via VmHWM, which
+ * /proc/self/clear_refs resets between stages) and from the allocator (bytes
+ * in use via mallinfo2, which covers ISL's own allocations). The ceiling is an
+ * address space limit, under which ISL allocations fail and are reported
+ * through the isl_ctx instead of the kernel killing the process. Both are per
+ * process, so budgeted queries must not run concurrently in one process.
+ */
+
+/// @brief Reads a "Key:   123 kB" field of /proc/self/status in bytes, or -1.
+inline long proc_status_bytes(const std::string& key)
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, key.size(), key) == 0 && line[key.size()] == ':')
+            return std::stol(line.substr(key.size() + 1)) * 1024;
+    }
+    return -1;
+}
+
+/// @brief The peak resident set since the last reset_peak_rss, in bytes.
+inline long peak_rss_bytes()
+{
+    return proc_status_bytes("VmHWM");
+}
+
+/// @brief Resets the peak resident set to the current one.
+inline bool reset_peak_rss()
+{
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+    return clear_refs.good();
+}
+
+/// @brief The bytes the allocator has handed out and not gotten back.
+inline long heap_bytes()
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+/// @brief The usage of one pipeline stage.
+struct stage_usage_struct
+{
+    /// @brief The stage name, e.g. "lexmin".
+    const std::string stage;
+    /// @brief The wall time of the stage.
+    const double seconds;
+    /// @brief The peak resident set during the stage.
+    const long peak_rss;
+    /// @brief The heap in use when the stage ended.
+    const long heap;
+};
+
+/**
+ * @brief Records the time and memory of the stages of a query, one stage at
+ * a time.
+ */
+class MemoryTracker
+{
+    private:
+        std::vector<stage_usage_struct> usage;
+        std::string stage;
+        std::chrono::steady_clock::time_point start;
+    public:
+        /// @brief Starts a stage, ending the previous one if still open.
+        void begin(const std::string& name)
+        {
+            if (!stage.empty())
+                this->end();
+            reset_peak_rss();
+            stage = name;
+            start = std::chrono::steady_clock::now();
+        }
+
+        /// @brief Ends the open stage.
+        void end()
+        {
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            usage.push_back(stage_usage_struct{stage, elapsed.count(), peak_rss_bytes(), heap_bytes()});
+            stage.clear();
+        }
+
+        /// @brief Records a stage measured elsewhere, e.g. in a child process.
+        void record(const stage_usage_struct& measured)
+        {
+            usage.push_back(measured);
+        }
+
+        /// @brief The stages recorded so far.
+        const std::vector<stage_usage_struct>& stages() const
+        {
+            return usage;
+        }
+
+        /// @brief The largest peak over the recorded stages.
+        long peak() const
+        {
+            long peak = 0;
+            for (const stage_usage_struct& s : usage)
+                peak = std::max(peak, s.peak_rss);
+            return peak;
+        }
+
+        /// @brief Prints one line per stage.
+        void report(std::ostream& out) const
+        {
+            for (const stage_usage_struct& s : usage)
+            {
+                out << s.stage << "\t| time: " << s.seconds << "\t| peak: " << s.peak_rss
+                    << "\t| heap: " << s.heap << std::endl;
+            }
+        }
+};
+
+/**
+ * @brief Caps the address space at the current size plus a budget while in
+ * scope, restoring the previous limit afterwards. A budget of 0 or less
+ * leaves the limit alone.
+ *
+ * Only allocations ISL checks itself fail softly under the ceiling. GMP
+ * aborts when its allocator fails, and a failed operator new inside NTL
+ * (through barvinok) throws across C frames and terminates, so a process
+ * that must survive the budget runs the query in a forked child, as
+ * analyze_budgeted does.
+ */
+class MemoryCeiling
+{
+    private:
+        struct rlimit previous;
+        bool applied = false;
+    public:
+        explicit MemoryCeiling(long budget_bytes)
+        {
+            long current = proc_status_bytes("VmSize");
+            if (budget_bytes <= 0 || current < 0 || getrlimit(RLIMIT_AS, &previous) != 0)
+                return;
+
+            struct rlimit ceiling = previous;
+            rlim_t wanted = current + budget_bytes;
+            ceiling.rlim_cur = previous.rlim_max == RLIM_INFINITY ? wanted : std::min(wanted, previous.rlim_max);
+            applied = setrlimit(RLIMIT_AS, &ceiling) == 0;
+        }
+
+        ~MemoryCeiling()
+        {
+            if (applied)
+                setrlimit(RLIMIT_AS, &previous);
+        }
+
+        MemoryCeiling(const MemoryCeiling&) = delete;
+        MemoryCeiling& operator=(const MemoryCeiling&) = delete;
+};
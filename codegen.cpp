@@ -0,0 +1,678 @@
+/**
+ * @brief Generates specialized counting kernels from the nearest source
+ * relation with ISL's AST generator. For mappings too irregular for closed
+ * form summation, the kernel enumerates every (dst, datum, src) at native loop
+ * speed instead.
+ */
+#include "latency.hpp"
+#include "metrics.hpp"
+#include "native_eval.hpp"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <isl/ast.h>
+#include <isl/ast_build.h>
+#include <isl/printer.h>
+#include <isl/union_map.h>
+#include <isl/union_set.h>
+
+/// @brief The entry point of a compiled counting kernel, nonzero if the jumps overflow a long.
+typedef int (*counting_kernel)(long *jumps, long *latency);
+
+/// @brief The totals counted by a kernel.
+struct kernel_count_struct
+{
+    const long jumps;
+    const long latency;
+};
+typedef std::unique_ptr<kernel_count_struct> kernel_count;
+
+/// @brief Carries the loop bookkeeping through the AST for printer.
+struct kernel_print_info
+{
+    /// @brief The schedule dims spanned by [dst, data].
+    int n_fill;
+    /// @brief The nesting depth of the loop being printed.
+    int depth;
+};
+
+/**
+ * Prints a for loop of the kernel, marking the outermost [dst, data] loops
+ * parallel and the innermost src loops SIMD.
+ */
+__isl_give isl_printer *print_kernel_for(
+    __isl_take isl_printer *p, __isl_take isl_ast_print_options *options,
+    __isl_keep isl_ast_node *node, void *p_print
+) {
+    auto p_info = static_cast<kernel_print_info*>(p_print);
+
+    // Schedule dim k is iterated by ck.
+    isl_ast_expr *p_iterator = isl_ast_node_for_get_iterator(node);
+    isl_id *p_id = isl_ast_expr_get_id(p_iterator);
+    int dim = std::stoi(std::string(isl_id_get_name(p_id)).substr(1));
+    isl_id_free(p_id);
+    isl_ast_expr_free(p_iterator);
+    isl_ast_node *p_body = isl_ast_node_for_get_body(node);
+    bool innermost = isl_ast_node_get_type(p_body) == isl_ast_node_user;
+    isl_ast_node_free(p_body);
+
+    // Every (dst, datum) is independent, so top level fill loops split.
+    if (p_info->depth == 0 && dim < p_info->n_fill)
+    {
+        p = isl_printer_start_line(p);
+        p = isl_printer_print_str(p, "#pragma omp parallel for private(m) reduction(+:jumps) reduction(max:latency)");
+        p = isl_printer_end_line(p);
+    }
+    else if (innermost && dim > p_info->n_fill)
+    {
+        p = isl_printer_start_line(p);
+        p = isl_printer_print_str(p, "#pragma omp simd reduction(min:m)");
+        p = isl_printer_end_line(p);
+    }
+
+    p_info->depth++;
+    p = isl_ast_node_for_print(node, p, options);
+    p_info->depth--;
+
+    return p;
+}
+
+/**
+ * Builds the schedule of one kernel statement: [x] -> [x, order, 0...] for
+ * the fill statements, [x, s] -> [x, 1, s] for the src statement.
+ *
+ * @param __isl_take domain The flat statement domain, named after it.
+ * @param n_fill            The dims spanned by [dst, data].
+ * @param n_src             The dims spanned by src.
+ * @param order             The position of the statement per (dst, datum).
+ */
+__isl_give isl_map *kernel_statement_schedule(
+    __isl_take isl_set *domain, int n_fill, int n_src, int order
+) {
+    isl_map *p_schedule = isl_set_identity(domain);
+    p_schedule = isl_map_reset_tuple_id(p_schedule, isl_dim_out);
+    p_schedule = isl_map_insert_dims(p_schedule, isl_dim_out, n_fill, 1);
+    p_schedule = isl_map_fix_si(p_schedule, isl_dim_out, n_fill, order);
+    // Pads the fill statements to the depth of the src statement.
+    int n_out = isl_map_dim(p_schedule, isl_dim_out);
+    if (n_out < n_fill + 1 + n_src)
+    {
+        p_schedule = isl_map_add_dims(p_schedule, isl_dim_out, n_fill + 1 + n_src - n_out);
+        for (int i = n_out; i < n_fill + 1 + n_src; i++)
+            p_schedule = isl_map_fix_si(p_schedule, isl_dim_out, i, 0);
+    }
+
+    return p_schedule;
+}
+
+/**
+ * Emits the distance function as a native C expression over d0, ..., s0, ....
+ *
+ * @param __isl_take dist_func  The distance function, as a map.
+ * @param n_mesh                The dims of a dst (and of a src).
+ */
+std::string kernel_distance_expr(__isl_take isl_map *dist_func, int n_mesh)
+{
+    // Makes the distance a pw_aff over the flat [d..., s...].
+    isl_pw_multi_aff *p_dist_pma = isl_pw_multi_aff_from_map(isl_map_flatten_domain(dist_func));
+    isl_pw_aff *p_dist = isl_pw_multi_aff_get_pw_aff(p_dist_pma, 0);
+    isl_pw_multi_aff_free(p_dist_pma);
+    for (int i = 0; i < 2 * n_mesh; i++)
+    {
+        std::string name = (i < n_mesh ? "d" : "s") + std::to_string(i % n_mesh);
+        p_dist = isl_pw_aff_set_dim_name(p_dist, isl_dim_in, i, name.c_str());
+    }
+    // Turns the arguments into parameters, which the AST expressions name.
+    p_dist = isl_pw_aff_move_dims(p_dist, isl_dim_param, 0, isl_dim_in, 0, 2 * n_mesh);
+    p_dist = isl_pw_aff_project_domain_on_params(p_dist);
+
+    isl_ast_build *p_build = isl_ast_build_from_context(
+        isl_set_params(isl_pw_aff_domain(isl_pw_aff_copy(p_dist)))
+    );
+    isl_ast_expr *p_expr = isl_ast_build_expr_from_pw_aff(p_build, p_dist);
+    char *s_expr = isl_ast_expr_to_C_str(p_expr);
+    std::string ret(s_expr);
+
+    free(s_expr);
+    isl_ast_expr_free(p_expr);
+    isl_ast_build_free(p_build);
+
+    return ret;
+}
+
+/**
+ * Generates the C++ source of a kernel counting the total jumps and the
+ * latency by enumerating every (dst, datum, src) of the nearest source
+ * relation. The jumps are summed in 128 bits and the kernel returns nonzero
+ * if the total does not fit the long it is stored in.
+ *
+ * @pre The maps have no parameters.
+ *
+ * @param __isl_take src_occupancy  A map relating source location and the
+ *                                  data occupied.
+ * @param __isl_take dst_fill       A map relating destination location and
+ *                                  the data requested.
+ * @param __isl_take dist_func      The distance function to use, as a map.
+ */
+std::string generate_counting_kernel(
+    __isl_take isl_map *src_occupancy,
+    __isl_take isl_map *dst_fill,
+    __isl_take isl_map *dist_func
+) {
+    isl_ctx *p_ctx = isl_map_get_ctx(dst_fill);
+    assert(isl_map_dim(dst_fill, isl_dim_param) == 0);
+    int n_mesh = isl_map_dim(dst_fill, isl_dim_in);
+    int n_data = isl_map_dim(dst_fill, isl_dim_out);
+    int n_fill = n_mesh + n_data;
+
+    // Makes the candidates [dst -> data] -> src.
+    isl_map *p_candidates = isl_map_apply_range(
+        isl_map_range_map(isl_map_copy(dst_fill)), isl_map_reverse(src_occupancy)
+    );
+    DUMP(p_candidates);
+
+    // I[dst, data] starts, S[dst, data, src] visits, F[dst, data] ends.
+    isl_set *p_fill = isl_set_flatten(isl_map_wrap(dst_fill));
+    isl_set *p_visit = isl_set_flatten(isl_map_wrap(p_candidates));
+    isl_union_map *p_schedule = isl_union_map_from_map(kernel_statement_schedule(
+        isl_set_set_tuple_name(isl_set_copy(p_fill), "I"), n_fill, n_mesh, 0
+    ));
+    p_schedule = isl_union_map_add_map(p_schedule, kernel_statement_schedule(
+        isl_set_set_tuple_name(p_visit, "S"), n_fill, n_mesh, 1
+    ));
+    p_schedule = isl_union_map_add_map(p_schedule, kernel_statement_schedule(
+        isl_set_set_tuple_name(p_fill, "F"), n_fill, n_mesh, 2
+    ));
+
+    // Generates the loop nest.
+    isl_ast_build *p_build = isl_ast_build_from_context(
+        isl_set_universe(isl_space_params_alloc(p_ctx, 0))
+    );
+    isl_ast_node *p_tree = isl_ast_build_node_from_schedule_map(p_build, p_schedule);
+    isl_ast_build_free(p_build);
+
+    kernel_print_info print_info{n_fill, 0};
+    isl_ast_print_options *p_options = isl_ast_print_options_set_print_for(
+        isl_ast_print_options_alloc(p_ctx), print_kernel_for, &print_info
+    );
+    isl_printer *p_printer = isl_printer_set_output_format(isl_printer_to_str(p_ctx), ISL_FORMAT_C);
+    p_printer = isl_printer_set_indent(p_printer, 4);
+    p_printer = isl_ast_node_print(p_tree, p_printer, p_options);
+    char *s_loops = isl_printer_get_str(p_printer);
+    std::string loops(s_loops);
+    free(s_loops);
+    isl_printer_free(p_printer);
+    isl_ast_node_free(p_tree);
+
+    // Names the statement arguments.
+    std::string fill_args, src_args, dst_params, src_params;
+    for (int i = 0; i < n_mesh; i++)
+    {
+        dst_params += (i ? ", long d" : "long d") + std::to_string(i);
+        src_params += ", long s" + std::to_string(i);
+        src_args += ", s" + std::to_string(i);
+    }
+    for (int i = 0; i < n_fill; i++)
+        fill_args += (i ? ", " : "") + std::string(i < n_mesh ? "d" : "a") + std::to_string(i < n_mesh ? i : i - n_mesh);
+    std::string dist_args;
+    for (int i = 0; i < n_mesh; i++)
+        dist_args += (i ? ", d" : "d") + std::to_string(i);
+
+    std::stringstream source;
+    source << "#include <climits>\n"
+           << "#define floord(n, d) (((n) < 0) ? -((-(n) + (d) - 1) / (d)) : (n) / (d))\n"
+           << "#define min(x, y) ((x) < (y) ? (x) : (y))\n"
+           << "#define max(x, y) ((x) > (y) ? (x) : (y))\n"
+           << "static inline long dist(" << dst_params << src_params << ")\n"
+           << "{\n    return " << kernel_distance_expr(dist_func, n_mesh) << ";\n}\n"
+           << "#define I(...) m = LONG_MAX\n"
+           << "#define S(" << fill_args << src_args << ") m = min(m, dist(" << dist_args << src_args << "))\n"
+           << "#define F(...) do { if (m != LONG_MAX) { jumps += m; latency = max(latency, m); } } while (0)\n"
+           << "extern \"C\" int pds_count(long *p_jumps, long *p_latency)\n{\n"
+           << "    __int128 jumps = 0;\n"
+           << "    long latency = 0, m = 0;\n"
+           << loops
+           << "    *p_jumps = jumps > LONG_MAX ? LONG_MAX : (long) jumps;\n    *p_latency = latency;\n"
+           << "    return jumps > LONG_MAX;\n}\n";
+
+    return source.str();
+}
+
+/// @brief A loaded kernel and the shared object holding it.
+struct loaded_kernel_struct
+{
+    void *library;
+    counting_kernel kernel;
+};
+
+/// @brief The kernels loaded so far by the text of their maps, closed at exit.
+class KernelCache
+{
+    private:
+        std::unordered_map<std::string, loaded_kernel_struct> kernels;
+    public:
+        KernelCache() = default;
+        KernelCache(const KernelCache&) = delete;
+        KernelCache& operator=(const KernelCache&) = delete;
+
+        ~KernelCache()
+        {
+            for (auto& [key, loaded] : kernels)
+                dlclose(loaded.library);
+        }
+
+        /// @brief The kernel loaded for a key, or nullptr.
+        counting_kernel find(const std::string& key) const
+        {
+            auto cached = kernels.find(key);
+            return cached == kernels.end() ? nullptr : cached->second.kernel;
+        }
+
+        /// @brief Keeps a kernel and its shared object open until exit.
+        void insert(const std::string& key, const loaded_kernel_struct& loaded)
+        {
+            kernels[key] = loaded;
+        }
+};
+
+KernelCache& kernel_cache()
+{
+    static KernelCache cache;
+    return cache;
+}
+
+/// @brief The flags kernels are compiled with.
+const std::string kernel_flags = "-O3 -march=native -fopenmp -shared -fPIC";
+
+/// @brief Splits a command line on whitespace, as $CXX may carry a launcher or flags.
+std::vector<std::string> split_words(const std::string& line)
+{
+    std::vector<std::string> words;
+    std::istringstream stream(line);
+    for (std::string word; stream >> word; )
+        words.push_back(word);
+
+    return words;
+}
+
+/**
+ * Runs a program without a shell, so that no path or variable in its
+ * arguments is interpreted, and waits for it. Its stderr is discarded.
+ *
+ * @param args      The program, looked up on $PATH, and its arguments.
+ * @param p_output  If given, set to what the program wrote to stdout.
+ *
+ * @return Whether the program ran and exited with status 0.
+ */
+bool run_program(const std::vector<std::string>& args, std::string *p_output = nullptr)
+{
+    if (args.empty())
+        return false;
+    std::vector<char*> argv;
+    for (const std::string& arg : args)
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    int fds[2] = {-1, -1};
+    if (p_output && pipe(fds) != 0)
+        return false;
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    if (p_output)
+    {
+        posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+        posix_spawn_file_actions_addclose(&actions, fds[0]);
+        posix_spawn_file_actions_addclose(&actions, fds[1]);
+    }
+    pid_t pid;
+    int spawned = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+
+    // Drains stdout before waiting, so that a full pipe cannot stall the child.
+    if (p_output)
+    {
+        close(fds[1]);
+        char buffer[4096];
+        ssize_t n_read;
+        while (spawned == 0 && (n_read = read(fds[0], buffer, sizeof(buffer))) > 0)
+            p_output->append(buffer, n_read);
+        close(fds[0]);
+    }
+    if (spawned != 0)
+        return false;
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+            return false;
+    }
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Identifies the compiler and the host kernels are built for, so that a
+ * kernel is not reused after a compiler upgrade or on another machine.
+ *
+ * @param compiler  The compiler command.
+ */
+std::string kernel_toolchain(const std::string& compiler)
+{
+    static std::unordered_map<std::string, std::string> identities;
+    auto known = identities.find(compiler);
+    if (known != identities.end())
+        return known->second;
+
+    std::string identity = compiler + "\n" + kernel_flags + "\n";
+    std::vector<std::string> args = split_words(compiler);
+    args.push_back("--version");
+    std::string version;
+    if (run_program(args, &version))
+        identity += version.substr(0, version.find('\n') + 1);
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    identity += host;
+    identities[compiler] = identity;
+
+    return identity;
+}
+
+/**
+ * Finds the directory compiled kernels are kept in: $PDS_KERNEL_CACHE, else
+ * $XDG_CACHE_HOME/polydelivery, else ~/.cache/polydelivery. It is created
+ * 0700 if missing, and refused unless it is a directory owned by the user
+ * that nobody else can write to, as its shared objects get loaded.
+ *
+ * @return The directory, or "" if there is no safe one.
+ */
+std::string kernel_cache_dir()
+{
+    std::string dir;
+    if (const char *s_dir = getenv("PDS_KERNEL_CACHE"))
+    {
+        dir = s_dir;
+    }
+    else
+    {
+        const char *s_xdg = getenv("XDG_CACHE_HOME");
+        const char *s_home = getenv("HOME");
+        if (s_xdg && *s_xdg)
+            dir = s_xdg;
+        else if (s_home && *s_home)
+            dir = std::string(s_home) + "/.cache";
+        else
+            return "";
+        mkdir(dir.c_str(), 0700);
+        dir += "/polydelivery";
+    }
+    mkdir(dir.c_str(), 0700);
+
+    struct stat info;
+    if (lstat(dir.c_str(), &info) != 0 || !S_ISDIR(info.st_mode) || info.st_uid != geteuid() ||
+        (info.st_mode & (S_IWGRP | S_IWOTH)))
+    {
+        std::cerr << "kernel cache " << dir << " is not a private directory" << std::endl;
+        return "";
+    }
+
+    return dir;
+}
+
+/**
+ * Creates a file that must not exist yet, so that nothing planted under its
+ * name is written through or loaded.
+ *
+ * @return Whether the file was created.
+ */
+bool create_exclusive(const std::string& path, const std::string& contents)
+{
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+        return false;
+    bool written = write(fd, contents.data(), contents.size()) == static_cast<ssize_t>(contents.size());
+    close(fd);
+
+    return written;
+}
+
+/// @brief Whether a file holds exactly the given contents.
+bool has_contents(const std::string& path, const std::string& contents)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream read;
+    read << file.rdbuf();
+
+    return file.good() && read.str() == contents;
+}
+
+/**
+ * Compiles a kernel into a shared object and loads it. Shared objects are kept
+ * in the private kernel_cache_dir, named by the hash of their source, compiler,
+ * flags and host, with that full key in a .key file beside them; a shared
+ * object is only reused if its key matches, so a hash collision recompiles
+ * nothing and loads nothing. Both are built under names of their own and
+ * renamed into place once complete, the key first.
+ *
+ * @param source    The kernel source from generate_counting_kernel.
+ * @param library   Set to the loaded shared object, for dlclose.
+ *
+ * @return The kernel entry point, or nullptr if it failed to build or load.
+ */
+counting_kernel load_counting_kernel(const std::string& source, void *&library)
+{
+    const char *s_compiler = getenv("CXX");
+    const std::string compiler = s_compiler && *s_compiler ? s_compiler : "c++";
+    const std::string dir = kernel_cache_dir();
+    if (dir.empty())
+        return nullptr;
+    const std::string key = kernel_toolchain(compiler) + "\n" + source;
+    std::size_t hash = std::hash<std::string>{}(key);
+    std::string stem = dir + "/pds_kernel_" + std::to_string(hash);
+
+    // Compiles only if no earlier run left the shared object behind.
+    if (!std::ifstream(stem + ".so").good())
+    {
+        std::string scratch = stem + "." + std::to_string(getpid());
+        if (!create_exclusive(scratch + ".cpp", source) || !create_exclusive(scratch + ".key", key) ||
+            !create_exclusive(scratch + ".so", ""))
+        {
+            std::cerr << "kernel scratch files " << scratch << " already exist" << std::endl;
+            return nullptr;
+        }
+        std::vector<std::string> args = split_words(compiler);
+        for (const std::string& flag : split_words(kernel_flags))
+            args.push_back(flag);
+        args.insert(args.end(), {"-o", scratch + ".so", scratch + ".cpp"});
+        bool built = run_program(args) &&
+                     rename((scratch + ".key").c_str(), (stem + ".key").c_str()) == 0 &&
+                     rename((scratch + ".so").c_str(), (stem + ".so").c_str()) == 0;
+        unlink((scratch + ".cpp").c_str());
+        if (!built)
+        {
+            unlink((scratch + ".key").c_str());
+            unlink((scratch + ".so").c_str());
+            std::cerr << "kernel failed to compile: " << scratch << ".cpp" << std::endl;
+            return nullptr;
+        }
+    }
+
+    if (!has_contents(stem + ".key", key))
+    {
+        std::cerr << "kernel " << stem << ".so was built from another source" << std::endl;
+        return nullptr;
+    }
+    library = dlopen((stem + ".so").c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!library)
+    {
+        std::cerr << "kernel failed to load: " << dlerror() << std::endl;
+        return nullptr;
+    }
+    counting_kernel kernel = reinterpret_cast<counting_kernel>(dlsym(library, "pds_count"));
+    if (!kernel)
+    {
+        dlclose(library);
+        library = nullptr;
+    }
+
+    return kernel;
+}
+
+/**
+ * Counts the total jumps and the latency by enumeration with a kernel
+ * specialized to the maps, generating and compiling it on first use.
+ *
+ * @param __isl_take src_occupancy  A map relating source location and the
+ *                                  data occupied.
+ * @param __isl_take dst_fill       A map relating destination location and
+ *                                  the data requested.
+ * @param __isl_take dist_func      The distance function to use, as a map.
+ *
+ * @return The counts, or nullptr if the kernel could not be built.
+ * @throw std::overflow_error if the total jumps do not fit a long.
+ */
+kernel_count count_by_enumeration(
+    __isl_take isl_map *src_occupancy,
+    __isl_take isl_map *dst_fill,
+    __isl_take isl_map *dist_func
+) {
+    // Keys the maps, one per line, to find a kernel already loaded by this process.
+    std::string key;
+    for (isl_map *p_map : {src_occupancy, dst_fill, dist_func})
+    {
+        char *s_map = isl_map_to_str(p_map);
+        if (!s_map)
+        {
+            isl_map_free(src_occupancy);
+            isl_map_free(dst_fill);
+            isl_map_free(dist_func);
+            return nullptr;
+        }
+        key += s_map;
+        key += "\n";
+        free(s_map);
+    }
+
+    counting_kernel kernel = kernel_cache().find(key);
+    if (kernel)
+    {
+        isl_map_free(src_occupancy);
+        isl_map_free(dst_fill);
+        isl_map_free(dist_func);
+    }
+    else
+    {
+        std::string source = generate_counting_kernel(src_occupancy, dst_fill, dist_func);
+        void *p_library = nullptr;
+        kernel = load_counting_kernel(source, p_library);
+        if (!kernel)
+            return nullptr;
+        kernel_cache().insert(key, loaded_kernel_struct{p_library, kernel});
+    }
+
+    long jumps, latency;
+    if (kernel(&jumps, &latency))
+        throw std::overflow_error("the total jumps do not fit a long");
+
+    return kernel_count(new kernel_count_struct{jumps, latency});
+}
+
+// Builds the demo driver unless compiled into the library.
+#ifndef POLYDELIVERY_LIBRARY
+int main()
+{
+    int M_int = 64;
+    int N_int = 64;
+    std::string M = std::to_string(M_int);
+    std::string N = std::to_string(N_int);
+    std::vector<int> D_vals({1, 2, 4, 8, 16, 32, 64});
+    clock_t start, end;
+    double cpu_time_used;
+    isl_ctx *p_ctx = isl_ctx_alloc();
+    MetricCache metrics(p_ctx);
+
+    for (int D_int : D_vals) {
+        start = clock();
+        std::string D = std::to_string(D_int);
+        // Defines the src occupancy map as a string.
+        std::string src_occupancy = "{[xs, ys] -> [a, b] : ("+D+"*xs)%"+M+" <= a <= ("+
+                                    D+"*xs+"+D+"-1)%"+M+" and b=ys and 0 <= xs < "+M+
+                                    " and 0 <= ys < "+N+" and 0 <= a < "+M+" and 0 <= b < "+N+" }";
+        // Defines the dst fill map as a string.
+        std::string dst_fill =  "{[xd, yd] -> [a, b] : b=yd and 0 <= xd < "+M+
+                                " and 0 <= yd < "+N+" and 0 <= a < "+M+" and 0 <= b < "+N+" }";
+        kernel_count counts = count_by_enumeration(
+            isl_map_read_from_str(p_ctx, src_occupancy.c_str()),
+            isl_map_read_from_str(p_ctx, dst_fill.c_str()),
+            metric_map<Manhattan<2>>(metrics)
+        );
+        end = clock();
+        cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
+        if (counts)
+            std::cout << "D: " << D << "\t| jumps: " << counts->jumps << "\t| latency: " << counts->latency << "\t| time: " << cpu_time_used << std::endl;
+    }
+
+    // Evaluates a parametric count natively over a million parameter points.
+    isl_pw_qpolynomial *p_count = isl_set_card(isl_set_read_from_str(
+        p_ctx, "[M, N] -> { [x, y] : 0 <= x < M and 0 <= y < N and (x + y) mod 3 = 0 }"
+    ));
+    NativeEvaluator count(p_count);
+    const long n_side = 1000;
+    std::vector<long> grid;
+    for (long m = 1; m <= n_side; m++)
+    {
+        for (long n = 1; n <= n_side; n++)
+        {
+            grid.push_back(m);
+            grid.push_back(n);
+        }
+    }
+    std::vector<double> values(n_side * n_side);
+    start = clock();
+    count.evaluate(grid.data(), values.size(), values.data());
+    end = clock();
+    cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
+
+    // Checks a grid of points spread over the range, corners included, against ISL.
+    const long stride = 37;
+    long n_checked = 0, n_mismatched = 0;
+    for (long m = 1; m <= n_side; m += stride)
+    {
+        for (long n = 1; n <= n_side; n += stride)
+        {
+            isl_point *p_point = isl_point_zero(isl_pw_qpolynomial_get_domain_space(p_count));
+            p_point = isl_point_set_coordinate_val(p_point, isl_dim_param, 0, isl_val_int_from_si(p_ctx, m));
+            p_point = isl_point_set_coordinate_val(p_point, isl_dim_param, 1, isl_val_int_from_si(p_ctx, n));
+            isl_val *p_expected = isl_pw_qpolynomial_eval(isl_pw_qpolynomial_copy(p_count), p_point);
+            n_mismatched += isl_val_get_d(p_expected) != values[(m - 1) * n_side + (n - 1)];
+            isl_val_free(p_expected);
+            n_checked++;
+        }
+    }
+    isl_pw_qpolynomial_free(p_count);
+    std::cout << "pieces: " << count.size() << "\t| checked: " << n_checked << "\t| mismatched: " << n_mismatched
+              << "\t| time: " << cpu_time_used << std::endl;
+
+    metrics.clear();
+    isl_ctx_free(p_ctx);
+
+    return 0;
+}
+#endif
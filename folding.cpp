@@ -6,6 +6,7 @@
 #include "folding.h"
 #include "latency.hpp"
 #include <memory>
+#include <stdexcept>
 #include <string>
 
 #include <isl/aff.h>
@@ -17,6 +18,32 @@
 #include <barvinok/barvinok.h>
 #include <barvinok/polylib.h>
 
+/// @brief Which ends of its trunk every datum is cast to.
+enum class fold_extent
+{
+    /// @brief The farthest point in the positive direction of the axis.
+    max,
+    /// @brief The farthest point in the negative direction of the axis.
+    min,
+    /// @brief Both, for trunks fed from inside rather than from an end.
+    both
+};
+
+/**
+ * @brief The geometry of the trunks of a layer. The fold formula maps every
+ * dst onto a trunk point; one trunk coord is the position along the trunk and
+ * the others tell the trunks apart, so a layer may have any number of trunks
+ * and twigs of any dimension. Trunks of different orientations share the
+ * trunk coords by measuring their own position along the axis.
+ */
+struct fold_geometry_struct
+{
+    /// @brief The position of the axis among the trunk coords, -1 for the last.
+    int trunk_axis = -1;
+    /// @brief The ends of its trunk every datum is cast to.
+    fold_extent extent = fold_extent::max;
+};
+
 class BranchTwig
 {
     public:
@@ -27,6 +54,8 @@ class BranchTwig
          * calculating the cost of folding. 
          */
         const std::string fold_formula;
+        /// @brief Where on its trunk every datum is cast to after folding.
+        const fold_geometry_struct fold_geometry;
         /// @brief The cost formula of the multicasting step for this layer.
         const std::string multicast_costs;
         /// @brief The src collapse formulation for the next layer.
@@ -53,13 +82,17 @@ class BranchTwig
          * the srcs and dsts of this layer to the inputs that work with next
          * layer.
          * @param ctx The context the layer is in.
+         * @param fold_geometry The trunk axis and the ends of the trunk every
+         * datum is cast to. Defaults to the farthest point along the last
+         * trunk coord.
          */
         BranchTwig(
             const std::string& crease_costs, const std::string& fold_formula,
             const std::string& multicast_costs, const collapse& collapse_formulas, 
-            isl_ctx *const ctx
+            isl_ctx *const ctx, const fold_geometry_struct& fold_geometry = {}
         ):
-        crease_costs(crease_costs), fold_formula(fold_formula), multicast_costs(multicast_costs), 
+        crease_costs(crease_costs), fold_formula(fold_formula), fold_geometry(fold_geometry),
+        multicast_costs(multicast_costs), 
         src_collapser(collapse_formulas->src_collapser), dst_collapser(collapse_formulas->dst_collapser),
         ctx(ctx) {}
 
@@ -77,15 +110,12 @@ class BranchTwig
         {
             // Folds the destinations onto their connected trunk.
             const fold_result fold_res = this->fold(s_dsts);
-            std::cout << "Crease Cost: " << fold_res->cost << std::endl;
+            std::cout << "Crease Cost: " << fold_res->cost->repr << std::endl;
             // std::cout << "Folded: " << fold_res->folded_repr << std::endl;
 
             // Calculates the cost to every folded node per datum.
-            const long casting_cost = this->multicast(fold_res->folded_repr);
-            std::cout << "Casting Cost: " << casting_cost << std::endl;
-
-            // Calculates the total cost of the layer.
-            const long total_cost = fold_res->cost + casting_cost;
+            const exact casting_cost = val_to_exact(this->multicast(fold_res->folded_repr));
+            std::cout << "Casting Cost: " << casting_cost->repr << std::endl;
 
             // Calculates the requests that are not satisfied by the layer.
             ///@todo Collapse the folded destinations into the next layer.
@@ -98,6 +128,22 @@ class BranchTwig
         {
             return this->evaluate(b->srcs, b->dsts);
         }
+
+        /**
+         * @brief Calculates the cost of the atomic units of this layer without
+         * collapsing or printing, for callers that only need the number.
+         *
+         * @param s_dsts The destinations of the bindings at this layer as an ISL string.
+         *
+         * @return The crease cost plus the casting cost of the layer, exact
+         * past the range of a long.
+         */
+        exact cost(const std::string& s_dsts)
+        {
+            // Folds first, as only folding throws.
+            const std::string folded = this->fold_dsts(s_dsts);
+            return val_to_exact(isl_val_add(this->crease_cost(s_dsts), this->multicast(folded)));
+        }
     private:
         /** 
          * @brief Folds the destinations onto their connected trunk. 
@@ -108,12 +154,26 @@ class BranchTwig
          */
         fold_result fold(const std::string& dsts)
         {
-            // Reads the dsts into isl format.
-            isl_map *p_dsts = isl_map_read_from_str(ctx, dsts.c_str());
-            
+            // Initializes the struct ptr to return.
+            fold_result result = fold_result(new fold_struct{
+                val_to_exact(this->crease_cost(dsts)), this->fold_dsts(dsts)
+            });
+
+            return result;
+        }
+
+        /**
+         * @brief Calculates the cost to cast all data of the destinations
+         * from the trunk.
+         *
+         * @param s_dsts The destinations to fold as an ISL string.
+         * @return __isl_give The exact cost of the folding step.
+         */
+        isl_val *crease_cost(const std::string& dsts)
+        {
             /// @note Gets the total cost of the folded dsts.
             // Returns { [id, x, y] -> number_of_data}
-            isl_pw_qpolynomial *p_card = isl_map_card(isl_map_copy(p_dsts));
+            isl_pw_qpolynomial *p_card = isl_map_card(isl_map_read_from_str(ctx, dsts.c_str()));
             // Calculates the cost per datum per dst cast from the trunk.
             isl_pw_qpolynomial *p_fold_cost = isl_pw_qpolynomial_read_from_str(ctx, this->crease_costs.c_str());
             DUMP(p_fold_cost);
@@ -124,11 +184,21 @@ class BranchTwig
             isl_pw_qpolynomial *p_total_cost = isl_pw_qpolynomial_sum(p_cost_at_dst);
             DUMP(p_total_cost);
             // Reads the value from p_total_cost.
-            isl_val *v_total_cost = isl_pw_qpolynomial_eval(p_total_cost, isl_point_zero(isl_pw_qpolynomial_get_domain_space(p_total_cost)));
-            // Initializes the variable storing the cost of folding.
-            long fold_cost = isl_val_get_num_si(v_total_cost);
-            // Frees the values.
-            isl_val_free(v_total_cost);
+            return isl_pw_qpolynomial_eval(p_total_cost, isl_point_zero(isl_pw_qpolynomial_get_domain_space(p_total_cost)));
+        }
+
+        /**
+         * @brief Folds the destinations onto the trunk according to the fold
+         * formula, keeping the ends of the trunk set by the fold geometry.
+         *
+         * @param s_dsts The destinations to fold as an ISL string.
+         * @return The folded destinations as an ISL string.
+         * @throw std::invalid_argument if the fold formula does not apply.
+         */
+        std::string fold_dsts(const std::string& dsts)
+        {
+            // Reads the dsts into isl format.
+            isl_map *p_dsts = isl_map_read_from_str(ctx, dsts.c_str());
 
             /// @note Folds p_dsts onto the trunk according to the fold formula.
             // Reads the fold formula into isl format.
@@ -137,34 +207,55 @@ class BranchTwig
             isl_map *p_data_to_dsts = isl_map_reverse(p_dsts);
             // Folds the dsts onto the trunk.
             isl_map *p_folded = isl_map_apply_range(p_data_to_dsts, p_fold);
-            p_folded = isl_map_reverse(p_folded);
-            // std::cout << "P_Folded: " << isl_map_to_str(p_folded) << std::endl;
-            // Gets the largest y value per datum.
-            /// @todo Functionalize this.
-            std::string all_after = "{ trunk[id, y] -> trunk[id, y'] : y' > y }";
-            isl_map *p_all_after = isl_map_read_from_str(ctx, all_after.c_str());
-            isl_map *p_max_y = isl_map_apply_range(p_all_after, isl_map_copy(p_folded));
-            DUMP(p_max_y);
-            isl_map *p_folded_condensed = isl_map_subtract(p_folded, p_max_y);
-            p_folded_condensed = isl_map_reverse(p_folded_condensed);
+            DUMP(p_folded);
+            // Splits the trunk coords into the trunk identity and the axis, i.e.
+            // [data -> [others]] -> [axis].
+            isl_space *p_trunk_space = isl_space_range(isl_map_get_space(p_folded));
+            int n_trunk = isl_space_dim(p_trunk_space, isl_dim_set);
+            int axis = this->fold_geometry.trunk_axis < 0 ? n_trunk - 1 : this->fold_geometry.trunk_axis;
+            isl_map *p_isolate = isolate_dim_map(p_trunk_space, axis);
+            isl_map *p_split = isl_map_uncurry(isl_map_apply_range(p_folded, isl_map_copy(p_isolate)));
+            // Gets the farthest points along the axis per datum per trunk.
+            isl_map *p_extent;
+            switch (this->fold_geometry.extent)
+            {
+                case fold_extent::min:
+                    p_extent = isl_map_lexmin(p_split);
+                    break;
+                case fold_extent::both:
+                    p_extent = isl_map_union(isl_map_lexmin(isl_map_copy(p_split)), isl_map_lexmax(p_split));
+                    break;
+                case fold_extent::max:
+                default:
+                    p_extent = isl_map_lexmax(p_split);
+                    break;
+            }
+            // Puts the axis back in place, i.e. data -> trunk.
+            isl_map *p_folded_condensed = isl_map_apply_range(
+                isl_map_curry(p_extent), isl_map_reverse(p_isolate)
+            );
+            DUMP(p_folded_condensed);
             // Converts p_folded_condensed to a string.
-            std::string s_folded_condensed = isl_map_to_str(p_folded_condensed);
+            char *s_folded = isl_map_to_str(p_folded_condensed);
             // Frees the maps.
             isl_map_free(p_folded_condensed);
+            // A fold formula that does not apply to the dsts leaves no map.
+            if (!s_folded)
+                throw std::invalid_argument("fold formula does not apply to the dsts");
+            std::string s_folded_condensed(s_folded);
+            free(s_folded);
 
-            // Initializes the struct ptr to return.
-            fold_result result = fold_result(new fold_struct{fold_cost, s_folded_condensed});
-
-            return result;
+            return s_folded_condensed;
         }
 
         /** 
          * @brief Calculates the the cost to every folded node per datum.
          * 
          * @param folded_geometry The folded destinations from this->fold(*).
-         * @return The cost of multicasting to the folded destinations.
+         * @return __isl_give The exact cost of multicasting to the folded
+         * destinations.
          */
-        long multicast(const std::string& s_folded_bindings)
+        isl_val *multicast(const std::string& s_folded_bindings)
         {
             // Reads the folded destinations into isl format.
             isl_map *p_folded_bindings = isl_map_read_from_str(ctx, s_folded_bindings.c_str());
@@ -180,13 +271,7 @@ class BranchTwig
             // Sums all the costs.
             isl_pw_qpolynomial *p_total_cost = isl_pw_qpolynomial_sum(p_cost_applied);
             // Evaluates the cost.
-            isl_val *v_total_cost = isl_pw_qpolynomial_eval(p_total_cost, isl_point_zero(isl_pw_qpolynomial_get_domain_space(p_total_cost)));
-            // Initializes the return value to the cost of multicasting.
-            long cost = isl_val_get_d(v_total_cost);
-            // Frees the values.
-            isl_val_free(v_total_cost);
-
-            return cost;
+            return isl_pw_qpolynomial_eval(p_total_cost, isl_point_zero(isl_pw_qpolynomial_get_domain_space(p_total_cost)));
         }
 
         /**
@@ -215,19 +300,28 @@ class BranchTwig
             // Collapses all src requests.
             isl_map *p_collapsed_srcs = isl_map_apply_range(p_collapse_srcs, p_srcs);
             // Converts p_collapsed_srcs to a string.
-            std::string s_collapsed_srcs = isl_map_to_str(p_collapsed_srcs);
+            char *s_collapsed_srcs = isl_map_to_str(p_collapsed_srcs);
             // Collapses all dst requests to the same format as their SRCs.
             isl_map *p_collapsed_dsts = isl_map_apply_range(p_collapse_dsts, p_dsts);
 
             // Calculates the requests that are not satisfied by the layer.
             isl_map *p_missing_data = isl_map_subtract(p_collapsed_dsts, p_collapsed_srcs);
             // Converts p_missing to a string.
-            std::string s_missing_data = isl_map_to_str(p_missing_data);
+            char *s_missing_data = isl_map_to_str(p_missing_data);
             // Frees the maps.
             isl_map_free(p_missing_data);
 
+            // Collapse formulas that do not apply to the bindings leave no map.
+            if (!s_collapsed_srcs || !s_missing_data)
+            {
+                free(s_collapsed_srcs);
+                free(s_missing_data);
+                throw std::invalid_argument("collapse formulas do not apply to the bindings");
+            }
             // Initializes the collapsed binding abstraction for the next layer.
             binding collapsed = binding(new binding_struct{s_collapsed_srcs, s_missing_data});
+            free(s_collapsed_srcs);
+            free(s_missing_data);
             return collapsed;
         }
 };
@@ -252,6 +346,8 @@ class BranchTrunk
         isl_ctx *const ctx;
 };
 
+// Builds the demo driver unless compiled into the library.
+#ifndef POLYDELIVERY_LIBRARY
 int main(int argc, char* argv[])
 {
     // Creates an isl context.
@@ -304,4 +400,5 @@ int main(int argc, char* argv[])
     isl_ctx_free(ctx);
 
     return 0;
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,463 @@
+#pragma once
+
+/**
+ * The solvers shared by the batch front ends, and the job file they read.
+ *
+ * A job file has one job per line: the kind of job, then its ISL strings, all
+ * separated by tabs. Blank lines and lines starting with '#' are skipped.
+ *
+ *  latency\t{ src[x] -> data[x] }\t{ dst[x] -> data[x] }\t{ dst[x] -> src[y] -> [x - y] }
+ */
+// Compiles the drivers below without their demo mains.
+#ifndef POLYDELIVERY_LIBRARY
+#define POLYDELIVERY_LIBRARY
+#endif
+#include "latency.cpp"
+#include "meshcast.cpp"
+#include "folding.cpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <isl/ctx.h>
+#include <isl/options.h>
+
+/// @brief A solve on string inputs inside a context owned by the job.
+typedef exact (*solve_fn)(isl_ctx *p_ctx, const std::vector<std::string>& args);
+
+/**
+ * Reads every argument as an isl_map.
+ *
+ * @param p_ctx     The context to read into.
+ * @param args      The ISL strings.
+ * @param maps      Filled with one __isl_give isl_map per argument.
+ *
+ * @return Whether every argument parsed. On failure every map is freed.
+ */
+bool read_maps(isl_ctx *p_ctx, const std::vector<std::string>& args, std::vector<isl_map*>& maps)
+{
+    bool parsed = true;
+    for (const std::string& arg : args)
+    {
+        maps.push_back(isl_map_read_from_str(p_ctx, arg.c_str()));
+        parsed = parsed && maps.back() != nullptr;
+    }
+    if (!parsed)
+    {
+        for (isl_map *p_map : maps)
+            isl_map_free(p_map);
+    }
+
+    return parsed;
+}
+
+/// @brief Solves (srcs, dsts, dist) with analyze_jumps.
+exact solve_jumps(isl_ctx *p_ctx, const std::vector<std::string>& args)
+{
+    std::vector<isl_map*> maps;
+    if (!read_maps(p_ctx, args, maps))
+        return val_to_exact(nullptr);
+    return analyze_jumps_exact(maps[0], maps[1], maps[2]);
+}
+
+/// @brief Solves (srcs, dsts, dist) with analyze_latency.
+exact solve_latency(isl_ctx *p_ctx, const std::vector<std::string>& args)
+{
+    std::vector<isl_map*> maps;
+    if (!read_maps(p_ctx, args, maps))
+        return val_to_exact(nullptr);
+    return analyze_latency_exact(maps[0], maps[1], maps[2]);
+}
+
+/// @brief Solves (srcs, dsts, dist) with identify_mesh_casts then cost_mesh_cast.
+exact solve_mesh_cast(isl_ctx *p_ctx, const std::vector<std::string>& args)
+{
+    std::vector<isl_map*> maps;
+    if (!read_maps(p_ctx, args, maps))
+        return val_to_exact(nullptr);
+    isl_map *p_networks = identify_mesh_casts(maps[0], maps[1], isl_map_copy(maps[2]));
+    return cost_mesh_cast_exact(p_networks, maps[2]);
+}
+
+/// @brief Solves (crease_costs, fold_formula, multicast_costs, dsts) with BranchTwig::cost.
+exact solve_twig(isl_ctx *p_ctx, const std::vector<std::string>& args)
+{
+    // Checks every formula parses, as BranchTwig takes them as strings.
+    isl_pw_qpolynomial *p_crease_costs = isl_pw_qpolynomial_read_from_str(p_ctx, args[0].c_str());
+    isl_map *p_fold = isl_map_read_from_str(p_ctx, args[1].c_str());
+    isl_pw_qpolynomial *p_multicast_costs = isl_pw_qpolynomial_read_from_str(p_ctx, args[2].c_str());
+    isl_map *p_dsts = isl_map_read_from_str(p_ctx, args[3].c_str());
+    bool parsed = p_crease_costs && p_fold && p_multicast_costs && p_dsts;
+    isl_pw_qpolynomial_free(p_crease_costs);
+    isl_map_free(p_fold);
+    isl_pw_qpolynomial_free(p_multicast_costs);
+    isl_map_free(p_dsts);
+    if (!parsed)
+        return val_to_exact(nullptr);
+
+    // The collapse formulas are not used for the cost.
+    collapse no_collapse = collapse(new collapse_struct{"", ""});
+    BranchTwig twig(args[0], args[1], args[2], no_collapse, p_ctx);
+
+    return twig.cost(args[3]);
+}
+
+/**
+ * Solves one job in a fresh context that reports ISL errors instead of
+ * aborting and catches whatever the solver throws, so a malformed job fails
+ * alone.
+ *
+ * @param solve     The solver to run.
+ * @param args      The ISL strings of the job.
+ * @param value     Set to the solved value if it fits, else 0.
+ * @param repr      Set to the exact value, or the reason the job failed.
+ *
+ * @return Whether ISL solved the job without error and it fits in a long.
+ */
+bool solve_job(solve_fn solve, const std::vector<std::string>& args, long& value, std::string& repr)
+{
+    isl_ctx *p_ctx = isl_ctx_alloc();
+    isl_options_set_on_error(p_ctx, ISL_ON_ERROR_CONTINUE);
+
+    bool ok = false;
+    value = 0;
+    try
+    {
+        exact result = solve(p_ctx, args);
+        if (isl_ctx_last_error(p_ctx) != isl_error_none)
+        {
+            const char *s_msg = isl_ctx_last_error_msg(p_ctx);
+            repr = s_msg ? s_msg : "ISL error";
+        }
+        else
+        {
+            ok = result->fits;
+            value = result->value;
+            repr = result->repr;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        repr = e.what();
+    }
+
+    isl_ctx_free(p_ctx);
+
+    return ok;
+}
+
+/// @brief A kind of job and the number of ISL strings it takes.
+struct job_kind_struct
+{
+    /// @brief The name of the kind in job files, e.g. "latency".
+    const char *name;
+    /// @brief The solver to run.
+    solve_fn solve;
+    /// @brief The number of ISL strings per job.
+    std::size_t arity;
+    /// @brief Which ISL string is the distance metric, or -1 for none.
+    int metric_arg;
+};
+
+/// @brief Every kind of job a job file may hold.
+const job_kind_struct job_kinds[] = {
+    {"jumps", solve_jumps, 3, 2},
+    {"latency", solve_latency, 3, 2},
+    {"mesh_cast", solve_mesh_cast, 3, 2},
+    {"twig", solve_twig, 4, -1}
+};
+
+/// @brief The kind named name, or nullptr if there is none.
+inline const job_kind_struct *find_job_kind(const std::string& name)
+{
+    for (const job_kind_struct& kind : job_kinds)
+    {
+        if (name == kind.name)
+            return &kind;
+    }
+    return nullptr;
+}
+
+/// @brief One job of a job file.
+struct job_struct
+{
+    /// @brief The kind of the job.
+    const job_kind_struct *kind;
+    /// @brief The ISL strings of the job.
+    std::vector<std::string> args;
+    /// @brief The line of the job file it came from.
+    long line_no;
+};
+
+/**
+ * Reads a job file.
+ *
+ * @param path  The job file.
+ *
+ * @return The jobs in file order.
+ * @throw std::invalid_argument if the file cannot be opened, or a line names
+ * an unknown kind or has the wrong number of ISL strings.
+ */
+std::vector<job_struct> read_job_file(const std::string& path)
+{
+    std::ifstream in(path);
+    if (!in)
+        throw std::invalid_argument("cannot open " + path);
+
+    std::vector<job_struct> jobs;
+    std::string line;
+    for (long line_no = 1; std::getline(in, line); line_no++)
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        // Splits the line on tabs.
+        std::vector<std::string> fields;
+        for (std::size_t start = 0, end; ; start = end + 1)
+        {
+            end = line.find('\t', start);
+            fields.push_back(line.substr(start, end == std::string::npos ? end : end - start));
+            if (end == std::string::npos)
+                break;
+        }
+
+        const job_kind_struct *p_kind = find_job_kind(fields[0]);
+        if (!p_kind)
+            throw std::invalid_argument("line " + std::to_string(line_no) + " has unknown kind " + fields[0]);
+        if (fields.size() - 1 != p_kind->arity)
+            throw std::invalid_argument(
+                "line " + std::to_string(line_no) + " needs " + std::to_string(p_kind->arity) + " ISL strings"
+            );
+        jobs.push_back(job_struct{p_kind, std::vector<std::string>(fields.begin() + 1, fields.end()), line_no});
+    }
+
+    return jobs;
+}
+
+/**
+ * Solve time prediction, for scheduling batches whose solve times are heavy
+ * tailed. A job is reduced to a few counts that are cheap to read off its
+ * inputs, and its time predicted as exp(weights . terms) over their logs. The
+ * weights are refit by least squares to the times logged by earlier runs.
+ */
+
+/// @brief The counts a solve time is predicted from.
+struct job_features_struct
+{
+    /// @brief The product of the piece counts of the inputs other than the metric.
+    double pieces = 1;
+    /// @brief The constraints over every input.
+    double constraints = 0;
+    /// @brief The existentials, i.e. divs, over every input.
+    double divs = 0;
+    /// @brief The pieces of the metric.
+    double metric_pieces = 1;
+};
+
+/// @brief The counts of one map, accumulated per basic map.
+struct map_counts_struct
+{
+    long pieces = 0;
+    long constraints = 0;
+    long divs = 0;
+};
+
+isl_stat count_basic_map(isl_basic_map *p_bmap, void *p_user)
+{
+    map_counts_struct *p_counts = static_cast<map_counts_struct*>(p_user);
+    p_counts->pieces++;
+    p_counts->constraints += isl_basic_map_n_constraint(p_bmap);
+    p_counts->divs += isl_basic_map_dim(p_bmap, isl_dim_div);
+    isl_basic_map_free(p_bmap);
+    return isl_stat_ok;
+}
+
+/**
+ * Reads the counts of a job off its inputs in a throwaway context. Inputs
+ * that are not maps, e.g. cost formulas, are skipped.
+ *
+ * @param args          The ISL strings of the job.
+ * @param metric_arg    Which string is the metric, or -1 for none.
+ */
+job_features_struct measure_job(const std::vector<std::string>& args, int metric_arg)
+{
+    job_features_struct features;
+    isl_ctx *p_ctx = isl_ctx_alloc();
+    isl_options_set_on_error(p_ctx, ISL_ON_ERROR_CONTINUE);
+    for (std::size_t a = 0; a < args.size(); a++)
+    {
+        isl_map *p_map = isl_map_read_from_str(p_ctx, args[a].c_str());
+        if (!p_map)
+            continue;
+        map_counts_struct counts;
+        isl_map_foreach_basic_map(p_map, count_basic_map, &counts);
+        isl_map_free(p_map);
+
+        if ((int) a == metric_arg)
+            features.metric_pieces = std::max(1L, counts.pieces);
+        else
+            features.pieces *= std::max(1L, counts.pieces);
+        features.constraints += counts.constraints;
+        features.divs += counts.divs;
+    }
+    isl_ctx_free(p_ctx);
+
+    return features;
+}
+
+/// @brief The number of terms of the cost model, including the bias.
+const int n_cost_terms = 5;
+
+/// @brief The weights of the cost model, defaulting to a rough prior.
+struct cost_model_struct
+{
+    double weights[n_cost_terms] = {-10, 1, 0.5, 0.5, 1};
+};
+
+/// @brief The terms of the cost model for the given counts.
+inline void cost_terms(const job_features_struct& features, double terms[n_cost_terms])
+{
+    terms[0] = 1;
+    terms[1] = std::log1p(features.pieces);
+    terms[2] = std::log1p(features.constraints);
+    // Every div may split the pieces, so it weighs in exponentially.
+    terms[3] = features.divs;
+    terms[4] = std::log1p(features.metric_pieces);
+}
+
+/// @brief The predicted solve time of a job in seconds.
+inline double predict_seconds(const cost_model_struct& model, const job_features_struct& features)
+{
+    double terms[n_cost_terms];
+    cost_terms(features, terms);
+    return std::exp(std::inner_product(terms, terms + n_cost_terms, model.weights, 0.0));
+}
+
+/// @brief The predicted and actual solve time of one job.
+struct timing_struct
+{
+    std::string kind;
+    job_features_struct features;
+    double predicted;
+    double actual;
+    /// @brief Whether the job was cut short, so actual only bounds its time from below.
+    bool censored = false;
+};
+
+/**
+ * Appends timings to a tab separated log, one line per job: kind, pieces,
+ * constraints, divs, metric pieces, predicted and actual seconds, and 1 if the
+ * time is censored.
+ */
+void append_timings(const std::string& path, const std::vector<timing_struct>& timings)
+{
+    std::ofstream out(path, std::ios::app);
+    for (const timing_struct& t : timings)
+    {
+        out << t.kind << "\t" << t.features.pieces << "\t" << t.features.constraints << "\t"
+            << t.features.divs << "\t" << t.features.metric_pieces << "\t" << t.predicted << "\t"
+            << t.actual << "\t" << t.censored << "\n";
+    }
+}
+
+/**
+ * Reads a log written by append_timings; a missing log reads as empty. Lines
+ * without the censored column, from older logs, read as uncensored.
+ */
+std::vector<timing_struct> read_timings(const std::string& path)
+{
+    std::vector<timing_struct> timings;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        timing_struct t;
+        if (!(fields >> t.kind >> t.features.pieces >> t.features.constraints >> t.features.divs
+                     >> t.features.metric_pieces >> t.predicted >> t.actual))
+            continue;
+        int censored = 0;
+        t.censored = (fields >> censored) && censored != 0;
+        timings.push_back(t);
+    }
+
+    return timings;
+}
+
+/**
+ * Refits the cost model to logged times by least squares on log seconds,
+ * pulled towards the prior weights so a short log cannot make it wild. A
+ * censored time enters at its bound, so jobs that timed out still pull their
+ * predictions up rather than leaving the fit to the jobs that finished.
+ *
+ * @param timings   The logged times.
+ * @param prior     How many jobs' worth of weight the prior weights get.
+ */
+cost_model_struct fit_cost_model(const std::vector<timing_struct>& timings, double prior = 8)
+{
+    cost_model_struct model;
+    // Builds the normal equations (X'X + prior I) w = X'y + prior w0.
+    double a[n_cost_terms][n_cost_terms + 1] = {};
+    for (int i = 0; i < n_cost_terms; i++)
+    {
+        a[i][i] = prior;
+        a[i][n_cost_terms] = prior * model.weights[i];
+    }
+    for (const timing_struct& t : timings)
+    {
+        if (!(t.actual > 0))
+            continue;
+        double terms[n_cost_terms];
+        cost_terms(t.features, terms);
+        for (int i = 0; i < n_cost_terms; i++)
+        {
+            for (int j = 0; j < n_cost_terms; j++)
+                a[i][j] += terms[i] * terms[j];
+            a[i][n_cost_terms] += terms[i] * std::log(t.actual);
+        }
+    }
+
+    // Solves them by Gaussian elimination; the prior keeps them well posed.
+    for (int c = 0; c < n_cost_terms; c++)
+    {
+        int pivot = c;
+        for (int r = c + 1; r < n_cost_terms; r++)
+        {
+            if (std::fabs(a[r][c]) > std::fabs(a[pivot][c]))
+                pivot = r;
+        }
+        std::swap(a[c], a[pivot]);
+        for (int r = 0; r < n_cost_terms; r++)
+        {
+            if (r == c)
+                continue;
+            double factor = a[r][c] / a[c][c];
+            for (int k = c; k <= n_cost_terms; k++)
+                a[r][k] -= factor * a[c][k];
+        }
+    }
+    for (int i = 0; i < n_cost_terms; i++)
+        model.weights[i] = a[i][n_cost_terms] / a[i][i];
+
+    return model;
+}
+
+/// @brief The job order that starts the longest predicted jobs first.
+std::vector<std::size_t> longest_first(const std::vector<double>& predicted)
+{
+    std::vector<std::size_t> order(predicted.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+        return predicted[a] > predicted[b];
+    });
+
+    return order;
+}
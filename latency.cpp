@@ -1,5 +1,17 @@
 #include "latency.hpp"
+#include "metrics.hpp"
+#include <signal.h>
+#include <sys/wait.h>
 #include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <optional>
+#include <sstream>
+
+#include <isl/options.h>
 
 struct qpolynomial_from_fold_info
 {
@@ -51,6 +63,8 @@ gather_pw_qpolynomial_from_fold(__isl_take isl_pw_qpolynomial_fold* pwqpf)
   return p_pwqp;
 }
 
+// Builds the demo driver unless compiled into the library.
+#ifndef POLYDELIVERY_LIBRARY
 int main(int argc, char* argv[])
 {
     int M_int = 1024;
@@ -76,68 +90,153 @@ int main(int argc, char* argv[])
     
         // long latency = analyze_latency(src_occupancy, dst_fill, dist_func_str);
         // std::cout << "latency: " << latency << std::endl;
-        long jumps = analyze_jumps(src_occupancy, dst_fill, dist_func_str);
+        long latency = analyze_latency_bisect(src_occupancy, dst_fill, dist_func_str);
+        std::cout << "bisected latency: " << latency << std::endl;
+        // Reruns the latency under a 1 GiB ceiling, slicing if it does not fit.
+        budgeted bounded = analyze_budgeted(
+            budgeted_analysis::latency, src_occupancy, dst_fill, dist_func_str, 1L << 30
+        );
+        std::cout << "budgeted latency: " << bounded->value << " | slices: " << bounded->slices << std::endl;
+        if (islIntermediates)
+        {
+            for (const stage_usage_struct& stage : bounded->stages)
+                std::cout << stage.stage << "\t| time: " << stage.seconds << "\t| peak: " << stage.peak_rss << std::endl;
+        }
+        exact jumps = analyze_jumps_exact(src_occupancy, dst_fill, dist_func_str);
         end = clock();
         cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
-        std::cout << "D: " << D << "\t| jumps: " << jumps << "\t| time: " << cpu_time_used << std::endl;
+        std::cout << "D: " << D << "\t| jumps: " << jumps->repr << "\t| time: " << cpu_time_used << std::endl;
     }
+
+    // Moves 1 byte inputs along the rows and 2 byte weights along the columns together.
+    std::string src_occupancy = "{ [xs, ys] -> I[a, b] : a = xs and b = ys and 0 <= xs < 64 and 0 <= ys < 64; "
+                                "[xs, ys] -> W[a, b] : a = xs and b = 0 and 0 <= xs < 64 and ys = 0 }";
+    std::string dst_fill = "{ [xd, yd] -> I[a, b] : a = xd and 0 <= b < 64 and 0 <= xd < 64 and 0 <= yd < 64; "
+                           "[xd, yd] -> W[a, b] : 0 <= a < 64 and b = 0 and 0 <= xd < 64 and 0 <= yd < 64 }";
+    joint_jumps joint = analyze_joint_jumps(
+        src_occupancy, dst_fill, nd_manhattan_metric({"xs", "ys"}, {"xd", "yd"}), {{"I", 1}, {"W", 2}}
+    );
+    for (const tensor_jumps_struct& t : joint->tensors)
+        std::cout << t.tensor << "\t| jumps: " << t.jumps->repr << "\t| byte jumps: " << t.byte_jumps->repr << std::endl;
+    std::cout << "total byte jumps: " << joint->byte_jumps->repr << std::endl;
+
+    // Routes by hops between two 32 x 32 dies, then prices the same transfers
+    // in hops, in pJ (8 per die-to-die hop, 1 per on-die hop) and in links
+    // used per level. Die 0 holds every datum, die 1 only the first 16 rows.
+    std::vector<std::string> src_dims({"ds", "xs", "ys"});
+    std::vector<std::string> dst_dims({"dd", "xd", "yd"});
+    std::string hops = nd_manhattan_metric(src_dims, dst_dims);
+    // Counts the links per level as costs; they are no metrics as they ignore dims.
+    std::string die_links = "{ [[dd, xd, yd] -> [ds, xs, ys]] -> [dd - ds] : dd >= ds; "
+                            "[[dd, xd, yd] -> [ds, xs, ys]] -> [ds - dd] : dd < ds }";
+    std::string on_die_links = "{ [[dd, xd, yd] -> [ds, xs, ys]] -> [(xd - xs) + (yd - ys)] : xd >= xs and yd >= ys; "
+                               "[[dd, xd, yd] -> [ds, xs, ys]] -> [(xs - xd) + (ys - yd)] : xd < xs and yd < ys; "
+                               "[[dd, xd, yd] -> [ds, xs, ys]] -> [(xs - xd) + (yd - ys)] : xd < xs and yd >= ys; "
+                               "[[dd, xd, yd] -> [ds, xs, ys]] -> [(xd - xs) + (ys - yd)] : xd >= xs and yd < ys }";
+    metric_table table = analyze_metric_table(
+        "{ [ds, xs, ys] -> [a, b] : a = xs and b = ys and 0 <= xs < 32 and 0 <= ys < 32 "
+        "and (ds = 0 or (ds = 1 and xs < 16)) }",
+        "{ [dd, xd, yd] -> [a, b] : a = xd and b = yd and 0 <= dd < 2 and 0 <= xd < 32 and 0 <= yd < 32 }",
+        hops, {
+            {"hops", hops},
+            {"energy", nd_weighted_manhattan_metric(src_dims, dst_dims, {8, 1, 1})},
+            {"die links", die_links},
+            {"on-die links", on_die_links}
+        }
+    );
+    for (const metric_total_struct& m : table->metrics)
+        std::cout << m.metric << "\t| total: " << m.total->repr << std::endl;
 }
+#endif
 
 /**
- * Minimizes the distance between every dst and src per data.
+ * Relates every (dst, datum) request to every src holding the datum.
+ * 
+ * @param __isl_take src_occ    A map relating source location and the data
+ *                              occupied.
+ * @param __isl_take dst_fill   A map relating destination location and the
+ *                              data requested.
+ *
+ * @return __isl_give           { [dst -> data] -> [dst -> src] }
+ */
+__isl_give isl_map *request_pairs(
+    __isl_take isl_map *src_occ,
+    __isl_take isl_map *dst_fill
+) {
+    // Makes { [dst -> data] -> src } by looking the datum up in the srcs.
+    isl_map *p_request_srcs = isl_map_apply_range(
+        isl_map_range_map(isl_map_copy(dst_fill)), isl_map_reverse(src_occ)
+    );
+    // Keeps the dst alongside the src.
+    return isl_map_range_product(isl_map_domain_map(dst_fill), p_request_srcs);
+}
+
+/// @brief request_pairs over every tensor of a union, told apart by data tuple.
+__isl_give isl_union_map *request_pairs(
+    __isl_take isl_union_map *src_occ,
+    __isl_take isl_union_map *dst_fill
+) {
+    isl_union_map *p_request_srcs = isl_union_map_apply_range(
+        isl_union_map_range_map(isl_union_map_copy(dst_fill)), isl_union_map_reverse(src_occ)
+    );
+    return isl_union_map_range_product(isl_union_map_domain_map(dst_fill), p_request_srcs);
+}
+
+/**
+ * Relates every (dst, datum) request to the distance of every src holding the
+ * datum.
  * 
  * @param __isl_take p_src_occupancy    A map relating source location and the
  *                                      data occupied.
  * @param __isl_take p_dst_fill         A map relating destination location and
  *                                      the data requested.
  * @param __isl_take dist_func          The distance function to use, as a map.
+ *
+ * @return __isl_give                   { [dst -> data] -> [dist] }
  */ 
-__isl_give isl_pw_qpolynomial *minimize_jumps(
+__isl_give isl_map *request_distances(
     __isl_take isl_map *src_occupancy, 
     __isl_take isl_map *dst_fill, 
     __isl_take isl_map *dist_func
 ) {
-    /* Makes [[dst -> data] -> dst] -> [data] */
-    isl_set* wrapped_dst_fill = isl_map_wrap(dst_fill);
-    isl_map* wrapped_fill_identity =
-        isl_map_identity(isl_space_map_from_set(isl_set_get_space(
-            wrapped_dst_fill
-        )));
-    DUMP(wrapped_fill_identity);
-    wrapped_fill_identity = isl_map_intersect_domain(
-        wrapped_fill_identity,
-        wrapped_dst_fill
-    );
-    DUMP(wrapped_fill_identity);
-    /* Makes [dst -> data] -> [dst -> data] */
-    isl_map* uncurried_fill_identity = isl_map_uncurry(wrapped_fill_identity);
-    DUMP(uncurried_fill_identity);
-
-    /* Inverts src_occupancy such that data implies source.
-     * i.e. {[xs, ys] -> [d0, d1]} becomes {[d0, d1] -> [xs, ys]} */
-    isl_map *src_occupancy_inverted = isl_map_reverse(src_occupancy);
-    DUMP(src_occupancy_inverted);
-
-    isl_map* dst_to_data_to_dst_TO_src = isl_map_apply_range(
-        uncurried_fill_identity,
-        src_occupancy_inverted
-    );
-    DUMP(dst_to_data_to_dst_TO_src);
-
-    isl_map* dst_to_data_TO_dst_to_src =
-        isl_map_curry(dst_to_data_to_dst_TO_src);
-
     // Calculates the distance of all the dst-src pairs with matching data.
     isl_map *distances_map = isl_map_apply_range(
-        dst_to_data_TO_dst_to_src, dist_func
+        request_pairs(src_occupancy, dst_fill), dist_func
     );
     DUMP(distances_map);
 
+    return distances_map;
+}
+
+/**
+ * Minimizes the distance between every dst and src per data.
+ * 
+ * @param __isl_take p_src_occupancy    A map relating source location and the
+ *                                      data occupied.
+ * @param __isl_take p_dst_fill         A map relating destination location and
+ *                                      the data requested.
+ * @param __isl_take dist_func          The distance function to use, as a map.
+ *
+ * @return The nearest distance per [dst -> data], or NULL if ISL failed or
+ *         dist_func does not give exactly one distance per pair.
+ */ 
+__isl_give isl_pw_qpolynomial *minimize_jumps(
+    __isl_take isl_map *src_occupancy, 
+    __isl_take isl_map *dst_fill, 
+    __isl_take isl_map *dist_func
+) {
+    isl_map *distances_map = request_distances(src_occupancy, dst_fill, dist_func);
+
     // Converts the distances map to a piecewise affine.
     isl_map *lexmin_distances = isl_map_lexmin(distances_map);
     isl_multi_pw_aff *dirty_distances_aff =isl_multi_pw_aff_from_pw_multi_aff(isl_pw_multi_aff_from_map(lexmin_distances));
     DUMP(dirty_distances_aff);
-    assert(isl_multi_pw_aff_size(dirty_distances_aff) == 1);
+    // A malformed distance gives no or several results per request.
+    if (isl_multi_pw_aff_size(dirty_distances_aff) != 1)
+    {
+        isl_multi_pw_aff_free(dirty_distances_aff);
+        return NULL;
+    }
     isl_pw_aff *distances_aff = isl_multi_pw_aff_get_at(dirty_distances_aff, 0);
     DUMP(distances_aff);
     isl_multi_pw_aff_free(dirty_distances_aff);
@@ -157,8 +256,10 @@ __isl_give isl_pw_qpolynomial *minimize_jumps(
  * @param p_dst_fill         A map relating destination location and
  *                           the data requested.
  * @param dist_func          The distance function to use, as a map.
+ *
+ * @return __isl_give        The exact total jumps.
  */
-long analyze_jumps(
+__isl_give isl_val *analyze_jumps_val(
     __isl_take isl_map *src_occ, 
     __isl_take isl_map *dst_fill,
     __isl_take isl_map *dist_func
@@ -172,17 +273,28 @@ long analyze_jumps(
     // First sums cost per dst, then sums cost per dst to get total cost.
     isl_pw_qpolynomial *sum = isl_pw_qpolynomial_sum(isl_pw_qpolynomial_sum(min_dist));
     // Grabs the return value as an isl_val.
-    isl_val *sum_extract = isl_pw_qpolynomial_eval(sum, isl_point_zero(isl_pw_qpolynomial_get_domain_space(sum)));
-    // Converts isl_val to int.
-    long ret = isl_val_get_num_si(sum_extract);
+    return isl_pw_qpolynomial_eval(sum, isl_point_zero(isl_pw_qpolynomial_get_domain_space(sum)));
+}
 
-    // Frees val.
-    isl_val_free(sum_extract);
+/// @brief analyze_jumps_val as a long. @throw std::overflow_error if it does not fit.
+long analyze_jumps(
+    __isl_take isl_map *src_occ, 
+    __isl_take isl_map *dst_fill,
+    __isl_take isl_map *dist_func
+) {
+    return val_to_long(analyze_jumps_val(src_occ, dst_fill, dist_func));
+}
 
-    return ret;
+/// @brief analyze_jumps_val kept exact past the range of a long.
+exact analyze_jumps_exact(
+    __isl_take isl_map *src_occ, 
+    __isl_take isl_map *dst_fill,
+    __isl_take isl_map *dist_func
+) {
+    return val_to_exact(analyze_jumps_val(src_occ, dst_fill, dist_func));
 }
 
-long analyze_jumps(const std::string& src_occupancy, const std::string& dst_fill, const std::string& dist_func)
+exact analyze_jumps_exact(const std::string& src_occupancy, const std::string& dst_fill, const std::string& dist_func)
 {
     // Creates a new isl context.
     isl_ctx *p_ctx = isl_ctx_alloc();
@@ -202,7 +314,7 @@ long analyze_jumps(const std::string& src_occupancy, const std::string& dst_fill
     );
 
     // Calls the isl version of analyze_latency.
-    long ret = analyze_jumps(
+    exact ret = analyze_jumps_exact(
         p_src_occupancy,
         p_dst_fill,
         p_dist_func
@@ -214,6 +326,213 @@ long analyze_jumps(const std::string& src_occupancy, const std::string& dst_fill
     return ret;
 }
 
+long analyze_jumps(const std::string& src_occupancy, const std::string& dst_fill, const std::string& dist_func)
+{
+    // Checks the range only once the context is gone.
+    return exact_to_long(analyze_jumps_exact(src_occupancy, dst_fill, dist_func));
+}
+
+/**
+ * Analyzes the total jumps of several tensors at once. Every tensor is told
+ * apart by the tuple name of its data, e.g. { src[x, y] -> I[c, h]; src[x, y]
+ * -> W[k, r] }, and may have its own occupancy and fill. The requests of every
+ * tensor are joined with the srcs and the metric in one union, so the metric
+ * is built once and the spatial work is shared, then reduced per tensor.
+ *
+ * @param __isl_take src_occ    The data occupied per src, over all tensors.
+ * @param __isl_take dst_fill   The data requested per dst, over all tensors.
+ * @param __isl_take dist_func  The distance function shared by the tensors,
+ *                              { [dst -> src] -> [dist] }.
+ * @param bytes                 The bytes per element per tensor name; 1 for
+ *                              the tensors not listed.
+ *
+ * @throw std::invalid_argument if a size is not positive or names no tensor.
+ */
+joint_jumps analyze_joint_jumps(
+    __isl_take isl_union_map *src_occ, __isl_take isl_union_map *dst_fill, __isl_take isl_map *dist_func,
+    const std::map<std::string, long>& bytes
+) {
+    for (const auto& [tensor, n_bytes] : bytes)
+    {
+        if (n_bytes > 0)
+            continue;
+        isl_union_map_free(src_occ);
+        isl_union_map_free(dst_fill);
+        isl_map_free(dist_func);
+        throw std::invalid_argument("tensor " + tensor + " has " + std::to_string(n_bytes)
+                                    + " bytes per element");
+    }
+    isl_ctx *p_ctx = isl_union_map_get_ctx(src_occ);
+    // Makes { [dst -> data] -> [dst -> src] } over every tensor.
+    isl_union_map *p_request_pairs = request_pairs(src_occ, dst_fill);
+    // Gets the min distance per request of every tensor.
+    isl_union_map *p_min_dists = isl_union_map_lexmin(isl_union_map_apply_range(
+        p_request_pairs, isl_union_map_from_map(dist_func)
+    ));
+
+    // Sums the min distances of every tensor separately.
+    struct sum_info
+    {
+        std::vector<std::pair<std::string, isl_val*>> sums;
+    } info;
+    isl_union_map_foreach_map(p_min_dists, [](isl_map *p_dists, void *p_user) -> isl_stat {
+        sum_info *p_info = static_cast<sum_info*>(p_user);
+        isl_space *p_request = isl_space_unwrap(isl_space_domain(isl_map_get_space(p_dists)));
+        const char *s_tensor = isl_space_get_tuple_name(p_request, isl_dim_out);
+        std::string tensor = s_tensor ? s_tensor : "";
+        isl_space_free(p_request);
+
+        isl_pw_multi_aff *p_dist_pma = isl_pw_multi_aff_from_map(p_dists);
+        isl_pw_aff *p_dist = isl_pw_multi_aff_get_pw_aff(p_dist_pma, 0);
+        isl_pw_multi_aff_free(p_dist_pma);
+        isl_pw_qpolynomial *p_sum = isl_pw_qpolynomial_sum(isl_pw_qpolynomial_sum(
+            isl_pw_qpolynomial_from_pw_aff(p_dist)
+        ));
+        p_info->sums.emplace_back(tensor, isl_pw_qpolynomial_eval(
+            p_sum, isl_point_zero(isl_pw_qpolynomial_get_domain_space(p_sum))
+        ));
+        return isl_stat_ok;
+    }, &info);
+    isl_union_map_free(p_min_dists);
+    std::sort(info.sums.begin(), info.sums.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+
+    // Rejects a size for a tensor that is not there, e.g. a misspelt name.
+    for (const auto& [tensor, n_bytes] : bytes)
+    {
+        bool known = std::any_of(info.sums.begin(), info.sums.end(), [&](const auto& sum) {
+            return sum.first == tensor;
+        });
+        if (known)
+            continue;
+        for (auto& sum : info.sums)
+            isl_val_free(sum.second);
+        throw std::invalid_argument("bytes names tensor " + tensor + ", which is not requested");
+    }
+
+    // Weighs every tensor by its element size and adds them up.
+    std::vector<tensor_jumps_struct> tensors;
+    isl_val *p_total = isl_val_zero(p_ctx);
+    for (auto& [tensor, p_jumps] : info.sums)
+    {
+        auto found = bytes.find(tensor);
+        long n_bytes = found == bytes.end() ? 1 : found->second;
+        isl_val *p_byte_jumps = isl_val_mul(isl_val_copy(p_jumps), isl_val_int_from_si(p_ctx, n_bytes));
+        p_total = isl_val_add(p_total, isl_val_copy(p_byte_jumps));
+        tensors.push_back(tensor_jumps_struct{tensor, n_bytes, val_to_exact(p_jumps), val_to_exact(p_byte_jumps)});
+    }
+
+    return joint_jumps(new joint_jumps_struct{std::move(tensors), val_to_exact(p_total)});
+}
+
+joint_jumps analyze_joint_jumps(
+    const std::string& src_occupancy, const std::string& dst_fill, const std::string& dist_func,
+    const std::map<std::string, long>& bytes
+) {
+    // Creates a new isl context.
+    isl_ctx *p_ctx = isl_ctx_alloc();
+
+    // Reads every tensor in one union, and the shared metric once.
+    joint_jumps ret;
+    try
+    {
+        ret = analyze_joint_jumps(
+            isl_union_map_read_from_str(p_ctx, src_occupancy.c_str()),
+            isl_union_map_read_from_str(p_ctx, dst_fill.c_str()),
+            isl_map_read_from_str(p_ctx, dist_func.c_str()),
+            bytes
+        );
+    }
+    catch (const std::exception&)
+    {
+        // Frees the isl objects before passing the error on.
+        isl_ctx_free(p_ctx);
+        throw;
+    }
+
+    // Frees the isl objects.
+    isl_ctx_free(p_ctx);
+
+    return ret;
+}
+
+/**
+ * Analyzes several costs of the same transfers at once, e.g. hops, energy and
+ * the links used per hierarchy level. The nearest src of every (dst, datum)
+ * request is chosen once under the routing metric, ties going to the
+ * lexicographically smallest src, so the expensive lexmin is not repeated per
+ * cost; every cost is then summed over that one selection.
+ *
+ * @param __isl_take src_occ    A map relating source location and the data
+ *                              occupied.
+ * @param __isl_take dst_fill   A map relating destination location and the
+ *                              data requested.
+ * @param __isl_take route_func The metric the sources are chosen under,
+ *                              { [dst -> src] -> [dist] }.
+ * @param cost_funcs            The name and metric of every cost, in the same
+ *                              space as route_func; every map is taken.
+ */
+metric_table analyze_metric_table(
+    __isl_take isl_map *src_occ, __isl_take isl_map *dst_fill, __isl_take isl_map *route_func,
+    const std::vector<std::pair<std::string, isl_map*>>& cost_funcs
+) {
+    // Makes { [dst -> data] -> [dst -> src] } for every src holding the datum.
+    isl_map *p_request_pairs = request_pairs(src_occ, dst_fill);
+
+    // Keeps the src alongside its routing distance so the lexmin picks it too.
+    isl_map *p_routed = isl_map_range_product(
+        isl_map_apply_range(isl_map_copy(p_request_pairs), route_func), p_request_pairs
+    );
+    isl_map *p_selection = isl_map_range_factor_range(isl_map_lexmin(p_routed));
+    DUMP(p_selection);
+
+    // Sums every cost over the selected [dst -> src] pairs.
+    std::vector<metric_total_struct> metrics;
+    for (const auto& [metric, p_cost_func] : cost_funcs)
+    {
+        isl_pw_multi_aff *p_cost_pma = isl_pw_multi_aff_from_map(
+            isl_map_apply_range(isl_map_copy(p_selection), p_cost_func)
+        );
+        isl_pw_aff *p_cost = isl_pw_multi_aff_get_pw_aff(p_cost_pma, 0);
+        isl_pw_multi_aff_free(p_cost_pma);
+        // First sums cost per dst, then sums cost per dst to get total cost.
+        isl_pw_qpolynomial *p_sum = isl_pw_qpolynomial_sum(isl_pw_qpolynomial_sum(
+            isl_pw_qpolynomial_from_pw_aff(p_cost)
+        ));
+        metrics.push_back(metric_total_struct{metric, val_to_exact(isl_pw_qpolynomial_eval(
+            p_sum, isl_point_zero(isl_pw_qpolynomial_get_domain_space(p_sum))
+        ))});
+    }
+    isl_map_free(p_selection);
+
+    return metric_table(new metric_table_struct{std::move(metrics)});
+}
+
+metric_table analyze_metric_table(
+    const std::string& src_occupancy, const std::string& dst_fill, const std::string& route_func,
+    const std::vector<std::pair<std::string, std::string>>& cost_funcs
+) {
+    // Creates a new isl context.
+    isl_ctx *p_ctx = isl_ctx_alloc();
+
+    // Reads the string representations of the maps into isl objects.
+    std::vector<std::pair<std::string, isl_map*>> p_cost_funcs;
+    for (const auto& [metric, cost_func] : cost_funcs)
+        p_cost_funcs.emplace_back(metric, isl_map_read_from_str(p_ctx, cost_func.c_str()));
+    metric_table ret = analyze_metric_table(
+        isl_map_read_from_str(p_ctx, src_occupancy.c_str()),
+        isl_map_read_from_str(p_ctx, dst_fill.c_str()),
+        isl_map_read_from_str(p_ctx, route_func.c_str()),
+        p_cost_funcs
+    );
+
+    // Frees the isl objects.
+    isl_ctx_free(p_ctx);
+
+    return ret;
+}
+
 /**
  * Analyzes the latency of a memory access by finding the minimum path from
  * every source to every destination for a particular data, then taking the max
@@ -225,8 +544,10 @@ long analyze_jumps(const std::string& src_occupancy, const std::string& dst_fill
  * @param __isl_take p_dst_fill         A map relating destination location and
  *                                      the data requested.
  * @param __isl_take dist_func          The distance function to use, as a map.
+ *
+ * @return __isl_give                   The exact maximum latency.
  */
-long analyze_latency (
+__isl_give isl_val *analyze_latency_val(
     isl_map *src_occ, 
     isl_map *dst_fill, 
     isl_map *dist_func
@@ -234,17 +555,29 @@ long analyze_latency (
     // Fetches the minimum distance between every source and destination per data.
     isl_pw_qpolynomial *p_min_dist = minimize_jumps(src_occ, dst_fill, dist_func);
     // Computes the maximum of minimum distances for every data.
-    isl_val *p_max_min_dist = isl_pw_qpolynomial_max(p_min_dist);
-    int ret = isl_val_get_num_si(p_max_min_dist);
+    return isl_pw_qpolynomial_max(p_min_dist);
+}
 
-    // Frees the isl objects.
-    isl_val_free(p_max_min_dist);
+/// @brief analyze_latency_val as a long. @throw std::overflow_error if it does not fit.
+long analyze_latency (
+    isl_map *src_occ, 
+    isl_map *dst_fill, 
+    isl_map *dist_func
+) {
+    return val_to_long(analyze_latency_val(src_occ, dst_fill, dist_func));
+}
 
-    return ret;
+/// @brief analyze_latency_val kept exact past the range of a long.
+exact analyze_latency_exact(
+    isl_map *src_occ, 
+    isl_map *dst_fill, 
+    isl_map *dist_func
+) {
+    return val_to_exact(analyze_latency_val(src_occ, dst_fill, dist_func));
 }
 
 /**
- * A wrapper for analyze_latency that takes in strings instead of isl objects.
+ * A wrapper for analyze_latency_exact that takes in strings instead of isl objects.
  * 
  * @param src_occupancy     A string representation of a map relating source
  *                          location and the data occupied.
@@ -252,9 +585,9 @@ long analyze_latency (
  *                          location and the data requested.
  * @param dist_func         A string representation of a distance function to use.
  *
- * @return                  A string representation of the maximum latency.
+ * @return                  The exact maximum latency.
  */
-long analyze_latency (
+exact analyze_latency_exact(
     const std::string& src_occupancy, 
     const std::string& dst_fill, 
     const std::string& dist_func
@@ -267,7 +600,7 @@ long analyze_latency (
     isl_map *p_dst_fill = isl_map_read_from_str(ctx, dst_fill.c_str());
     isl_map *p_dist_aff = isl_map_read_from_str(ctx, dist_func.c_str());
     // Calls the isl version of analyze_latency.
-    long ret = analyze_latency(p_src_occ, p_dst_fill, p_dist_aff);
+    exact ret = analyze_latency_exact(p_src_occ, p_dst_fill, p_dist_aff);
 
     // Frees the isl objects.
     isl_ctx_free(ctx);
@@ -275,27 +608,531 @@ long analyze_latency (
     return ret;
 }
 
+/// @brief analyze_latency_exact as a long. @throw std::overflow_error if it does not fit.
+long analyze_latency (
+    const std::string& src_occupancy, 
+    const std::string& dst_fill, 
+    const std::string& dist_func
+) {
+    return exact_to_long(analyze_latency_exact(src_occupancy, dst_fill, dist_func));
+}
+
 /**
- * Defines the n-dimensional Manhattan distance function. This is done programatically
- * as ISL does not have an absolute value function.
+ * Analyzes the same max of min distances as analyze_latency without the
+ * parametric lexmin, by bisecting on a candidate latency L. Each step asks
+ * whether some (dst, datum) request has no src within L, a single emptiness
+ * test. Requests found within L are dropped once L is known to be too small,
+ * so the later steps only look at the few far requests that decide the max.
  * 
- * @pre             src_dims.size() == dst_dims.size()
+ * @param __isl_take p_src_occupancy    A map relating source location and the 
+ *                                      data occupied.
+ * @param __isl_take p_dst_fill         A map relating destination location and
+ *                                      the data requested.
+ * @param __isl_take dist_func          The distance function to use, as a map.
+ *
+ * @return The maximum latency, or 0 if no request can be served.
+ * @throw std::overflow_error if the distances do not fit in a long.
+ * @throw std::runtime_error if ISL fails on a step of the bisection.
+ */
+long analyze_latency_bisect(
+    isl_map *src_occ, 
+    isl_map *dst_fill, 
+    isl_map *dist_func
+) {
+    isl_map *p_distances = request_distances(src_occ, dst_fill, dist_func);
+    // Only requests with some src have a latency, as in analyze_latency.
+    isl_set *p_requests = isl_map_domain(isl_map_copy(p_distances));
+    isl_bool no_requests = isl_set_is_empty(p_requests);
+    if (no_requests != isl_bool_false)
+    {
+        isl_set_free(p_requests);
+        isl_map_free(p_distances);
+        if (no_requests == isl_bool_error)
+            throw std::runtime_error("latency bisection failed to find the requests");
+        return 0;
+    }
+
+    // Brackets the latency by the extreme distances of any pair.
+    isl_set *p_range = isl_map_range(isl_map_copy(p_distances));
+    exact lo_exact = val_to_exact(isl_set_dim_min_val(isl_set_copy(p_range), 0));
+    exact hi_exact = val_to_exact(isl_set_dim_max_val(p_range, 0));
+    if (!lo_exact->fits || !hi_exact->fits)
+    {
+        // Frees the isl objects before passing the overflow on.
+        isl_set_free(p_requests);
+        isl_map_free(p_distances);
+        throw std::overflow_error("distance " + (lo_exact->fits ? hi_exact : lo_exact)->repr
+            + " does not fit in a long");
+    }
+    long lo = lo_exact->value;
+    long hi = hi_exact->value;
+
+    // Keeps every request uncovered at lo - 1 and none uncovered at hi.
+    while (lo < hi)
+    {
+        long mid = lo + (hi - lo) / 2;
+        isl_map *p_within = isl_map_upper_bound_si(
+            isl_map_intersect_domain(isl_map_copy(p_distances), isl_set_copy(p_requests)),
+            isl_dim_out, 0, mid
+        );
+        isl_set *p_uncovered = isl_set_subtract(
+            isl_set_copy(p_requests), isl_map_domain(p_within)
+        );
+        isl_bool all_covered = isl_set_is_empty(p_uncovered);
+        if (all_covered == isl_bool_error)
+        {
+            // Frees the isl objects before reporting the failed step.
+            isl_set_free(p_uncovered);
+            isl_set_free(p_requests);
+            isl_map_free(p_distances);
+            throw std::runtime_error("latency bisection failed at " + std::to_string(mid));
+        }
+        if (all_covered)
+        {
+            hi = mid;
+            isl_set_free(p_uncovered);
+        }
+        else
+        {
+            // Only the uncovered requests can still decide the max.
+            lo = mid + 1;
+            isl_set_free(p_requests);
+            p_requests = isl_set_coalesce(p_uncovered);
+        }
+    }
+
+    isl_set_free(p_requests);
+    isl_map_free(p_distances);
+
+    return hi;
+}
+
+/// @brief A wrapper for analyze_latency_bisect that takes in strings instead of isl objects.
+long analyze_latency_bisect(
+    const std::string& src_occupancy, 
+    const std::string& dst_fill, 
+    const std::string& dist_func
+) {
+    // Creates a new isl context.
+    isl_ctx *ctx = isl_ctx_alloc();
+
+    // Reads the string representations of the maps into isl objects.
+    isl_map *p_src_occ = isl_map_read_from_str(ctx, src_occupancy.c_str());
+    isl_map *p_dst_fill = isl_map_read_from_str(ctx, dst_fill.c_str());
+    isl_map *p_dist_aff = isl_map_read_from_str(ctx, dist_func.c_str());
+    long ret;
+    try
+    {
+        ret = analyze_latency_bisect(p_src_occ, p_dst_fill, p_dist_aff);
+    }
+    catch (const std::exception&)
+    {
+        // Frees the isl objects before passing the error on.
+        isl_ctx_free(ctx);
+        throw;
+    }
+
+    // Frees the isl objects.
+    isl_ctx_free(ctx);
+
+    return ret;
+}
+
+/// @brief The prefix naming the stages of a dst slice, e.g. "[0, 7] ".
+std::string slice_label(const std::vector<long>& slice)
+{
+    return slice.empty() ? "" : "[" + std::to_string(slice[0]) + ", " + std::to_string(slice[1]) + "] ";
+}
+
+/**
+ * Runs a budgeted analysis on the dsts in [lo, hi] along the first dst dim, in
+ * a context of its own so that everything it allocated goes when it ends.
+ *
+ * @param analysis      The analysis to run.
+ * @param src_occupancy The src occupancy as an ISL string.
+ * @param dst_fill      The dst fill as an ISL string.
+ * @param dist_func     The distance function as an ISL string.
+ * @param slice         The [lo, hi] dst range, or {} for every dst.
+ * @param budget_bytes  The memory ceiling.
+ * @param tracker       Records the stages.
+ * @param result        Set to the result of the slice, if any request.
+ *
+ * @return ok, budget_exceeded if an allocation failed or the heap outgrew the
+ *         budget, or error.
+ * @throw std::bad_alloc if an allocation outside ISL fails, leaving the
+ *        isl_ctx behind; see run_budgeted_slice_forked.
+ */
+budget_status run_budgeted_slice(
+    budgeted_analysis analysis, const std::string& src_occupancy, const std::string& dst_fill,
+    const std::string& dist_func, const std::vector<long>& slice, long budget_bytes,
+    MemoryTracker& tracker, exact& result
+) {
+    const std::string label = slice_label(slice);
+    const long heap_start = heap_bytes();
+    // Checks the heap between stages as allocations made outside ISL, e.g. by
+    // GMP, abort instead of failing.
+    auto over_budget = [&]() { return budget_bytes > 0 && heap_bytes() - heap_start > budget_bytes; };
+
+    isl_ctx *p_ctx = isl_ctx_alloc();
+    isl_options_set_on_error(p_ctx, ISL_ON_ERROR_CONTINUE);
+    bool exceeded = false;
+    bool failed = false;
+    {
+        MemoryCeiling ceiling(budget_bytes);
+
+        tracker.begin(label + "read");
+        isl_map *p_src_occ = isl_map_read_from_str(p_ctx, src_occupancy.c_str());
+        isl_map *p_dst_fill = isl_map_read_from_str(p_ctx, dst_fill.c_str());
+        isl_map *p_dist_func = isl_map_read_from_str(p_ctx, dist_func.c_str());
+        if (!slice.empty())
+        {
+            p_dst_fill = isl_map_lower_bound_si(p_dst_fill, isl_dim_in, 0, slice[0]);
+            p_dst_fill = isl_map_upper_bound_si(p_dst_fill, isl_dim_in, 0, slice[1]);
+        }
+
+        tracker.begin(label + "minimize");
+        isl_pw_qpolynomial *p_min_dist = minimize_jumps(p_src_occ, p_dst_fill, p_dist_func);
+        exceeded = over_budget();
+        // Fails even without an error on the isl_ctx, e.g. for a bad metric.
+        failed = !p_min_dist;
+
+        tracker.begin(label + "reduce");
+        isl_val *p_result = nullptr;
+        if (exceeded || failed)
+        {
+            isl_pw_qpolynomial_free(p_min_dist);
+        }
+        else if (analysis == budgeted_analysis::jumps)
+        {
+            isl_pw_qpolynomial *p_sum = isl_pw_qpolynomial_sum(isl_pw_qpolynomial_sum(p_min_dist));
+            p_result = isl_pw_qpolynomial_eval(p_sum, isl_point_zero(isl_pw_qpolynomial_get_domain_space(p_sum)));
+        }
+        else
+        {
+            p_result = isl_pw_qpolynomial_max(p_min_dist);
+        }
+        tracker.end();
+        exceeded = exceeded || over_budget();
+
+        // A slice without requests has a max of -infty and adds nothing.
+        if (p_result && isl_val_is_neginfty(p_result) != isl_bool_true)
+            result = val_to_exact(p_result);
+        else
+            isl_val_free(p_result);
+    }
+
+    budget_status status = budget_status::ok;
+    if (exceeded || isl_ctx_last_error(p_ctx) == isl_error_alloc)
+        status = budget_status::budget_exceeded;
+    else if (failed || isl_ctx_last_error(p_ctx) != isl_error_none)
+        status = budget_status::error;
+    isl_ctx_free(p_ctx);
+
+    return status;
+}
+
+/// @brief Writes all of data to fd, retrying short writes.
+bool write_all(int fd, const std::string& data)
+{
+    std::size_t written = 0;
+    while (written < data.size())
+    {
+        ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        written += n;
+    }
+    return true;
+}
+
+/**
+ * Runs run_budgeted_slice in a forked child, such that an allocation failing
+ * where it cannot fail softly, i.e. in GMP, in NTL or in the C++ code around
+ * ISL, ends the child instead of the caller, and whatever it leaves allocated
+ * goes with it. The result and the stages come back through a pipe. As with
+ * any fork, the caller should not hold locks other threads may need.
+ *
+ * @param analysis      The analysis to run.
+ * @param src_occupancy The src occupancy as an ISL string.
+ * @param dst_fill      The dst fill as an ISL string.
+ * @param dist_func     The distance function as an ISL string.
+ * @param slice         The [lo, hi] dst range, or {} for every dst.
+ * @param budget_bytes  The memory ceiling.
+ * @param tracker       Records the stages.
+ * @param result        Set to the result of the slice, if any request.
+ *
+ * @return As run_budgeted_slice. A child that aborted, as GMP does and as an
+ *         exception escaping NTL does, is budget_exceeded; one that died
+ *         otherwise is an error. Either way its stages are recorded as one.
+ * @throw std::runtime_error if the child cannot be started.
+ */
+budget_status run_budgeted_slice_forked(
+    budgeted_analysis analysis, const std::string& src_occupancy, const std::string& dst_fill,
+    const std::string& dist_func, const std::vector<long>& slice, long budget_bytes,
+    MemoryTracker& tracker, exact& result
+) {
+    int fds[2];
+    if (pipe(fds) != 0)
+        throw std::runtime_error("cannot open a pipe to a budgeted slice");
+    const auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        throw std::runtime_error("cannot fork a budgeted slice");
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        MemoryTracker child_tracker;
+        exact child_result;
+        budget_status status;
+        try
+        {
+            status = run_budgeted_slice(
+                analysis, src_occupancy, dst_fill, dist_func, slice, budget_bytes, child_tracker, child_result
+            );
+        }
+        catch (const std::bad_alloc&)
+        {
+            status = budget_status::budget_exceeded;
+        }
+        catch (const std::exception&)
+        {
+            status = budget_status::error;
+        }
+
+        // Reports once the ceiling is lifted, as "status has_result [fits value
+        // repr]" then "seconds peak heap stage" per stage.
+        std::ostringstream report;
+        report << static_cast<int>(status) << ' ' << (child_result ? 1 : 0);
+        if (child_result)
+            report << ' ' << child_result->fits << ' ' << child_result->value << ' ' << child_result->repr;
+        report << '\n';
+        for (const stage_usage_struct& stage : child_tracker.stages())
+            report << stage.seconds << ' ' << stage.peak_rss << ' ' << stage.heap << ' ' << stage.stage << '\n';
+        bool sent = write_all(fds[1], report.str());
+        // Skips the exit handlers and stdio buffers inherited from the parent.
+        _exit(sent ? 0 : 1);
+    }
+
+    close(fds[1]);
+    std::string report;
+    char buffer[4096];
+    for (;;)
+    {
+        ssize_t n = read(fds[0], buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        report.append(buffer, n);
+    }
+    close(fds[0]);
+    int child_status = 0;
+    while (waitpid(pid, &child_status, 0) < 0 && errno == EINTR)
+        ;
+
+    std::istringstream in(report);
+    int status = 0, has_result = 0;
+    if (!WIFEXITED(child_status) || WEXITSTATUS(child_status) != 0 || !(in >> status >> has_result))
+    {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        tracker.record(stage_usage_struct{slice_label(slice) + "died", elapsed.count(), -1, -1});
+        bool aborted = WIFSIGNALED(child_status) && WTERMSIG(child_status) == SIGABRT;
+        return aborted ? budget_status::budget_exceeded : budget_status::error;
+    }
+    if (has_result)
+    {
+        bool fits = false;
+        long value = 0;
+        std::string repr;
+        in >> fits >> value >> repr;
+        result = exact(new exact_struct{value, fits, repr});
+    }
+    std::string line;
+    std::getline(in, line);
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        double seconds = 0;
+        long peak = -1, heap = -1;
+        std::string stage;
+        fields >> seconds >> peak >> heap >> std::ws;
+        std::getline(fields, stage);
+        tracker.record(stage_usage_struct{stage, seconds, peak, heap});
+    }
+
+    return static_cast<budget_status>(status);
+}
+
+/**
+ * Runs a budgeted analysis on the dsts in [lo, hi] along the first dst dim.
+ * Under a budget it runs in a forked child, see run_budgeted_slice_forked.
+ *
+ * @param analysis      The analysis to run.
+ * @param src_occupancy The src occupancy as an ISL string.
+ * @param dst_fill      The dst fill as an ISL string.
+ * @param dist_func     The distance function as an ISL string.
+ * @param slice         The [lo, hi] dst range, or {} for every dst.
+ * @param budget_bytes  The memory ceiling, or 0 for none.
+ * @param tracker       Records the stages.
+ * @param value         Set to the result of the slice, if any request.
+ *
+ * @return ok, budget_exceeded if an allocation failed or the heap outgrew the
+ *         budget, or error.
+ * @throw std::overflow_error if the result does not fit in a long.
+ */
+budget_status analyze_budgeted_slice(
+    budgeted_analysis analysis, const std::string& src_occupancy, const std::string& dst_fill,
+    const std::string& dist_func, const std::vector<long>& slice, long budget_bytes,
+    MemoryTracker& tracker, std::optional<long>& value
+) {
+    exact result;
+    budget_status status = budget_bytes > 0
+        ? run_budgeted_slice_forked(
+              analysis, src_occupancy, dst_fill, dist_func, slice, budget_bytes, tracker, result
+          )
+        : run_budgeted_slice(
+              analysis, src_occupancy, dst_fill, dist_func, slice, budget_bytes, tracker, result
+          );
+    if (status == budget_status::ok && result)
+        value = exact_to_long(result);
+
+    return status;
+}
+
+/**
+ * Runs an analysis under a memory budget. If the whole problem does not fit,
+ * the dsts are split into 2, 4, ... up to max_slices ranges along their first
+ * dim, solved one at a time and combined, since both the total jumps and the
+ * max latency decompose over the requests.
+ *
+ * @param analysis      The analysis to run.
+ * @param src_occupancy The src occupancy as an ISL string.
+ * @param dst_fill      The dst fill as an ISL string.
+ * @param dist_func     The distance function as an ISL string.
+ * @param budget_bytes  The memory ceiling per attempt, or 0 for none.
+ * @param max_slices    The most dst slices to try before giving up.
+ *
+ * @return The result with its status and the usage of every stage.
+ */
+budgeted analyze_budgeted(
+    budgeted_analysis analysis, const std::string& src_occupancy, const std::string& dst_fill,
+    const std::string& dist_func, long budget_bytes, int max_slices
+) {
+    MemoryTracker tracker;
+    auto result = [&](budget_status status, long value, int slices) {
+        return budgeted(new budgeted_struct{status, value, slices, tracker.stages()});
+    };
+
+    // Finds the range of dsts to slice.
+    long first = 0, last = 0;
+    {
+        isl_ctx *p_ctx = isl_ctx_alloc();
+        isl_options_set_on_error(p_ctx, ISL_ON_ERROR_CONTINUE);
+        isl_set *p_dsts = isl_map_domain(isl_map_read_from_str(p_ctx, dst_fill.c_str()));
+        isl_val *p_first = isl_set_dim_min_val(isl_set_copy(p_dsts), 0);
+        isl_val *p_last = isl_set_dim_max_val(p_dsts, 0);
+        bool bounded = isl_val_is_int(p_first) == isl_bool_true && isl_val_is_int(p_last) == isl_bool_true;
+        exact first_exact = val_to_exact(p_first);
+        exact last_exact = val_to_exact(p_last);
+        isl_ctx_free(p_ctx);
+        // Leaves an unbounded dst dim unsliced.
+        if (bounded)
+        {
+            first = exact_to_long(first_exact);
+            last = exact_to_long(last_exact);
+        }
+        else
+            max_slices = 1;
+    }
+
+    int slices = 1;
+    for (; slices <= max_slices; slices *= 2)
+    {
+        const long width = (last - first + slices) / slices;
+        std::optional<long> total;
+        budget_status status = budget_status::ok;
+        for (long lo = first; lo <= last && status == budget_status::ok; lo += width)
+        {
+            std::optional<long> value;
+            std::vector<long> slice;
+            if (slices > 1)
+                slice = {lo, std::min(lo + width - 1, last)};
+            status = analyze_budgeted_slice(
+                analysis, src_occupancy, dst_fill, dist_func, slice, budget_bytes, tracker, value
+            );
+            if (status != budget_status::ok || !value)
+                continue;
+
+            // Combines the slices, checking the sum as val_to_long does.
+            if (!total)
+                total = value;
+            else if (analysis == budgeted_analysis::latency)
+                total = std::max(*total, *value);
+            else if (__builtin_add_overflow(*total, *value, &*total))
+                throw std::overflow_error("total jumps do not fit in a long");
+        }
+
+        if (status == budget_status::error)
+            return result(status, 0, slices);
+        if (status == budget_status::ok)
+            return result(status, total.value_or(0), slices);
+        // Stops once every slice is a single dst row.
+        if (width == 1)
+            break;
+    }
+
+    return result(budget_status::budget_exceeded, 0, std::min(slices, max_slices));
+}
+
+/**
+ * Defines an n-dimensional distance function over links with a per-hop cost
+ * and an optional wraparound per dimension, i.e. weighted meshes and tori.
+ * Every dimension adds a single div-free term (2 pieces for a mesh dimension,
+ * at most 4 for a ring), so the result stays cheap for lexmin. The ring terms
+ * only hold on [0, circumference), so the distance is only defined there;
+ * pairs with a ring coordinate outside get no distance rather than a wrong one.
  * 
- * @param src_dims  A vector of strings representing the source dimensions.
- * @param dst_dims  A vector of strings representing the destination dimensions.
+ * @param src_dims          A vector of strings representing the source dimensions.
+ * @param dst_dims          A vector of strings representing the destination dimensions.
+ * @param weights           The cost of one hop along every dimension, positive
+ *                          so that distinct nodes stay apart.
+ * @param circumferences    The ring size of every dimension, or 0 for no wraparound.
  * 
- * @return          A piecewise affine function string representing the Manhattan distance.
+ * @return          A piecewise affine function string representing the distance.
+ * @throw std::invalid_argument if the four vectors differ in length, a weight
+ *        is not positive or a circumference is negative.
  */
-std::string nd_manhattan_metric(std::vector<std::string> src_dims, std::vector<std::string> dst_dims)
-{
+std::string nd_link_metric(
+    const std::vector<std::string>& src_dims, const std::vector<std::string>& dst_dims,
+    const std::vector<long>& weights, const std::vector<long>& circumferences
+) {
+    const std::size_t n_dims = dst_dims.size();
+    if (src_dims.size() != n_dims || weights.size() != n_dims || circumferences.size() != n_dims)
+        throw std::invalid_argument("metric needs as many src dims, weights and circumferences as dst dims");
+    for (std::size_t i = 0; i < n_dims; i++)
+    {
+        if (weights[i] <= 0)
+            throw std::invalid_argument("hop weight along " + dst_dims[i] + " must be positive, got "
+                                        + std::to_string(weights[i]));
+        if (circumferences[i] < 0)
+            throw std::invalid_argument("circumference along " + dst_dims[i] + " must not be negative, got "
+                                        + std::to_string(circumferences[i]));
+    }
+
     // Creates a new isl context.
     isl_ctx *p_ctx = isl_ctx_alloc();
 
     // Allocates computer memory for the isl space where dist calculations are done.
-    isl_space *p_dist_space = isl_space_alloc(p_ctx, 0, dst_dims.size(), src_dims.size());
+    isl_space *p_dist_space = isl_space_alloc(p_ctx, 0, n_dims, n_dims);
 
     // Programmatically creates and binds the dst and src dimensions to the dist space.
-    for (int i = 0; i < src_dims.size(); i++)
+    for (std::size_t i = 0; i < n_dims; i++)
     {
         p_dist_space = isl_space_set_dim_id(
             p_dist_space, isl_dim_in, i, isl_id_alloc(p_ctx, dst_dims[i].c_str(), NULL)
@@ -310,96 +1147,111 @@ std::string nd_manhattan_metric(std::vector<std::string> src_dims, std::vector<s
     // Converts it into a local space.
     isl_local_space *p_dist_local = isl_local_space_from_space(p_dist_space);
 
-    // Total Manhattan distance affine function.
-    isl_pw_aff *nd_manhattan_metric = isl_pw_aff_zero_on_domain(
+    // Total distance affine function.
+    isl_pw_aff *p_metric = isl_pw_aff_zero_on_domain(
         isl_local_space_copy(p_dist_local)
     );
-    // Constructs all the absolute value affines per dimension and adds to metric.
-    for (int i = 0; i < dst_dims.size(); i++)
+    // Keeps the ring coordinates of dst and src within their ring.
+    isl_set *p_valid = isl_set_universe(isl_local_space_get_space(p_dist_local));
+    // Constructs the per dimension hop counts and adds their costs to metric.
+    for (std::size_t i = 0; i < n_dims; i++)
     {
-        // Constructs the affine for the src.
-        isl_pw_aff *src_aff = isl_pw_aff_var_on_domain(
-            isl_local_space_copy(p_dist_local), isl_dim_set, dst_dims.size() + i
-        );
-        // Constructs the affine for the dst.
-        isl_pw_aff *dst_aff = isl_pw_aff_var_on_domain(
-            isl_local_space_copy(p_dist_local), isl_dim_set, i
-        );
-
-        // Subtracts the dst. 
-        isl_pw_aff *p_aff = isl_pw_aff_sub(src_aff, dst_aff);
-        // Grabs the negation.
-        isl_pw_aff *p_neg_aff = isl_pw_aff_neg(isl_pw_aff_copy(p_aff));
-        // Constructs the affine for the absolute value.
-        isl_pw_aff *p_abs_aff = isl_pw_aff_max(p_aff, p_neg_aff);
+        if (circumferences[i] > 0)
+        {
+            for (std::size_t dim : {i, n_dims + i})
+            {
+                p_valid = isl_set_lower_bound_si(p_valid, isl_dim_set, dim, 0);
+                p_valid = isl_set_upper_bound_val(
+                    p_valid, isl_dim_set, dim, isl_val_int_from_si(p_ctx, circumferences[i] - 1)
+                );
+            }
+        }
+        // Shares the per dim terms with the metric templates.
+        isl_pw_aff *p_hops = circumferences[i] > 0
+            ? ring_diff_on_domain(p_dist_local, i, n_dims + i, circumferences[i])
+            : abs_diff_on_domain(p_dist_local, i, n_dims + i);
+        if (weights[i] != 1)
+        {
+            p_hops = isl_pw_aff_scale_val(p_hops, isl_val_int_from_si(p_ctx, weights[i]));
+        }
 
-        // Adds the absolute value affine to the vector.
-        nd_manhattan_metric = isl_pw_aff_add(nd_manhattan_metric, p_abs_aff);
+        // Adds the cost of the dimension to the metric.
+        p_metric = isl_pw_aff_add(p_metric, p_hops);
     }
+    // Merges the pieces that share an affine form.
+    p_metric = isl_pw_aff_coalesce(isl_pw_aff_intersect_domain(p_metric, p_valid));
 
     // Grabs the return value as a string.
-    std::string ret = isl_pw_aff_to_str(nd_manhattan_metric);
+    char *s_metric = isl_pw_aff_to_str(p_metric);
+    std::string ret(s_metric);
 
     // Frees the isl objects.
+    free(s_metric);
     isl_local_space_free(p_dist_local);
-    isl_pw_aff_free(nd_manhattan_metric);
+    isl_pw_aff_free(p_metric);
     isl_ctx_free(p_ctx);
 
     return ret;
 }
 
 /**
- * Calculates the latency of a memory access on a ring.
+ * Defines the n-dimensional Manhattan distance function. This is done programatically
+ * as ISL does not have an absolute value function.
+ * 
+ * @pre             src_dims.size() == dst_dims.size()
+ * 
+ * @param src_dims  A vector of strings representing the source dimensions.
+ * @param dst_dims  A vector of strings representing the destination dimensions.
  * 
- * @param n     The circumference of the torus. 
+ * @return          A piecewise affine function string representing the Manhattan distance.
  */
-std::string n_long_ring_metric(long n)
+std::string nd_manhattan_metric(std::vector<std::string> src_dims, std::vector<std::string> dst_dims)
 {
-    // Creates a new isl context.
-    isl_ctx *p_ctx = isl_ctx_alloc();
-
-    /* Creates isl_ids for the src and dst dimensions. This is to be used for
-     * the map as unique identifiers. */
-    isl_id *src_id = isl_id_alloc(p_ctx, "src", NULL);
-    isl_id *dst_id = isl_id_alloc(p_ctx, "dst", NULL);
-
-    // Creates the space in which distance calculations are done.
-    isl_space *p_dist_space = isl_space_alloc(p_ctx, 0, 1, 1);
-    
-    // Sets the dst and src as members of the space.
-    p_dist_space = isl_space_set_dim_id(p_dist_space, isl_dim_in, 0, dst_id);
-    p_dist_space = isl_space_set_dim_id(p_dist_space, isl_dim_out, 0, src_id);
-
-    // Wraps the space into a set space.
-    p_dist_space = isl_space_wrap(p_dist_space);
-
-    // Creates p_dist as a local space.
-    isl_local_space *p_dist_local = isl_local_space_from_space(p_dist_space);
-
-    // Creates the src and dst affines.
-    isl_pw_aff *src_aff = isl_pw_aff_var_on_domain(isl_local_space_copy(p_dist_local), isl_dim_set, 0);
-    isl_pw_aff *dst_aff = isl_pw_aff_var_on_domain(p_dist_local, isl_dim_set, 1);
-
-    // Subtracts the dst from the src.
-    isl_pw_aff *src_sub_dst_aff = isl_pw_aff_sub(src_aff, dst_aff);
-    // Subtracts the src from the dst.
-    isl_pw_aff *dst_sub_src_aff = isl_pw_aff_neg(isl_pw_aff_copy(src_sub_dst_aff));
-
-    // Creates an isl_val for the torus circumference.
-    isl_val *p_circumference = isl_val_int_from_si(p_ctx, n);
-
-    // Creates the moduli for both differences.
-    isl_pw_aff *src_sub_dst_mod_n_aff = isl_pw_aff_mod_val(src_sub_dst_aff, isl_val_copy(p_circumference));
-    isl_pw_aff *dst_sub_src_mod_n_aff = isl_pw_aff_mod_val(dst_sub_src_aff, p_circumference);
+    return nd_link_metric(
+        src_dims, dst_dims,
+        std::vector<long>(dst_dims.size(), 1), std::vector<long>(dst_dims.size(), 0)
+    );
+}
 
-    // Combines the moduli into a single piecewise affine.
-    isl_pw_aff *p_dist = isl_pw_aff_min(src_sub_dst_mod_n_aff, dst_sub_src_mod_n_aff);
-    // Grabs the return value as a string.
-    std::string ret = isl_pw_aff_to_str(p_dist);
+/**
+ * Defines the n-dimensional Manhattan distance function with a different cost
+ * per hop along every dimension, e.g. cheap on-die and expensive die-to-die
+ * links.
+ * 
+ * @param src_dims  A vector of strings representing the source dimensions.
+ * @param dst_dims  A vector of strings representing the destination dimensions.
+ * @param weights   The cost of one hop along every dimension.
+ */
+std::string nd_weighted_manhattan_metric(
+    const std::vector<std::string>& src_dims, const std::vector<std::string>& dst_dims,
+    const std::vector<long>& weights
+) {
+    return nd_link_metric(src_dims, dst_dims, weights, std::vector<long>(dst_dims.size(), 0));
+}
 
-    // Frees the isl objects.
-    isl_pw_aff_free(p_dist);
-    isl_ctx_free(p_ctx);
+/**
+ * Defines the n-dimensional torus distance function.
+ * 
+ * @param src_dims          A vector of strings representing the source dimensions.
+ * @param dst_dims          A vector of strings representing the destination dimensions.
+ * @param circumferences    The ring size of every dimension.
+ */
+std::string nd_torus_metric(
+    const std::vector<std::string>& src_dims, const std::vector<std::string>& dst_dims,
+    const std::vector<long>& circumferences
+) {
+    return nd_link_metric(src_dims, dst_dims, std::vector<long>(dst_dims.size(), 1), circumferences);
+}
 
-    return ret;
-}
\ No newline at end of file
+/**
+ * Calculates the latency of a memory access on a ring. Coordinates outside
+ * [0, n) get no distance, see nd_link_metric.
+ * 
+ * @param n         The circumference of the torus. 
+ * @param src_dim   The name of the source dimension.
+ * @param dst_dim   The name of the destination dimension.
+ */
+std::string n_long_ring_metric(long n, const std::string& src_dim, const std::string& dst_dim)
+{
+    return nd_torus_metric({src_dim}, {dst_dim}, {n});
+}
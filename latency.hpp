@@ -1,17 +1,27 @@
 #pragma once
 
+#include <climits>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <tuple>
 #include <vector>
 
+#include "budget.hpp"
+
 // Includes ISL affine list/piecewise functions.
 #include <isl/aff.h>
 #include <isl/ilp.h>
+// Includes ISL constraints.
+#include <isl/constraint.h>
+#include <isl/local_space.h>
 // Includes isl qpolynomials.
 #include <isl/polynomial.h>
 // Includes ISL maps/binary relations.
 #include <isl/map.h>
+#include <isl/union_map.h>
 // Includes ISL ids and dspaces.
 #include <isl/id.h>
 #include <isl/space.h>
@@ -28,8 +38,12 @@ long analyze_jumps(isl_map *p_src_occupancy, isl_map *p_dst_fill, isl_pw_aff *di
 long analyze_jumps(const std::string& src_occupancy, const std::string& dst_fill, const std::string& dist_func);
 long analyze_latency(isl_map *p_src_occupancy, isl_map *p_dst_fill, isl_pw_aff *dist_func);
 long analyze_latency(const std::string& src_occupancy, const std::string& dst_fill, const std::string& dist_func);
+__isl_give isl_val *analyze_jumps_val(__isl_take isl_map *src_occ, __isl_take isl_map *dst_fill, __isl_take isl_map *dist_func);
+__isl_give isl_val *analyze_latency_val(__isl_take isl_map *src_occ, __isl_take isl_map *dst_fill, __isl_take isl_map *dist_func);
+long analyze_latency_bisect(__isl_take isl_map *src_occ, __isl_take isl_map *dst_fill, __isl_take isl_map *dist_func);
+long analyze_latency_bisect(const std::string& src_occupancy, const std::string& dst_fill, const std::string& dist_func);
 std::string nd_manhattan_metric(std::vector<std::string> src_dims, std::vector<std::string> dst_dims);
-std::string n_long_ring_metric(long n);
+std::string n_long_ring_metric(long n, const std::string& src_dim, const std::string& dst_dim);
 
 // Defines debug variables from environment variables.
 #include <string.h>
@@ -39,7 +53,22 @@ bool islIntermediates = (getenv("ISL_INTERMEDIATES") != NULL) &&
 // Defines a function to programatically generate an n-dimensional Manhattan distance function.
 std::string nd_manhattan_metric(std::vector<std::string> src_dims, std::vector<std::string> dst_dims);
 // Defines a function to programatically generate an n-circumference ring distance function.
-std::string n_long_ring_metric(long ring_circumference);
+std::string n_long_ring_metric(long ring_circumference, const std::string& src_dim = "src", const std::string& dst_dim = "dst");
+// Defines a function to programatically generate weighted mesh and torus distance functions.
+std::string nd_link_metric(
+    const std::vector<std::string>& src_dims, const std::vector<std::string>& dst_dims,
+    const std::vector<long>& weights, const std::vector<long>& circumferences
+);
+// Defines a function to programatically generate a per-dimension weighted Manhattan distance function.
+std::string nd_weighted_manhattan_metric(
+    const std::vector<std::string>& src_dims, const std::vector<std::string>& dst_dims,
+    const std::vector<long>& weights
+);
+// Defines a function to programatically generate an n-dimensional torus distance function.
+std::string nd_torus_metric(
+    const std::vector<std::string>& src_dims, const std::vector<std::string>& dst_dims,
+    const std::vector<long>& circumferences
+);
 
 // Defines debug dump function.
 void dump(const std::string& str, isl_map *map)
@@ -94,8 +123,266 @@ void dump(const std::string& str, isl_pw_qpolynomial* pwqp) {
     }
 }
 
+void dump(const std::string& str, isl_pw_qpolynomial_fold* pwf) {
+    if (islIntermediates) {
+        std::cout << str << std::endl;
+        isl_pw_qpolynomial_fold_dump(pwf);
+    }
+}
+
 #define DUMP(varname) dump(#varname, varname)
 
+/// @brief An analysis result kept exact however large it grows.
+struct exact_struct
+{
+    /// @brief The result if it fits in a long, else 0.
+    const long value;
+    /// @brief Whether the result is an integer that fits in a long.
+    const bool fits;
+    /// @brief The exact result as an integer, a rational p/q, infty or NaN.
+    const std::string repr;
+};
+typedef std::unique_ptr<exact_struct> exact;
+
+/**
+ * Checks whether a value is an integer within the range of a long.
+ *
+ * @param __isl_keep v  The value to check.
+ */
+bool val_fits_long(__isl_keep isl_val *v)
+{
+    if (isl_val_is_int(v) != isl_bool_true)
+        return false;
+    isl_ctx *p_ctx = isl_val_get_ctx(v);
+    isl_val *p_max = isl_val_int_from_si(p_ctx, LONG_MAX);
+    isl_val *p_min = isl_val_int_from_si(p_ctx, LONG_MIN);
+    bool fits = isl_val_le(v, p_max) == isl_bool_true &&
+                isl_val_ge(v, p_min) == isl_bool_true;
+    isl_val_free(p_max);
+    isl_val_free(p_min);
+
+    return fits;
+}
+
+/**
+ * Extracts a result exactly, with the long form alongside when it fits.
+ *
+ * @param __isl_take v  The value to extract.
+ */
+exact val_to_exact(__isl_take isl_val *v)
+{
+    bool fits = val_fits_long(v);
+    long value = fits ? isl_val_get_num_si(v) : 0;
+    char *s_repr = isl_val_to_str(v);
+    std::string repr(s_repr ? s_repr : "NaN");
+    free(s_repr);
+    isl_val_free(v);
+
+    return exact(new exact_struct{value, fits, repr});
+}
+
+/**
+ * Checks that an exact result fits in a long.
+ *
+ * @param result    The exact result.
+ * @throw std::overflow_error if the result is not an integer in range.
+ */
+long exact_to_long(const exact& result)
+{
+    if (!result->fits)
+        throw std::overflow_error("result " + result->repr + " does not fit in a long");
+    return result->value;
+}
+
+/**
+ * Extracts a result as a long, checking that nothing is lost on the way.
+ *
+ * @param __isl_take v  The value to extract.
+ * @throw std::runtime_error if the value is null, i.e. the computation failed.
+ * @throw std::overflow_error if the result is not an integer in range.
+ */
+long val_to_long(__isl_take isl_val *v)
+{
+    if (!v)
+        throw std::runtime_error("the result could not be computed");
+    // Takes the fast path whenever the value fits.
+    if (val_fits_long(v))
+    {
+        long value = isl_val_get_num_si(v);
+        isl_val_free(v);
+        return value;
+    }
+    return exact_to_long(val_to_exact(v));
+}
+
+exact analyze_jumps_exact(__isl_take isl_map *src_occ, __isl_take isl_map *dst_fill, __isl_take isl_map *dist_func);
+exact analyze_jumps_exact(const std::string& src_occupancy, const std::string& dst_fill, const std::string& dist_func);
+exact analyze_latency_exact(__isl_take isl_map *src_occ, __isl_take isl_map *dst_fill, __isl_take isl_map *dist_func);
+exact analyze_latency_exact(const std::string& src_occupancy, const std::string& dst_fill, const std::string& dist_func);
+
+/// @brief The traffic of one tensor of a joint analysis.
+struct tensor_jumps_struct
+{
+    /// @brief The tuple name of the tensor's data, e.g. "W".
+    std::string tensor;
+    /// @brief The bytes per element.
+    long bytes;
+    /// @brief The total jumps of its elements, as analyze_jumps.
+    exact jumps;
+    /// @brief jumps weighted by bytes.
+    exact byte_jumps;
+};
+
+/// @brief The traffic of all the tensors of a layer moving together.
+struct joint_jumps_struct
+{
+    /// @brief Per tensor, in tuple name order.
+    const std::vector<tensor_jumps_struct> tensors;
+    /// @brief The byte jumps summed over the tensors.
+    const exact byte_jumps;
+};
+typedef std::unique_ptr<joint_jumps_struct> joint_jumps;
+
+joint_jumps analyze_joint_jumps(
+    __isl_take isl_union_map *src_occ, __isl_take isl_union_map *dst_fill, __isl_take isl_map *dist_func,
+    const std::map<std::string, long>& bytes
+);
+joint_jumps analyze_joint_jumps(
+    const std::string& src_occupancy, const std::string& dst_fill, const std::string& dist_func,
+    const std::map<std::string, long>& bytes
+);
+
+/// @brief The total of one cost over the selected sources.
+struct metric_total_struct
+{
+    /// @brief The name of the cost, e.g. "energy".
+    std::string metric;
+    /// @brief The cost summed over every (dst, datum) request.
+    exact total;
+};
+
+/// @brief Several costs of one nearest-source selection.
+struct metric_table_struct
+{
+    /// @brief Per cost, in the order given.
+    const std::vector<metric_total_struct> metrics;
+};
+typedef std::unique_ptr<metric_table_struct> metric_table;
+
+metric_table analyze_metric_table(
+    __isl_take isl_map *src_occ, __isl_take isl_map *dst_fill, __isl_take isl_map *route_func,
+    const std::vector<std::pair<std::string, isl_map*>>& cost_funcs
+);
+metric_table analyze_metric_table(
+    const std::string& src_occupancy, const std::string& dst_fill, const std::string& route_func,
+    const std::vector<std::pair<std::string, std::string>>& cost_funcs
+);
+
+/// @brief The analyses that can run under a memory budget.
+enum class budgeted_analysis
+{
+    /// @brief The total jumps, as analyze_jumps; slices add up.
+    jumps,
+    /// @brief The max of min distances, as analyze_latency; slices take the max.
+    latency
+};
+
+/// @brief How a budgeted query ended.
+enum class budget_status
+{
+    ok,
+    /// @brief Every strategy ran out of memory.
+    budget_exceeded,
+    /// @brief ISL failed for another reason, e.g. a malformed input.
+    error
+};
+
+/// @brief The result of a query run under a memory budget.
+struct budgeted_struct
+{
+    const budget_status status;
+    /// @brief The result if status is ok, else 0.
+    const long value;
+    /// @brief The number of dst slices of the last strategy tried, 1 if unsliced.
+    const int slices;
+    /// @brief The usage of every stage run, failed attempts included.
+    const std::vector<stage_usage_struct> stages;
+};
+typedef std::unique_ptr<budgeted_struct> budgeted;
+
+budgeted analyze_budgeted(
+    budgeted_analysis analysis, const std::string& src_occupancy, const std::string& dst_fill,
+    const std::string& dist_func, long budget_bytes, int max_slices = 16
+);
+
+/**
+ * Builds the map that isolates one dim of a set space into the range of a
+ * wrapped pair, e.g. for pos = 1, { dst[x, y, z] -> [[x, z] -> [y]] }. Apply it
+ * to a range then uncurry to move the other dims into the domain; its reverse
+ * puts the dim back in place.
+ *
+ * @param __isl_take set_space  The space holding the dim.
+ * @param pos                   The position of the dim to isolate.
+ */
+__isl_give isl_map *isolate_dim_map(__isl_take isl_space *set_space, int pos)
+{
+    isl_size n = isl_space_dim(set_space, isl_dim_set);
+    // Builds [[others] -> [pos]] with the same parameters as set_space.
+    isl_space *p_params = isl_space_params(isl_space_copy(set_space));
+    isl_space *p_others = isl_space_add_dims(
+        isl_space_set_from_params(isl_space_copy(p_params)), isl_dim_set, n - 1
+    );
+    isl_space *p_isolated = isl_space_add_dims(
+        isl_space_set_from_params(p_params), isl_dim_set, 1
+    );
+    isl_space *p_split = isl_space_wrap(
+        isl_space_map_from_domain_and_range(p_others, p_isolated)
+    );
+
+    // Equates every dim with its new position; pos moves to the end.
+    isl_map *p_isolate = isl_map_universe(
+        isl_space_map_from_domain_and_range(set_space, p_split)
+    );
+    for (int i = 0; i < n; i++)
+    {
+        int out = i < pos ? i : (i == pos ? n - 1 : i - 1);
+        p_isolate = isl_map_equate(p_isolate, isl_dim_in, i, isl_dim_out, out);
+    }
+
+    return p_isolate;
+}
+
+/**
+ * Adds a constraint of the form sum(coefficient * var) + constant {= or >=} 0
+ * to a basic map.
+ *
+ * @param __isl_take bmap   The basic map the constraint is added to.
+ * @param terms             The (dim type, position, coefficient) triples.
+ * @param constant          The constant term.
+ * @param equality          Whether the constraint is an equality.
+ */
+__isl_give isl_basic_map *add_affine_constraint(
+    __isl_take isl_basic_map *bmap,
+    const std::vector<std::tuple<isl_dim_type, int, long>>& terms,
+    long constant,
+    bool equality
+) {
+    isl_ctx *p_ctx = isl_basic_map_get_ctx(bmap);
+    isl_local_space *p_local = isl_basic_map_get_local_space(bmap);
+    isl_constraint *p_constraint = equality ? isl_constraint_alloc_equality(p_local)
+                                            : isl_constraint_alloc_inequality(p_local);
+    // Sets the terms as values, as the _si setters only take ints.
+    for (const auto& [type, pos, coefficient] : terms)
+    {
+        p_constraint = isl_constraint_set_coefficient_val(
+            p_constraint, type, pos, isl_val_int_from_si(p_ctx, coefficient)
+        );
+    }
+    p_constraint = isl_constraint_set_constant_val(p_constraint, isl_val_int_from_si(p_ctx, constant));
+
+    return isl_basic_map_add_constraint(bmap, p_constraint);
+}
+
 /// @brief Strings representing the src and dst datum holds/requests in ISL.
 struct binding_struct
 {
@@ -109,7 +396,7 @@ typedef std::unique_ptr<binding_struct> binding;
  */
 struct fold_struct
 {
-    const long cost;
+    const exact cost;
     const std::string folded_repr;
 };
 typedef std::unique_ptr<fold_struct> fold_result;
@@ -1,19 +1,191 @@
 #include "latency.hpp"
+#include "metrics.hpp"
 
+#include <algorithm>
+#include <initializer_list>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 #pragma O3
 /// NOTES FOR NON-TREE MULTICAST SCENARIO
-// - Load balancing issues for multiple minimally distant sources.
+// - Load balancing issues for multiple minimally distant sources; see tie_break.
 // - Compose minimal distances with the other set to remove non-minimal pairs then
 // move on with the rest of the algorithm.
+
+/// @brief How to pick a source among several equally close ones.
+enum class tie_break
+{
+    /// @brief The lexicographically smallest source.
+    lowest_index,
+    /// @brief Rotates the preferred source with the dst coordinates, i.e. the
+    /// smallest (sum(src) - sum(dst)) mod period, then the smallest source.
+    /// Needs a period of at least 2; a period of 1 is lowest_index.
+    round_robin,
+    /// @brief The source closest under a secondary distance function, then
+    /// the smallest source.
+    secondary_metric,
+    /// @brief Even dsts, by the parity of their coordinate sum, take the
+    /// smallest source and odd ones the largest. Only the two extreme sources
+    /// of a tie get load: this halves two-way ties when the tied dsts
+    /// alternate in parity, e.g. along a row, but is no balanced split of
+    /// wider ties, for which round_robin spreads the load.
+    parity_extremes
+};
+
+/// @brief The tie breaking policy and its parameters.
+struct tie_break_struct
+{
+    tie_break policy = tie_break::lowest_index;
+    /// @brief The rotation period for round_robin, at least 2.
+    long period = 2;
+    /// @brief The { [dst -> src] -> [key] } map for secondary_metric.
+    std::string secondary_metric = "";
+};
+
+/**
+ * Projects every transfer onto the (dst, src) pair it travels between.
+ *
+ * @param __isl_take transfers  The transfers as [data -> dst] -> src.
+ *
+ * @return The map { [[data -> dst] -> src] -> [dst -> src] }.
+ */
+__isl_give isl_map *transfer_pairs(__isl_take isl_map *transfers)
+{
+    isl_map *p_to_dst = isl_map_range_factor_range(
+        isl_map_domain_map(isl_map_copy(transfers))
+    );
+    isl_map *p_to_src = isl_map_range_map(transfers);
+
+    return isl_map_range_product(p_to_dst, p_to_src);
+}
+
+/**
+ * Picks the source with the smallest key among the tied sources, breaking
+ * remaining ties by the smallest source.
+ *
+ * @param __isl_take tied_sources   The tied sources as [data -> dst] -> src.
+ * @param __isl_take key            The key as { [dst -> src] -> [key] }.
+ */
+__isl_give isl_map *lexmin_by_key(
+    __isl_take isl_map *tied_sources,
+    __isl_take isl_map *key
+) {
+    // Projects [[data -> dst] -> src] onto [dst -> src].
+    isl_map *p_to_pair = transfer_pairs(tied_sources);
+    // Makes [data -> dst] -> [key -> src] and picks the smallest.
+    isl_map *p_keyed = isl_map_apply_range(p_to_pair, key);
+    p_keyed = isl_map_range_reverse(isl_map_curry(p_keyed));
+    DUMP(p_keyed);
+    p_keyed = isl_map_lexmin(p_keyed);
+
+    return isl_map_range_factor_range(p_keyed);
+}
+
+/**
+ * Picks one source per [data -> dst] among the minimally distant ones.
+ *
+ * @param __isl_take tied_sources   The tied sources as [data -> dst] -> src.
+ * @param tie_breaker               The policy to pick with.
+ * @throw std::invalid_argument if round_robin has a period below 2.
+ */
+__isl_give isl_map *break_ties(
+    __isl_take isl_map *tied_sources,
+    const tie_break_struct& tie_breaker
+) {
+    if (tie_breaker.policy == tie_break::round_robin && tie_breaker.period < 2)
+    {
+        isl_map_free(tied_sources);
+        throw std::invalid_argument("round_robin needs a period of at least 2, got "
+                                    + std::to_string(tie_breaker.period));
+    }
+    isl_ctx *p_ctx = isl_map_get_ctx(tied_sources);
+    isl_space *p_space = isl_map_get_space(tied_sources);
+    isl_space *p_fill_space = isl_space_unwrap(isl_space_domain(isl_space_copy(p_space)));
+    isl_size n_data = isl_space_dim(p_fill_space, isl_dim_in);
+    isl_space_free(p_fill_space);
+    isl_size n_mesh = isl_space_dim(p_space, isl_dim_out);
+
+    switch (tie_breaker.policy)
+    {
+        case tie_break::round_robin:
+        {
+            // Builds { [dst -> src] -> [(sum(src) - sum(dst)) mod period] }.
+            isl_space *p_dst_space = isl_space_range(isl_space_unwrap(
+                isl_space_domain(isl_space_copy(p_space))
+            ));
+            isl_space *p_pair_space = isl_space_wrap(isl_space_map_from_domain_and_range(
+                p_dst_space, isl_space_range(p_space)
+            ));
+            isl_local_space *p_pair_local = isl_local_space_from_space(p_pair_space);
+            isl_pw_aff *p_key = isl_pw_aff_zero_on_domain(isl_local_space_copy(p_pair_local));
+            for (int i = 0; i < n_mesh; i++)
+            {
+                p_key = isl_pw_aff_sub(p_key, isl_pw_aff_var_on_domain(
+                    isl_local_space_copy(p_pair_local), isl_dim_set, i
+                ));
+                p_key = isl_pw_aff_add(p_key, isl_pw_aff_var_on_domain(
+                    isl_local_space_copy(p_pair_local), isl_dim_set, n_mesh + i
+                ));
+            }
+            isl_local_space_free(p_pair_local);
+            p_key = isl_pw_aff_mod_val(p_key, isl_val_int_from_si(p_ctx, tie_breaker.period));
+            DUMP(p_key);
+
+            return lexmin_by_key(tied_sources, isl_map_from_pw_aff(p_key));
+        }
+        case tie_break::secondary_metric:
+        {
+            isl_space_free(p_space);
+            isl_map *p_key = isl_map_read_from_str(
+                p_ctx, tie_breaker.secondary_metric.c_str()
+            );
+
+            return lexmin_by_key(tied_sources, p_key);
+        }
+        case tie_break::parity_extremes:
+        {
+            // Finds the dsts whose coordinates sum to an even number.
+            isl_local_space *p_fill_local = isl_local_space_from_space(
+                isl_space_domain(p_space)
+            );
+            isl_pw_aff *p_parity = isl_pw_aff_zero_on_domain(isl_local_space_copy(p_fill_local));
+            for (int i = 0; i < n_mesh; i++)
+            {
+                p_parity = isl_pw_aff_add(p_parity, isl_pw_aff_var_on_domain(
+                    isl_local_space_copy(p_fill_local), isl_dim_set, n_data + i
+                ));
+            }
+            isl_local_space_free(p_fill_local);
+            p_parity = isl_pw_aff_mod_val(p_parity, isl_val_int_from_si(p_ctx, 2));
+            isl_set *p_even = isl_pw_aff_zero_set(p_parity);
+            DUMP(p_even);
+
+            // Even dsts take the smallest source, odd ones the largest.
+            isl_map *p_even_sources = isl_map_lexmin(isl_map_intersect_domain(
+                isl_map_copy(tied_sources), isl_set_copy(p_even)
+            ));
+            isl_map *p_odd_sources = isl_map_lexmax(isl_map_subtract_domain(
+                tied_sources, p_even
+            ));
+
+            return isl_map_union(p_even_sources, p_odd_sources);
+        }
+        case tie_break::lowest_index:
+        default:
+            isl_space_free(p_space);
+            return isl_map_lexmin(tied_sources);
+    }
+}
+
 __isl_give isl_map *identify_mesh_casts( 
     __isl_take isl_map *src_occupancy, 
     __isl_take isl_map *dst_fill, 
-    __isl_take isl_map *dist_func
+    __isl_take isl_map *dist_func,
+    const tie_break_struct& tie_breaker = {}
 ) {
     /* Makes [[dst -> data] -> dst] -> [data] */
     isl_set *wrapped_dst_fill = isl_map_wrap(dst_fill);
@@ -50,17 +222,20 @@ __isl_give isl_map *identify_mesh_casts(
         isl_map_copy(dst_to_data_TO_dst_to_src), isl_map_copy(dist_func)
     );
     DUMP(distances_map);
-    isl_map *dst_to_data_TO_dst_to_src_TO2_dst_to_src = isl_map_range_map(dst_to_data_TO_dst_to_src);
+    isl_map *dst_to_data_TO_dst_to_src_TO2_dst_to_src = isl_map_range_map(isl_map_copy(dst_to_data_TO_dst_to_src));
     isl_map *dst_to_data_TO_dst_to_src_TO2_dist = isl_map_apply_range(dst_to_data_TO_dst_to_src_TO2_dst_to_src, dist_func);
     DUMP(dst_to_data_TO_dst_to_src_TO2_dist);
 
     // Gets the minimal distance pairs.
     isl_map *lexmin_distances = isl_map_lexmin(distances_map);
-    isl_map *assoc_dist_with_src = isl_map_apply_range(lexmin_distances, isl_map_reverse(
-        dst_to_data_TO_dst_to_src_TO2_dist
-    ));
-    // Isolates the relevant minimal pairs.
-    isl_map *minimal_pairs = isl_set_unwrap(isl_map_range(assoc_dist_with_src));
+    // Attaches the minimal distance of its [dst -> data] to every pair.
+    isl_map *dst_to_data_TO_dst_to_src_TO2_min_dist = isl_map_apply_range(
+        isl_map_domain_map(dst_to_data_TO_dst_to_src), lexmin_distances
+    );
+    // Isolates the pairs at the minimal distance of their own [dst -> data].
+    isl_map *minimal_pairs = isl_set_unwrap(isl_map_domain(isl_map_intersect(
+        dst_to_data_TO_dst_to_src_TO2_dist, dst_to_data_TO_dst_to_src_TO2_min_dist
+    )));
     DUMP(minimal_pairs);
     // Isolates the multicast networks.
     isl_map *multicast_networks = isl_map_curry(minimal_pairs);
@@ -68,7 +243,7 @@ __isl_give isl_map *identify_mesh_casts(
     DUMP(multicast_networks);
     multicast_networks = isl_map_uncurry(multicast_networks);
     DUMP(multicast_networks);
-    multicast_networks = isl_map_lexmin(multicast_networks);
+    multicast_networks = break_ties(multicast_networks, tie_breaker);
     DUMP(multicast_networks);
     multicast_networks = isl_map_curry(multicast_networks);
     DUMP(multicast_networks);
@@ -80,7 +255,8 @@ __isl_give isl_map *identify_mesh_casts(
     isl_ctx *const p_ctx,
     const std::string& src_occupancy, 
     const std::string& dst_fill, 
-    const std::string& dist_func
+    const std::string& dist_func,
+    const tie_break_struct& tie_breaker = {}
 ) {
     // Reads the string representations of the maps into isl objects.
     isl_map *p_src_occupancy = isl_map_read_from_str(
@@ -100,13 +276,521 @@ __isl_give isl_map *identify_mesh_casts(
     isl_map *ret = identify_mesh_casts(
         p_src_occupancy,
         p_dst_fill,
-        p_dist_func
+        p_dist_func,
+        tie_breaker
     );
 
     return ret;
 }
 
-long cost_mesh_cast(
+/**
+ * Calculates how many (dst, datum) deliveries every source serves.
+ *
+ * @param __isl_take mesh_cast_networks The networks from identify_mesh_casts.
+ *
+ * @return A piecewise quasi-polynomial over src of the deliveries served.
+ */
+__isl_give isl_pw_qpolynomial *source_load(__isl_take isl_map *mesh_cast_networks)
+{
+    // Makes src -> [data -> dst] and counts the deliveries per src.
+    isl_map *p_served = isl_map_reverse(isl_map_uncurry(mesh_cast_networks));
+    DUMP(p_served);
+
+    return isl_map_card(p_served);
+}
+
+/**
+ * Checks a routing order of the mesh dims, filling in the default one.
+ *
+ * @param dim_order The routing order of the mesh dims; empty for 0, 1, ...,
+ *                  N-1 (i.e. XY).
+ * @param n_mesh    The number of mesh dims, N.
+ * @throw std::invalid_argument if the order is not a permutation of the dims.
+ */
+std::vector<int> routing_order(std::vector<int> dim_order, isl_size n_mesh)
+{
+    if (n_mesh < 0)
+        throw std::invalid_argument("networks have no mesh dims");
+    if (dim_order.empty())
+    {
+        for (int i = 0; i < n_mesh; i++)
+            dim_order.push_back(i);
+    }
+    if (dim_order.size() != static_cast<std::size_t>(n_mesh))
+        throw std::invalid_argument("dim order does not cover the " + std::to_string(n_mesh) + " mesh dims");
+    std::vector<bool> seen(n_mesh, false);
+    for (int m : dim_order)
+    {
+        if (m < 0 || m >= n_mesh || seen[m])
+            throw std::invalid_argument("dim order repeats or exceeds mesh dim " + std::to_string(m));
+        seen[m] = true;
+    }
+
+    return dim_order;
+}
+
+/// @brief The mesh dims of networks as [data] -> [dst -> src], or isl_size_error.
+isl_size network_mesh_dims(__isl_keep isl_map *mesh_cast_networks)
+{
+    isl_size n_out = isl_map_dim(mesh_cast_networks, isl_dim_out);
+    return n_out < 0 ? isl_size_error : n_out / 2;
+}
+
+/**
+ * Checks a routing order as routing_order does, before the caller builds
+ * anything, freeing the maps it took if the order does not fit.
+ *
+ * @param dim_order The routing order of the mesh dims; empty for XY.
+ * @param n_mesh    The number of mesh dims, or isl_size_error.
+ * @param taken     The __isl_take maps of the caller.
+ * @throw std::invalid_argument if the order is not a permutation of the dims.
+ */
+std::vector<int> routing_order_or_free(
+    const std::vector<int>& dim_order, isl_size n_mesh, std::initializer_list<isl_map*> taken
+) {
+    try
+    {
+        return routing_order(dim_order, n_mesh);
+    }
+    catch (const std::invalid_argument&)
+    {
+        for (isl_map *p_map : taken)
+            isl_map_free(p_map);
+        throw;
+    }
+}
+
+/**
+ * Relates every datum transfer to the directed mesh links it crosses under
+ * dimension-order routing. A link is link[dim, dir, node...], leaving node
+ * along mesh dim dim in direction dir (1 or -1).
+ *
+ * @param __isl_take mesh_cast_networks The networks from identify_mesh_casts,
+ *                                      as [data] -> [dst -> src].
+ * @param dim_order                     The routing order of the mesh dims;
+ *                                      empty for 0, 1, ..., N-1 (i.e. XY).
+ *
+ * @return The map { [[data -> dst] -> src] -> link[dim, dir, node...] }.
+ * @throw std::invalid_argument if dim_order is not a permutation of the dims.
+ */
+__isl_give isl_map *dor_routed_links(
+    __isl_take isl_map *mesh_cast_networks,
+    std::vector<int> dim_order = {}
+) {
+    // Checks the order before building anything.
+    dim_order = routing_order_or_free(dim_order, network_mesh_dims(mesh_cast_networks), {mesh_cast_networks});
+    // Makes the transfers [[data -> dst] -> src].
+    isl_set *p_transfers = isl_map_wrap(isl_map_uncurry(mesh_cast_networks));
+    isl_space *p_transfer_space = isl_set_get_space(p_transfers);
+    // The transfers flatten to data, dst, src.
+    isl_space *p_pair_space = isl_space_unwrap(isl_space_copy(p_transfer_space));
+    isl_size n_mesh = isl_space_dim(p_pair_space, isl_dim_out);
+    isl_size n_data = isl_space_dim(p_pair_space, isl_dim_in) - n_mesh;
+    isl_space_free(p_pair_space);
+    const int dst = n_data, src = n_data + n_mesh;
+
+    // Builds the space of the transfer to link relation.
+    isl_space *p_link_space = isl_space_add_dims(
+        isl_space_set_from_params(isl_space_params(isl_space_copy(p_transfer_space))),
+        isl_dim_set, n_mesh + 2
+    );
+    p_link_space = isl_space_set_tuple_name(p_link_space, isl_dim_set, "link");
+    isl_space *p_routing_space = isl_space_map_from_domain_and_range(
+        p_transfer_space, p_link_space
+    );
+
+    isl_map *p_routed = isl_map_empty(isl_space_copy(p_routing_space));
+    for (int k = 0; k < n_mesh; k++)
+    {
+        const int m = dim_order[k];
+        for (int dir : {1, -1})
+        {
+            isl_basic_map *p_step = isl_basic_map_universe(isl_space_copy(p_routing_space));
+            // Fixes the dim and direction of the link.
+            p_step = add_affine_constraint(p_step, {{isl_dim_out, 0, 1}}, -m, true);
+            p_step = add_affine_constraint(p_step, {{isl_dim_out, 1, 1}}, -dir, true);
+            // Dims routed before are at dst, dims routed after are still at src.
+            for (int j = 0; j < k; j++)
+            {
+                p_step = add_affine_constraint(p_step, {
+                    {isl_dim_out, 2 + dim_order[j], 1}, {isl_dim_in, dst + dim_order[j], -1}
+                }, 0, true);
+            }
+            for (int j = k + 1; j < n_mesh; j++)
+            {
+                p_step = add_affine_constraint(p_step, {
+                    {isl_dim_out, 2 + dim_order[j], 1}, {isl_dim_in, src + dim_order[j], -1}
+                }, 0, true);
+            }
+            // Walks from src towards dst along m: src <= node < dst going up,
+            // dst < node <= src going down.
+            p_step = add_affine_constraint(p_step, {
+                {isl_dim_out, 2 + m, dir}, {isl_dim_in, src + m, -dir}
+            }, 0, false);
+            p_step = add_affine_constraint(p_step, {
+                {isl_dim_in, dst + m, dir}, {isl_dim_out, 2 + m, -dir}
+            }, -1, false);
+
+            p_routed = isl_map_union(p_routed, isl_map_from_basic_map(p_step));
+        }
+    }
+    isl_space_free(p_routing_space);
+    p_routed = isl_map_intersect_domain(p_routed, p_transfers);
+    DUMP(p_routed);
+
+    return p_routed;
+}
+
+/// @brief What a link carries once per unit of load.
+enum class link_load_kind
+{
+    /// @brief Every (dst, datum) transfer, sent on its own.
+    unicast,
+    /// @brief Every multicast tree, i.e. every [datum -> src] network, which
+    /// crosses a link shared by the paths to several dsts once.
+    multicast
+};
+
+/**
+ * Counts the data crossing every directed mesh link when each (dst, datum) is
+ * sent from its chosen src under dimension-order routing.
+ *
+ * @param __isl_take mesh_cast_networks The networks from identify_mesh_casts.
+ * @param dim_order                     The routing order of the mesh dims.
+ * @param kind                          Whether the paths to the dsts of a
+ *                                      network share their common links.
+ *
+ * @return A piecewise quasi-polynomial over link[dim, dir, node...] of the
+ *         transfers or trees crossing it.
+ */
+__isl_give isl_pw_qpolynomial *link_loads(
+    __isl_take isl_map *mesh_cast_networks,
+    const std::vector<int>& dim_order = {},
+    link_load_kind kind = link_load_kind::unicast
+) {
+    isl_map *p_routed = dor_routed_links(mesh_cast_networks, dim_order);
+    if (kind == link_load_kind::multicast)
+    {
+        // Drops the dst, { [[data -> dst] -> src] -> link } to { [data -> src] -> link }.
+        p_routed = isl_map_uncurry(isl_map_range_factor_range(
+            isl_map_curry(isl_map_curry(p_routed))
+        ));
+    }
+    DUMP(p_routed);
+
+    return isl_map_card(isl_map_reverse(p_routed));
+}
+
+/// @brief The most loaded link found by hottest_link.
+struct hot_link_struct
+{
+    /// @brief The load of the most loaded link.
+    const long load;
+    /// @brief The links on the piece of the load function holding the max.
+    const std::string region;
+    /// @brief A link with the max load; empty only if the hottest piece is
+    /// unbounded along some link dim.
+    const std::string link;
+};
+typedef std::unique_ptr<hot_link_struct> hot_link;
+
+/// @brief Tracks the hottest piece through isl_pw_qpolynomial_foreach_piece.
+struct hottest_piece_info
+{
+    isl_val *p_max;
+    isl_set *p_region;
+    isl_qpolynomial *p_load;
+};
+
+isl_stat hottest_piece_accumulator(isl_set *set, isl_qpolynomial *qp, void *p_hottest)
+{
+    auto p_info = static_cast<hottest_piece_info*>(p_hottest);
+    isl_val *p_piece_max = isl_pw_qpolynomial_max(
+        isl_pw_qpolynomial_alloc(isl_set_copy(set), isl_qpolynomial_copy(qp))
+    );
+    if (!p_info->p_max || isl_val_gt(p_piece_max, p_info->p_max))
+    {
+        isl_val_free(p_info->p_max);
+        isl_set_free(p_info->p_region);
+        isl_qpolynomial_free(p_info->p_load);
+        *p_info = {p_piece_max, set, qp};
+    }
+    else
+    {
+        isl_val_free(p_piece_max);
+        isl_set_free(set);
+        isl_qpolynomial_free(qp);
+    }
+
+    return isl_stat_ok;
+}
+
+/**
+ * Narrows a set down to one point at which a function reaches its max over the
+ * set. Every dim is bisected in turn, keeping a half on which the max of the
+ * function is still reached, so it takes a max per halving whatever the form
+ * of the function.
+ *
+ * @param __isl_take region The set, bounded along every dim.
+ * @param __isl_keep f      The function.
+ * @param __isl_keep max    The max of f over region.
+ *
+ * @return The point, or NULL if region is unbounded along some dim.
+ */
+__isl_give isl_point *argmax_point(
+    __isl_take isl_set *region,
+    __isl_keep isl_pw_qpolynomial *f,
+    __isl_keep isl_val *max
+) {
+    // Checks whether the max of f over a part of region is the max over region.
+    auto reaches_max = [&](isl_set *p_part) {
+        isl_val *p_part_max = isl_pw_qpolynomial_max(isl_pw_qpolynomial_intersect_domain(
+            isl_pw_qpolynomial_copy(f), isl_set_copy(p_part)
+        ));
+        bool reached = isl_val_eq(p_part_max, max) == isl_bool_true;
+        isl_val_free(p_part_max);
+        return reached;
+    };
+
+    isl_size n = isl_set_dim(region, isl_dim_set);
+    for (int i = 0; i < n; i++)
+    {
+        isl_val *p_lo = isl_set_dim_min_val(isl_set_copy(region), i);
+        isl_val *p_hi = isl_set_dim_max_val(isl_set_copy(region), i);
+        if (isl_val_is_int(p_lo) != isl_bool_true || isl_val_is_int(p_hi) != isl_bool_true)
+        {
+            isl_val_free(p_lo);
+            isl_val_free(p_hi);
+            isl_set_free(region);
+            return nullptr;
+        }
+        // Keeps the max reached within [lo, hi] along dim i.
+        while (isl_val_lt(p_lo, p_hi) == isl_bool_true)
+        {
+            isl_val *p_mid = isl_val_floor(isl_val_div_ui(
+                isl_val_add(isl_val_copy(p_lo), isl_val_copy(p_hi)), 2
+            ));
+            isl_set *p_lower = isl_set_upper_bound_val(
+                isl_set_copy(region), isl_dim_set, i, isl_val_copy(p_mid)
+            );
+            if (reaches_max(p_lower))
+            {
+                isl_set_free(region);
+                region = p_lower;
+                isl_val_free(p_hi);
+                p_hi = p_mid;
+            }
+            else
+            {
+                isl_set_free(p_lower);
+                isl_val_free(p_lo);
+                p_lo = isl_val_add_ui(p_mid, 1);
+                region = isl_set_lower_bound_val(region, isl_dim_set, i, isl_val_copy(p_lo));
+            }
+        }
+        region = isl_set_fix_val(region, isl_dim_set, i, p_lo);
+        isl_val_free(p_hi);
+    }
+
+    return isl_set_sample_point(region);
+}
+
+/**
+ * Finds the most loaded link of link_loads. The max is exact, and so is the
+ * link, found by bisecting the hottest piece down to a point holding the max.
+ *
+ * @param __isl_take loads  The link loads from link_loads.
+ * @throw std::overflow_error if the max load does not fit in a long.
+ */
+hot_link hottest_link(__isl_take isl_pw_qpolynomial *loads)
+{
+    hottest_piece_info info{nullptr, nullptr, nullptr};
+    isl_pw_qpolynomial_foreach_piece(loads, hottest_piece_accumulator, &info);
+    isl_pw_qpolynomial_free(loads);
+    if (!info.p_max)
+        return hot_link(new hot_link_struct{0, "{ }", ""});
+
+    char *s_region = isl_set_to_str(info.p_region);
+    std::string region(s_region);
+    free(s_region);
+
+    // Pins down a link holding the max on the hottest piece.
+    isl_pw_qpolynomial *p_piece = isl_pw_qpolynomial_alloc(
+        isl_set_copy(info.p_region), info.p_load
+    );
+    isl_point *p_link = argmax_point(info.p_region, p_piece, info.p_max);
+    std::string link = "";
+    if (p_link)
+    {
+        char *s_link = isl_point_to_str(p_link);
+        link = s_link;
+        free(s_link);
+        isl_point_free(p_link);
+    }
+    isl_pw_qpolynomial_free(p_piece);
+
+    // Converts last, such that nothing is left behind if it throws.
+    long max_load = val_to_long(info.p_max);
+
+    return hot_link(new hot_link_struct{max_load, region, link});
+}
+
+/// @brief The timing parameters of the mesh links, as ISL value strings.
+struct link_timing_struct
+{
+    /// @brief The cycles for a datum to cross one hop.
+    const std::string per_hop_latency;
+    /// @brief The cycles a link is busy per datum, i.e. 1 / bandwidth.
+    const std::string cycles_per_datum;
+};
+
+/// @brief The completion times under the bandwidth-aware latency model.
+struct loaded_latency_struct
+{
+    /// @brief The completion time per dst as an ISL fold string.
+    const std::string completion;
+    /// @brief The latest completion time over every dst.
+    const double critical_path;
+    /// @brief critical_path as an exact ISL value string.
+    const std::string exact_critical_path;
+    /// @brief Whether ISL bounded the busiest link per dst exactly; if not,
+    /// completion and the critical path are upper bounds.
+    const bool tight;
+};
+typedef std::unique_ptr<loaded_latency_struct> loaded_latency;
+
+/**
+ * Lifts a function over the domain or the range of a relation onto the
+ * relation itself, e.g. f(link) onto { [dst -> link] }.
+ *
+ * @param __isl_take projection The map from the wrapped relation to the
+ *                              arguments of f, e.g. its range_map.
+ * @param __isl_take f          The function to lift.
+ */
+__isl_give isl_pw_qpolynomial *lift_pw_qpolynomial(
+    __isl_take isl_map *projection,
+    __isl_take isl_pw_qpolynomial *f
+) {
+    // Every point has exactly one image, so the sum is just f at that image.
+    return isl_map_apply_pw_qpolynomial(projection, f);
+}
+
+/**
+ * Calculates the completion time of every dst when links serialize the data
+ * they carry, instead of the hop count alone.
+ *
+ * A dst receiving V data over routes whose busiest link carries L data, at
+ * most H hops away, completes at
+ *      per_hop_latency * H + cycles_per_datum * max(V, L).
+ * Only remote transfers count towards V and L. The busiest link per dst is
+ * bounded by ISL, so it is exact for affine loads and an upper bound otherwise,
+ * as reported by tight.
+ *
+ * @param __isl_take mesh_cast_networks The networks from identify_mesh_casts.
+ * @param __isl_take dist_func          The distance function used to find them.
+ * @param timing                        The link timing parameters.
+ * @param dim_order                     The routing order of the mesh dims.
+ */
+loaded_latency analyze_loaded_latency(
+    __isl_take isl_map *mesh_cast_networks,
+    __isl_take isl_map *dist_func,
+    const link_timing_struct& timing,
+    const std::vector<int>& dim_order = {}
+) {
+    // Checks the order before building anything.
+    routing_order_or_free(dim_order, network_mesh_dims(mesh_cast_networks), {mesh_cast_networks, dist_func});
+    isl_ctx *p_ctx = isl_map_get_ctx(mesh_cast_networks);
+    isl_val *p_per_hop = isl_val_read_from_str(p_ctx, timing.per_hop_latency.c_str());
+    isl_val *p_per_datum = isl_val_read_from_str(p_ctx, timing.cycles_per_datum.c_str());
+
+    // Drops the transfers a dst already holds locally.
+    isl_map *p_transfers = isl_map_uncurry(mesh_cast_networks);
+    isl_size n_data = isl_map_dim(p_transfers, isl_dim_in) - isl_map_dim(p_transfers, isl_dim_out);
+    isl_map *p_local = isl_map_universe(isl_map_get_space(p_transfers));
+    for (int i = 0; i < isl_map_dim(p_transfers, isl_dim_out); i++)
+        p_local = isl_map_equate(p_local, isl_dim_in, n_data + i, isl_dim_out, i);
+    p_transfers = isl_map_subtract(p_transfers, p_local);
+    DUMP(p_transfers);
+    // Projects the transfers onto their dst.
+    isl_map *p_to_dst = isl_map_range_factor_range(
+        isl_map_domain_map(isl_map_copy(p_transfers))
+    );
+
+    // Finds the farthest hop per dst, H.
+    isl_map *p_hops = isl_map_apply_range(transfer_pairs(isl_map_copy(p_transfers)), dist_func);
+    p_hops = isl_map_apply_domain(p_hops, isl_map_copy(p_to_dst));
+    isl_pw_qpolynomial *p_hop_time = isl_pw_qpolynomial_scale_val(
+        isl_pw_qpolynomial_from_pw_aff(isl_map_dim_max(p_hops, 0)),
+        p_per_hop
+    );
+    DUMP(p_hop_time);
+
+    // Counts the data received per dst, V.
+    isl_pw_qpolynomial *p_received = isl_map_card(
+        isl_map_reverse(isl_set_unwrap(isl_map_domain(isl_map_copy(p_transfers))))
+    );
+    DUMP(p_received);
+
+    // Finds the links on the routes to every dst and their loads, L.
+    isl_map *p_routed = dor_routed_links(isl_map_curry(p_transfers), dim_order);
+    isl_pw_qpolynomial *p_loads = isl_map_card(isl_map_reverse(isl_map_copy(p_routed)));
+    isl_map *p_dst_links = isl_map_apply_domain(p_routed, p_to_dst);
+    isl_set *p_dst_link_pairs = isl_map_wrap(p_dst_links);
+    isl_map *p_pair_to_dst = isl_map_domain_map(isl_set_unwrap(isl_set_copy(p_dst_link_pairs)));
+    isl_map *p_pair_to_link = isl_map_range_map(isl_set_unwrap(p_dst_link_pairs));
+
+    // Bounds the link serialized completion over the links of every dst.
+    isl_pw_qpolynomial *p_link_time = isl_pw_qpolynomial_add(
+        lift_pw_qpolynomial(p_pair_to_dst, isl_pw_qpolynomial_copy(p_hop_time)),
+        isl_pw_qpolynomial_scale_val(
+            lift_pw_qpolynomial(p_pair_to_link, p_loads), isl_val_copy(p_per_datum)
+        )
+    );
+    isl_bool tight = isl_bool_false;
+    isl_pw_qpolynomial_fold *p_completion = isl_pw_qpolynomial_bound(
+        p_link_time, isl_fold_max, &tight
+    );
+    // Adds the dst side serialized completion.
+    isl_pw_qpolynomial *p_dst_time = isl_pw_qpolynomial_add(
+        p_hop_time, isl_pw_qpolynomial_scale_val(p_received, p_per_datum)
+    );
+    p_completion = isl_pw_qpolynomial_fold_fold(
+        p_completion,
+        isl_pw_qpolynomial_fold_from_pw_qpolynomial(isl_fold_max, p_dst_time)
+    );
+    p_completion = isl_pw_qpolynomial_fold_coalesce(p_completion);
+    DUMP(p_completion);
+
+    // Finds the critical path over every dst.
+    char *s_completion = isl_pw_qpolynomial_fold_to_str(p_completion);
+    std::string completion(s_completion);
+    free(s_completion);
+    isl_val *p_critical = isl_pw_qpolynomial_fold_max(p_completion);
+    char *s_critical = isl_val_to_str(p_critical);
+    loaded_latency ret = loaded_latency(new loaded_latency_struct{
+        completion, isl_val_get_d(p_critical), s_critical, tight == isl_bool_true
+    });
+    free(s_critical);
+    isl_val_free(p_critical);
+
+    return ret;
+}
+
+/**
+ * Calculates the cost of every multicast network individually, as the span of
+ * its dsts along the first of two mesh dims. See dor_mesh_cast_tree_costs for
+ * N-D meshes.
+ *
+ * @param __isl_take mesh_cast_networks The networks from identify_mesh_casts,
+ *                                      as [data] -> [dst -> src].
+ * @param __isl_take dist_func          The distance function used to find the
+ *                                      networks.
+ *
+ * @return A piecewise quasi-polynomial over [data -> src] holding the cost of
+ *         the network rooted at src for that datum, or NULL if ISL failed
+ *         or a network does not give exactly one cost.
+ */
+__isl_give isl_pw_qpolynomial *mesh_cast_network_costs(
     __isl_take isl_map *mesh_cast_networks,
     __isl_take isl_map *dist_func
 ) {
@@ -123,10 +807,10 @@ long cost_mesh_cast(
     mesh_cast_networks = isl_map_uncurry(mesh_cast_networks);
     DUMP(mesh_cast_networks);
     
-    // Projects away the xd dimension from mesh_cast_networks.
+    // Projects away the yd dimension from mesh_cast_networks, i.e. 2-D only.
     isl_map *multicast_simplification = isl_map_project_out(mesh_cast_networks, isl_dim_out, 1, 1);
     DUMP(multicast_simplification);
-    // Finds max(yd) - min(yd) for each [a, b] -> [xs, ys].
+    // Finds max(xd) - min(xd) for each [a, b] -> [xs, ys].
     isl_map *multicast_max = isl_map_lexmax(isl_map_copy(multicast_simplification));
     DUMP(multicast_max);
     isl_map *multicast_min = isl_map_lexmin(multicast_simplification);
@@ -134,7 +818,7 @@ long cost_mesh_cast(
     // Subtracts the max from the min to get the range.
     isl_map *multicast_min_neg = isl_map_neg(multicast_min);
     DUMP(multicast_min_neg);
-    isl_map *multi_cast_cost = isl_map_sum(multicast_max, multicast_min);
+    isl_map *multi_cast_cost = isl_map_sum(multicast_max, multicast_min_neg);
     DUMP(multi_cast_cost);
 
     // Converts to a qpolynomial for addition over range.
@@ -142,20 +826,258 @@ long cost_mesh_cast(
         isl_pw_multi_aff_from_map(multi_cast_cost)
     );
     DUMP(dirty_distances_aff);
-    assert(isl_multi_pw_aff_size(dirty_distances_aff) == 1);
+    // A malformed distance gives no or several results per request.
+    if (isl_multi_pw_aff_size(dirty_distances_aff) != 1)
+    {
+        isl_multi_pw_aff_free(dirty_distances_aff);
+        isl_map_free(dist_func);
+        return NULL;
+    }
     isl_pw_aff *distances_aff = isl_multi_pw_aff_get_at(dirty_distances_aff, 0);
     DUMP(distances_aff);
     isl_multi_pw_aff_free(dirty_distances_aff);
     auto *dirty_distances_fold = isl_pw_qpolynomial_from_pw_aff(distances_aff);
     DUMP(dirty_distances_fold);
 
+    isl_map_free(dist_func);
+
+    return dirty_distances_fold;
+}
+
+/// @brief Sums the cost of every multicast network, exactly.
+__isl_give isl_val *cost_mesh_cast_val(
+    __isl_take isl_map *mesh_cast_networks,
+    __isl_take isl_map *dist_func
+) {
+    // Fetches the cost of every network per datum.
+    isl_pw_qpolynomial *network_costs = mesh_cast_network_costs(
+        mesh_cast_networks, dist_func
+    );
+
     // Does the addition over range.
-    isl_pw_qpolynomial *sum = isl_pw_qpolynomial_sum(isl_pw_qpolynomial_sum(dirty_distances_fold));
+    isl_pw_qpolynomial *sum = isl_pw_qpolynomial_sum(isl_pw_qpolynomial_sum(network_costs));
     // Grabs the return value as an isl_val.
-    isl_val *sum_extract = isl_pw_qpolynomial_eval(sum, isl_point_zero(isl_pw_qpolynomial_get_domain_space(sum)));
-    long ret = isl_val_get_num_si(sum_extract);
+    return isl_pw_qpolynomial_eval(sum, isl_point_zero(isl_pw_qpolynomial_get_domain_space(sum)));
+}
 
-    return ret;
+/// @brief cost_mesh_cast_val as a long. @throw std::overflow_error if it does not fit.
+long cost_mesh_cast(
+    __isl_take isl_map *mesh_cast_networks,
+    __isl_take isl_map *dist_func
+) {
+    return val_to_long(cost_mesh_cast_val(mesh_cast_networks, dist_func));
+}
+
+/// @brief cost_mesh_cast_val kept exact past the range of a long.
+exact cost_mesh_cast_exact(
+    __isl_take isl_map *mesh_cast_networks,
+    __isl_take isl_map *dist_func
+) {
+    return val_to_exact(cost_mesh_cast_val(mesh_cast_networks, dist_func));
+}
+
+/**
+ * Calculates the exact link count of every multicast tree on an N-D mesh under
+ * dimension-order routing.
+ *
+ * A datum routed from src to dst first travels along dim order[0] to dst's
+ * coordinate, then along order[1], and so on. Every path leaving src along
+ * order[k] runs at the position fixed by the dst coordinates of the earlier
+ * dims, so the tree's links along order[k] are, per distinct dst prefix
+ * (d[order[0]], ..., d[order[k-1]]), the span between src and the extreme dst
+ * coordinates along order[k] with that prefix.
+ *
+ * @param __isl_take mesh_cast_networks The networks from identify_mesh_casts,
+ *                                      as [data] -> [dst -> src].
+ * @param dim_order                     The routing order of the mesh dims;
+ *                                      empty for 0, 1, ..., N-1 (i.e. XY).
+ *
+ * @return A piecewise quasi-polynomial over [data -> src] holding the link
+ *         count of the tree rooted at src for that datum.
+ * @throw std::invalid_argument if dim_order is not a permutation of the dims.
+ */
+__isl_give isl_pw_qpolynomial *dor_mesh_cast_tree_costs(
+    __isl_take isl_map *mesh_cast_networks,
+    std::vector<int> dim_order = {}
+) {
+    isl_size n_data = isl_map_dim(mesh_cast_networks, isl_dim_in);
+    // Checks the order before building anything.
+    dim_order = routing_order_or_free(dim_order, network_mesh_dims(mesh_cast_networks), {mesh_cast_networks});
+    // Makes the networks [[data] -> [src]] -> [dst].
+    isl_map *p_rooted = isl_map_uncurry(isl_map_range_reverse(mesh_cast_networks));
+    isl_size n_mesh = isl_map_dim(p_rooted, isl_dim_out);
+
+    // Permutes dst into routing order, i.e. dst[...] -> [d[order[0]], ...].
+    isl_space *p_dst_space = isl_space_range(isl_map_get_space(p_rooted));
+    isl_space *p_ordered_space = isl_space_add_dims(
+        isl_space_set_from_params(isl_space_params(isl_space_copy(p_dst_space))),
+        isl_dim_set, n_mesh
+    );
+    isl_map *p_order = isl_map_universe(
+        isl_space_map_from_domain_and_range(p_dst_space, p_ordered_space)
+    );
+    for (int k = 0; k < n_mesh; k++)
+        p_order = isl_map_equate(p_order, isl_dim_in, dim_order[k], isl_dim_out, k);
+    p_rooted = isl_map_apply_range(p_rooted, p_order);
+    DUMP(p_rooted);
+
+    isl_pw_qpolynomial *p_tree_cost = nullptr;
+    for (int k = 0; k < n_mesh; k++)
+    {
+        // Keeps the dst prefix up to and including the dim routed at step k.
+        isl_map *p_step = isl_map_project_out(
+            isl_map_copy(p_rooted), isl_dim_out, k + 1, n_mesh - k - 1
+        );
+        // Makes [[[data] -> [src]] -> [prefix]] -> [d_k].
+        p_step = isl_map_apply_range(
+            p_step, isolate_dim_map(isl_space_range(isl_map_get_space(p_step)), k)
+        );
+        p_step = isl_map_uncurry(p_step);
+        DUMP(p_step);
+
+        // Grabs the extreme dst coordinates along the step per prefix.
+        isl_pw_aff *p_hi = isl_map_dim_max(isl_map_copy(p_step), 0);
+        isl_pw_aff *p_lo = isl_map_dim_min(p_step, 0);
+        // Grabs the src coordinate along the step.
+        isl_local_space *p_prefix_local = isl_local_space_from_space(
+            isl_pw_aff_get_domain_space(p_hi)
+        );
+        isl_pw_aff *p_src = isl_pw_aff_var_on_domain(
+            p_prefix_local, isl_dim_set, n_data + dim_order[k]
+        );
+
+        // The paths span from src to the farthest dst on either side.
+        isl_pw_aff *p_span = isl_pw_aff_sub(
+            isl_pw_aff_max(p_hi, isl_pw_aff_copy(p_src)),
+            isl_pw_aff_min(p_lo, p_src)
+        );
+        DUMP(p_span);
+
+        // Sums the spans over every prefix of the tree.
+        isl_pw_qpolynomial *p_step_cost = isl_pw_qpolynomial_sum(
+            isl_pw_qpolynomial_from_pw_aff(p_span)
+        );
+        if (p_tree_cost)
+            p_tree_cost = isl_pw_qpolynomial_add(p_tree_cost, p_step_cost);
+        else
+            p_tree_cost = p_step_cost;
+    }
+    DUMP(p_tree_cost);
+
+    isl_map_free(p_rooted);
+
+    return p_tree_cost;
+}
+
+/**
+ * Sums the dimension-order-routed tree link counts over every multicast
+ * network, exactly.
+ *
+ * @param __isl_take mesh_cast_networks The networks from identify_mesh_casts.
+ * @param dim_order                     The routing order of the mesh dims.
+ */
+__isl_give isl_val *cost_dor_mesh_cast_val(
+    __isl_take isl_map *mesh_cast_networks,
+    const std::vector<int>& dim_order = {}
+) {
+    isl_pw_qpolynomial *p_tree_costs = dor_mesh_cast_tree_costs(mesh_cast_networks, dim_order);
+    // Sums over src per datum, then over every datum.
+    isl_pw_qpolynomial *sum = isl_pw_qpolynomial_sum(isl_pw_qpolynomial_sum(p_tree_costs));
+    return isl_pw_qpolynomial_eval(sum, isl_point_zero(isl_pw_qpolynomial_get_domain_space(sum)));
+}
+
+/// @brief cost_dor_mesh_cast_val as a long. @throw std::overflow_error if it does not fit.
+long cost_dor_mesh_cast(
+    __isl_take isl_map *mesh_cast_networks,
+    const std::vector<int>& dim_order = {}
+) {
+    return val_to_long(cost_dor_mesh_cast_val(mesh_cast_networks, dim_order));
+}
+
+/// @brief The cost of combining partial sums in the network against gathering them.
+struct reduction_struct
+{
+    /// @brief The links of every reduction tree, i.e. the hops when partial
+    /// sums are combined wherever their paths merge.
+    const exact tree_links;
+    /// @brief The hops when every partial sum travels alone to its accumulator.
+    const exact gather_hops;
+    /// @brief The hops from the farthest producer to its accumulator, i.e. the
+    /// depth of the deepest tree.
+    const exact depth;
+};
+typedef std::unique_ptr<reduction_struct> reduction;
+
+/**
+ * Analyzes the many-to-one flow of partial sums from their producers to an
+ * accumulator. Every producer sends to its nearest accumulator; the partial
+ * sums then combine where their dimension-order routed paths merge, so each
+ * tree link carries one partial sum. The paths into an accumulator are the
+ * multicast paths out of it routed in the reverse dim order, so the trees are
+ * costed as multicasts from the accumulators to the producers.
+ *
+ * @param __isl_take producers      The partial sums produced per node, e.g.
+ *                                  { prod[x, y] -> psum[o] }.
+ * @param __isl_take accumulators   The partial sums accumulated per node, e.g.
+ *                                  { acc[x, y] -> psum[o] }.
+ * @param __isl_take dist_func      The mesh metric, { [prod -> acc] -> [dist] }.
+ * @param dim_order                 The order the partial sums are routed in
+ *                                  towards the accumulator; empty for XY.
+ */
+reduction analyze_reduction(
+    __isl_take isl_map *producers,
+    __isl_take isl_map *accumulators,
+    __isl_take isl_map *dist_func,
+    std::vector<int> dim_order = {}
+) {
+    dim_order = routing_order_or_free(
+        dim_order, isl_map_dim(producers, isl_dim_in), {producers, accumulators, dist_func}
+    );
+    std::reverse(dim_order.begin(), dim_order.end());
+
+    // Sends every producer's partial sum to its nearest accumulator.
+    isl_map *p_trees = identify_mesh_casts(accumulators, producers, isl_map_copy(dist_func));
+    DUMP(p_trees);
+
+    // Gets the distance of every partial sum, { [psum -> [prod -> acc]] -> [dist] }.
+    isl_map *p_path_lengths = isl_map_apply_range(isl_map_range_map(isl_map_copy(p_trees)), dist_func);
+    isl_multi_pw_aff *p_lengths_mpa = isl_multi_pw_aff_from_pw_multi_aff(
+        isl_pw_multi_aff_from_map(p_path_lengths)
+    );
+    isl_pw_qpolynomial *p_lengths = isl_pw_qpolynomial_from_pw_aff(isl_multi_pw_aff_get_at(p_lengths_mpa, 0));
+    isl_multi_pw_aff_free(p_lengths_mpa);
+    // Every partial sum travelling alone crosses its whole path.
+    exact depth = val_to_exact(isl_pw_qpolynomial_max(isl_pw_qpolynomial_copy(p_lengths)));
+    // Sums over the pairs per partial sum, then over the partial sums.
+    isl_pw_qpolynomial *p_gather = isl_pw_qpolynomial_sum(isl_pw_qpolynomial_sum(p_lengths));
+    exact gather_hops = val_to_exact(
+        isl_pw_qpolynomial_eval(p_gather, isl_point_zero(isl_pw_qpolynomial_get_domain_space(p_gather)))
+    );
+
+    // Merges the paths into trees rooted at the accumulators.
+    isl_pw_qpolynomial *p_tree_costs = dor_mesh_cast_tree_costs(p_trees, dim_order);
+    isl_pw_qpolynomial *sum = isl_pw_qpolynomial_sum(isl_pw_qpolynomial_sum(p_tree_costs));
+    exact tree_links = val_to_exact(
+        isl_pw_qpolynomial_eval(sum, isl_point_zero(isl_pw_qpolynomial_get_domain_space(sum)))
+    );
+
+    return reduction(new reduction_struct{std::move(tree_links), std::move(gather_hops), std::move(depth)});
+}
+
+reduction analyze_reduction(
+    isl_ctx *const p_ctx,
+    const std::string& producers,
+    const std::string& accumulators,
+    const std::string& dist_func,
+    const std::vector<int>& dim_order = {}
+) {
+    // Reads the string representations of the maps into isl objects.
+    return analyze_reduction(
+        isl_map_read_from_str(p_ctx, producers.c_str()),
+        isl_map_read_from_str(p_ctx, accumulators.c_str()),
+        isl_map_read_from_str(p_ctx, dist_func.c_str()),
+        dim_order
+    );
 }
 
 /**
@@ -186,6 +1108,237 @@ long cost_mesh_cast(
     return ret;
 }
 
+/// @brief The slicing used when streaming multicast networks.
+enum class mesh_cast_granularity
+{
+    /// @brief One disjoint [data -> src] basic piece, i.e. whole networks.
+    piece,
+    /// @brief One disjoint basic block of data with every network serving it.
+    datum_block
+};
+
+/// @brief A slice of the multicast networks handed to a stream consumer.
+struct mesh_cast_slice_struct
+{
+    /// @brief The networks in the slice as [data] -> [dst -> src]. Owned by the
+    /// stream; copy it to keep it past the callback.
+    isl_map *const networks;
+    /// @brief The summed tree link count of every network in the slice, as
+    /// cost_dor_mesh_cast.
+    const exact cost;
+};
+
+/// @brief Consumer of streamed multicast networks. Return isl_stat_error to stop.
+typedef isl_stat (*mesh_cast_slice_fn)(const mesh_cast_slice_struct& slice, void *user);
+
+/// @brief Carries the stream state through the ISL foreach callbacks.
+struct mesh_cast_stream_info
+{
+    isl_map *src_occupancy;
+    isl_map *dst_fill;
+    isl_map *dist_func;
+    mesh_cast_granularity granularity;
+    const tie_break_struct& tie_breaker;
+    const std::vector<int>& dim_order;
+    mesh_cast_slice_fn fn;
+    void *user;
+};
+
+/**
+ * Costs one slice and hands it to the consumer. Stops the stream on a failure
+ * such that no exception crosses ISL.
+ *
+ * @param info              The stream state.
+ * @param __isl_take slice  The networks in the slice.
+ */
+isl_stat emit_mesh_cast_slice(const mesh_cast_stream_info& info, __isl_take isl_map *slice)
+{
+    DUMP(slice);
+    isl_stat status = isl_stat_error;
+    try
+    {
+        // Costs the slice on its own; every network in it is complete.
+        exact cost = val_to_exact(cost_dor_mesh_cast_val(isl_map_copy(slice), info.dim_order));
+        mesh_cast_slice_struct piece{slice, std::move(cost)};
+        status = info.fn(piece, info.user);
+    }
+    catch (const std::exception&)
+    {
+        status = isl_stat_error;
+    }
+    isl_map_free(slice);
+
+    return status;
+}
+
+/// @brief Carries one block's networks through the per piece callback.
+struct mesh_cast_block_info
+{
+    const mesh_cast_stream_info& stream;
+    isl_map *networks;
+};
+
+isl_stat mesh_cast_piece_accumulator(isl_basic_set *piece, void *p_block)
+{
+    auto p_info = static_cast<mesh_cast_block_info*>(p_block);
+
+    // Restricts [[data -> src] -> dst] to the piece then restores the form.
+    isl_map *p_rooted = isl_map_uncurry(
+        isl_map_range_reverse(isl_map_copy(p_info->networks))
+    );
+    p_rooted = isl_map_intersect_domain(p_rooted, isl_set_from_basic_set(piece));
+
+    return emit_mesh_cast_slice(p_info->stream, isl_map_range_reverse(isl_map_curry(p_rooted)));
+}
+
+isl_stat mesh_cast_block_accumulator(isl_basic_set *block, void *p_stream)
+{
+    auto p_info = static_cast<mesh_cast_stream_info*>(p_stream);
+    isl_set *p_block = isl_set_from_basic_set(block);
+
+    // Finds the networks of the requests for the data in the block only.
+    isl_map *p_networks;
+    try
+    {
+        p_networks = identify_mesh_casts(
+            isl_map_intersect_range(isl_map_copy(p_info->src_occupancy), isl_set_copy(p_block)),
+            isl_map_intersect_range(isl_map_copy(p_info->dst_fill), p_block),
+            isl_map_copy(p_info->dist_func),
+            p_info->tie_breaker
+        );
+    }
+    catch (const std::exception&)
+    {
+        return isl_stat_error;
+    }
+    if (!p_networks)
+        return isl_stat_error;
+
+    if (p_info->granularity == mesh_cast_granularity::datum_block)
+        return emit_mesh_cast_slice(*p_info, p_networks);
+
+    // Makes the network roots disjoint such that no network is counted twice.
+    isl_set *p_roots = isl_map_domain(isl_map_uncurry(
+        isl_map_range_reverse(isl_map_copy(p_networks))
+    ));
+    p_roots = isl_set_make_disjoint(isl_set_coalesce(p_roots));
+    DUMP(p_roots);
+    mesh_cast_block_info info{*p_info, p_networks};
+    isl_stat status = isl_set_foreach_basic_set(p_roots, mesh_cast_piece_accumulator, &info);
+
+    isl_set_free(p_roots);
+    isl_map_free(p_networks);
+
+    return status;
+}
+
+/**
+ * Streams the multicast networks one slice at a time instead of finding them
+ * all at once.
+ *
+ * The requested data is cut into disjoint basic blocks and the networks of
+ * each block are found on their own, so only one block's requests and networks
+ * are held at a time. The tie breaking policies look at the dst and src only,
+ * so a block's networks match those identify_mesh_casts finds over every
+ * block. The peak memory is that of the largest block; data requested as one
+ * basic set is one block and gains nothing.
+ *
+ * Slices are disjoint and each contains whole networks, so the slice costs
+ * sum to cost_dor_mesh_cast over the same networks.
+ *
+ * @param __isl_keep src_occupancy  The src occupancy, as identify_mesh_casts.
+ * @param __isl_keep dst_fill       The dst fill, as identify_mesh_casts.
+ * @param __isl_keep dist_func      The distance function to pick sources by.
+ * @param granularity               How to slice the networks.
+ * @param fn                        Called once per slice.
+ * @param user                      Passed through to fn.
+ * @param tie_breaker               The policy to pick sources with.
+ * @param dim_order                 The routing order to cost the trees with.
+ *
+ * @return isl_stat_error if fn stopped the stream or a slice could not be
+ *         found or costed, isl_stat_ok otherwise.
+ */
+isl_stat foreach_mesh_cast_network(
+    __isl_keep isl_map *src_occupancy,
+    __isl_keep isl_map *dst_fill,
+    __isl_keep isl_map *dist_func,
+    mesh_cast_granularity granularity,
+    mesh_cast_slice_fn fn,
+    void *user,
+    const tie_break_struct& tie_breaker = {},
+    const std::vector<int>& dim_order = {}
+) {
+    // Makes the requested data disjoint such that no request is served twice.
+    isl_set *p_index = isl_map_range(isl_map_copy(dst_fill));
+    p_index = isl_set_make_disjoint(isl_set_coalesce(p_index));
+    DUMP(p_index);
+
+    mesh_cast_stream_info info{
+        src_occupancy, dst_fill, dist_func, granularity, tie_breaker, dim_order, fn, user
+    };
+    isl_stat status = isl_set_foreach_basic_set(p_index, mesh_cast_block_accumulator, &info);
+
+    isl_set_free(p_index);
+
+    return status;
+}
+
+isl_stat mesh_cast_slice_serializer(const mesh_cast_slice_struct& slice, void *p_slices)
+{
+    auto p_out = static_cast<std::vector<std::string>*>(p_slices);
+    char *s_slice = isl_map_to_str(slice.networks);
+    if (!s_slice)
+        return isl_stat_error;
+    p_out->emplace_back(s_slice);
+    free(s_slice);
+
+    return isl_stat_ok;
+}
+
+/**
+ * Splits the multicast networks into independent slices as ISL strings. As an
+ * isl_ctx is not shareable between threads, this is the hand-off for
+ * processing slices in parallel, each worker reading into its own context.
+ *
+ * @param __isl_keep src_occupancy  The src occupancy, as identify_mesh_casts.
+ * @param __isl_keep dst_fill       The dst fill, as identify_mesh_casts.
+ * @param __isl_keep dist_func      The distance function to pick sources by.
+ * @param granularity               How to slice the networks.
+ * @param tie_breaker               The policy to pick sources with.
+ *
+ * @return The slices as ISL strings.
+ * @throw std::runtime_error if a slice could not be found.
+ */
+std::vector<std::string> partition_mesh_casts(
+    __isl_keep isl_map *src_occupancy,
+    __isl_keep isl_map *dst_fill,
+    __isl_keep isl_map *dist_func,
+    mesh_cast_granularity granularity,
+    const tie_break_struct& tie_breaker = {}
+) {
+    std::vector<std::string> slices;
+    isl_stat status = foreach_mesh_cast_network(
+        src_occupancy, dst_fill, dist_func, granularity, mesh_cast_slice_serializer, &slices, tie_breaker
+    );
+    if (status != isl_stat_ok)
+        throw std::runtime_error("could not partition the multicast networks");
+
+    return slices;
+}
+
+isl_stat mesh_cast_slice_printer(const mesh_cast_slice_struct& slice, void *p_total)
+{
+    std::cout << "slice cost: " << slice.cost->repr << std::endl;
+    // Stops rather than summing a cost that does not fit.
+    if (!slice.cost->fits)
+        return isl_stat_error;
+    *static_cast<long*>(p_total) += slice.cost->value;
+
+    return isl_stat_ok;
+}
+
+// Builds the demo driver unless compiled into the library.
+#ifndef POLYDELIVERY_LIBRARY
 int main(int argc, char* argv[])
 {
     int M_int = 4;
@@ -196,6 +1349,7 @@ int main(int argc, char* argv[])
     clock_t start, end;
     double cpu_time_used;
     isl_ctx *p_ctx = isl_ctx_alloc();
+    MetricCache metrics(p_ctx);
 
     for (int D_int : D_vals) {
         start = clock();
@@ -210,23 +1364,69 @@ int main(int argc, char* argv[])
                                 " and 0 <= yd < "+N+" and 0 <= a < "+M+" and 0 <= b < "+N+" }";
 
         // Defines the distance function string.
-        std::string dist_func_str = R"DIST({
-            [dst[xd, yd] -> src[xs, ys]] -> dist[(xd - xs) + (yd - ys)] : 
-                xd >= xs and yd >= ys;
-            [dst[xd, yd] -> src[xs, ys]] -> dist[-(xd - xs) + -(yd - ys)] : 
-                xd < xs and yd < ys;
-            [dst[xd, yd] -> src[xs, ys]] -> dist[-(xd - xs) + (yd - ys)] : 
-                xd < xs and yd >= ys;
-            [dst[xd, yd] -> src[xs, ys]] -> dist[(xd - xs) + -(yd - ys)] : 
-                xd >= xs and yd < ys
-            })DIST";
+        std::string dist_func_str = metric_str<Manhattan<2>>(metrics, "dst", "src");
     
         auto mcs = identify_mesh_casts(p_ctx, src_occupancy, dst_fill, dist_func_str);
         DUMP(mcs);
         auto res = cost_mesh_cast(p_ctx, isl_map_to_str(mcs), dist_func_str);
         std::cout << res << std::endl;
+
+        // Streams the same networks one piece at a time.
+        long streamed = 0;
+        isl_map *p_src_occupancy = isl_map_read_from_str(p_ctx, src_occupancy.c_str());
+        isl_map *p_dst_fill = isl_map_read_from_str(p_ctx, dst_fill.c_str());
+        isl_map *p_dist_func = isl_map_read_from_str(p_ctx, dist_func_str.c_str());
+        foreach_mesh_cast_network(
+            p_src_occupancy, p_dst_fill, p_dist_func, mesh_cast_granularity::piece,
+            mesh_cast_slice_printer, &streamed
+        );
+        isl_map_free(p_src_occupancy);
+        isl_map_free(p_dst_fill);
+        std::cout << "streamed: " << streamed << std::endl;
+        std::cout << "XY tree links: " << cost_dor_mesh_cast(isl_map_copy(mcs)) << std::endl;
+
+        // Compares the busiest source under every tie breaking policy.
+        std::vector<tie_break_struct> tie_breakers({
+            {tie_break::lowest_index},
+            {tie_break::round_robin, M_int},
+            {tie_break::secondary_metric, 2, "{ [dst[xd, yd] -> src[xs, ys]] -> [ys] }"},
+            {tie_break::parity_extremes}
+        });
+        for (const tie_break_struct& tie_breaker : tie_breakers)
+        {
+            isl_map *p_picked = identify_mesh_casts(p_ctx, src_occupancy, dst_fill, dist_func_str, tie_breaker);
+            long max_load = val_to_long(isl_pw_qpolynomial_max(source_load(p_picked)));
+            std::cout << "max source load: " << max_load << std::endl;
+        }
+
+        // Finds the most loaded link under XY routing.
+        hot_link hottest = hottest_link(link_loads(isl_map_copy(mcs)));
+        std::cout << "hottest link: " << hottest->link << " | load: " << hottest->load << std::endl;
+        hot_link hottest_tree = hottest_link(link_loads(isl_map_copy(mcs), {}, link_load_kind::multicast));
+        std::cout << "hottest tree link: " << hottest_tree->link << " | load: " << hottest_tree->load << std::endl;
+
+        // Serializes the transfers over single datum per cycle links.
+        loaded_latency loaded = analyze_loaded_latency(
+            isl_map_copy(mcs), isl_map_read_from_str(p_ctx, dist_func_str.c_str()), {"1", "1"}
+        );
+        std::cout << "loaded latency: " << loaded->exact_critical_path
+                  << (loaded->tight ? "" : " (upper bound)") << std::endl;
+        isl_map_free(p_dist_func);
         end = clock();
         cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
         // std::cout << "Time: " << cpu_time_used << std::endl;
     }
-}
\ No newline at end of file
+
+    // Reduces every column's partial sums into the accumulator on row 0.
+    std::string producers = "{ prod[x, y] -> psum[o] : o = x and 0 <= x < "+M+" and 0 <= y < "+N+" }";
+    std::string accumulators = "{ acc[x, y] -> psum[o] : o = x and 0 <= x < "+M+" and y = 0 }";
+    reduction reduced = analyze_reduction(
+        p_ctx, producers, accumulators, metric_str<Manhattan<2>>(metrics, "prod", "acc")
+    );
+    std::cout << "reduction tree links: " << reduced->tree_links->repr << " | gather hops: "
+              << reduced->gather_hops->repr << " | depth: " << reduced->depth->repr << std::endl;
+
+    metrics.clear();
+    isl_ctx_free(p_ctx);
+}
+#endif
\ No newline at end of file
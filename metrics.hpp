@@ -0,0 +1,368 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <typeinfo>
+
+// Includes ISL affine list/piecewise functions.
+#include <isl/aff.h>
+// Includes ISL maps/binary relations.
+#include <isl/map.h>
+// Includes ISL local spaces.
+#include <isl/local_space.h>
+#include <isl/space.h>
+// Imports ISL val.
+#include <isl/val.h>
+#include <isl/polynomial.h>
+
+/**
+ * Compile-time distance metrics. Every metric defines, from the same per-dim
+ * terms, both the isl_pw_aff used by the polyhedral engine and a constexpr
+ * native distance for enumerative and sampling checks.
+ *
+ * A metric is a struct with
+ *  - dims:     the number of mesh dims.
+ *  - distance: the native distance between a dst and a src.
+ *  - build:    the isl_pw_aff over a wrapped [dst -> src] local space, where
+ *              dst dim i is at position i and src dim i at position dims + i.
+ */
+
+/// @brief Native |x| usable in constant expressions.
+constexpr long metric_abs(long x)
+{
+    return x < 0 ? -x : x;
+}
+
+/**
+ * Builds |dst - src| along one dim of a [dst -> src] local space.
+ *
+ * @param __isl_keep pair_local The local space of the wrapped [dst -> src].
+ * @param dst_pos               The position of the dst dim.
+ * @param src_pos               The position of the src dim.
+ */
+inline __isl_give isl_pw_aff *abs_diff_on_domain(
+    __isl_keep isl_local_space *pair_local, int dst_pos, int src_pos
+) {
+    isl_pw_aff *p_diff = isl_pw_aff_sub(
+        isl_pw_aff_var_on_domain(isl_local_space_copy(pair_local), isl_dim_set, src_pos),
+        isl_pw_aff_var_on_domain(isl_local_space_copy(pair_local), isl_dim_set, dst_pos)
+    );
+    // ISL has no absolute value, so takes the max of both signs.
+    isl_pw_aff *p_neg_diff = isl_pw_aff_neg(isl_pw_aff_copy(p_diff));
+
+    return isl_pw_aff_max(p_diff, p_neg_diff);
+}
+
+/**
+ * Builds the distance min(|dst - src|, circumference - |dst - src|) around a
+ * ring along one dim of a [dst -> src] local space. Unlike the mod form this
+ * needs no existentials.
+ *
+ * @pre 0 <= dst, src < circumference.
+ *
+ * @param __isl_keep pair_local The local space of the wrapped [dst -> src].
+ * @param dst_pos               The position of the dst dim.
+ * @param src_pos               The position of the src dim.
+ * @param circumference         The number of nodes on the ring.
+ */
+inline __isl_give isl_pw_aff *ring_diff_on_domain(
+    __isl_keep isl_local_space *pair_local, int dst_pos, int src_pos,
+    long circumference
+) {
+    isl_ctx *p_ctx = isl_local_space_get_ctx(pair_local);
+    isl_pw_aff *p_direct = abs_diff_on_domain(pair_local, dst_pos, src_pos);
+    // Goes the other way around the ring.
+    isl_pw_aff *p_wrapped = isl_pw_aff_add_constant_val(
+        isl_pw_aff_neg(isl_pw_aff_copy(p_direct)),
+        isl_val_int_from_si(p_ctx, circumference)
+    );
+
+    return isl_pw_aff_min(p_direct, p_wrapped);
+}
+
+/// @brief The N-dimensional Manhattan distance.
+template <std::size_t N>
+struct Manhattan
+{
+    static constexpr std::size_t dims = N;
+
+    static constexpr long distance(const std::array<long, N>& dst, const std::array<long, N>& src)
+    {
+        long dist = 0;
+        for (std::size_t i = 0; i < N; i++)
+            dist += metric_abs(dst[i] - src[i]);
+        return dist;
+    }
+
+    static __isl_give isl_pw_aff *build(__isl_keep isl_local_space *pair_local)
+    {
+        isl_pw_aff *p_dist = isl_pw_aff_zero_on_domain(isl_local_space_copy(pair_local));
+        for (std::size_t i = 0; i < N; i++)
+            p_dist = isl_pw_aff_add(p_dist, abs_diff_on_domain(pair_local, i, N + i));
+        return p_dist;
+    }
+};
+
+/// @brief The Manhattan distance with a per-hop cost per dim.
+template <long... Weights>
+struct WeightedManhattan
+{
+    static constexpr std::size_t dims = sizeof...(Weights);
+    static constexpr std::array<long, dims> weights = {Weights...};
+
+    static constexpr long distance(const std::array<long, dims>& dst, const std::array<long, dims>& src)
+    {
+        long dist = 0;
+        for (std::size_t i = 0; i < dims; i++)
+            dist += weights[i] * metric_abs(dst[i] - src[i]);
+        return dist;
+    }
+
+    static __isl_give isl_pw_aff *build(__isl_keep isl_local_space *pair_local)
+    {
+        isl_ctx *p_ctx = isl_local_space_get_ctx(pair_local);
+        isl_pw_aff *p_dist = isl_pw_aff_zero_on_domain(isl_local_space_copy(pair_local));
+        for (std::size_t i = 0; i < dims; i++)
+        {
+            p_dist = isl_pw_aff_add(p_dist, isl_pw_aff_scale_val(
+                abs_diff_on_domain(pair_local, i, dims + i),
+                isl_val_int_from_si(p_ctx, weights[i])
+            ));
+        }
+        return p_dist;
+    }
+};
+
+/// @brief The distance on a torus with the given circumference per dim.
+template <long... Circumferences>
+struct Torus
+{
+    static constexpr std::size_t dims = sizeof...(Circumferences);
+    static constexpr std::array<long, dims> circumferences = {Circumferences...};
+
+    static constexpr long distance(const std::array<long, dims>& dst, const std::array<long, dims>& src)
+    {
+        long dist = 0;
+        for (std::size_t i = 0; i < dims; i++)
+        {
+            long direct = metric_abs(dst[i] - src[i]);
+            long wrapped = circumferences[i] - direct;
+            dist += direct < wrapped ? direct : wrapped;
+        }
+        return dist;
+    }
+
+    static __isl_give isl_pw_aff *build(__isl_keep isl_local_space *pair_local)
+    {
+        isl_pw_aff *p_dist = isl_pw_aff_zero_on_domain(isl_local_space_copy(pair_local));
+        for (std::size_t i = 0; i < dims; i++)
+        {
+            p_dist = isl_pw_aff_add(p_dist, ring_diff_on_domain(
+                pair_local, i, dims + i, circumferences[i]
+            ));
+        }
+        return p_dist;
+    }
+};
+
+/// @brief The distance on a ring of the given circumference.
+template <long Circumference>
+using Ring = Torus<Circumference>;
+
+/// @brief Scales every hop of a metric by the same cost.
+template <typename Metric, long Weight>
+struct Weighted
+{
+    static constexpr std::size_t dims = Metric::dims;
+
+    static constexpr long distance(const std::array<long, dims>& dst, const std::array<long, dims>& src)
+    {
+        return Weight * Metric::distance(dst, src);
+    }
+
+    static __isl_give isl_pw_aff *build(__isl_keep isl_local_space *pair_local)
+    {
+        isl_ctx *p_ctx = isl_local_space_get_ctx(pair_local);
+        return isl_pw_aff_scale_val(
+            Metric::build(pair_local), isl_val_int_from_si(p_ctx, Weight)
+        );
+    }
+};
+
+/**
+ * Builds a metric as an isl_pw_aff over [dst[...] -> src[...]].
+ *
+ * @param ctx       The context to build the metric in.
+ * @param dst_tuple The tuple name of the dsts, or "" for none.
+ * @param src_tuple The tuple name of the srcs, or "" for none.
+ */
+template <typename Metric>
+__isl_give isl_pw_aff *build_metric(
+    isl_ctx *ctx, const std::string& dst_tuple = "", const std::string& src_tuple = ""
+) {
+    // Creates the [dst -> src] space the metric is defined on.
+    isl_space *p_dist_space = isl_space_alloc(ctx, 0, Metric::dims, Metric::dims);
+    if (!dst_tuple.empty())
+        p_dist_space = isl_space_set_tuple_name(p_dist_space, isl_dim_in, dst_tuple.c_str());
+    if (!src_tuple.empty())
+        p_dist_space = isl_space_set_tuple_name(p_dist_space, isl_dim_out, src_tuple.c_str());
+    isl_local_space *p_dist_local = isl_local_space_from_space(isl_space_wrap(p_dist_space));
+
+    isl_pw_aff *p_metric = isl_pw_aff_coalesce(Metric::build(p_dist_local));
+    isl_local_space_free(p_dist_local);
+
+    return p_metric;
+}
+
+/**
+ * @brief The metrics built in one context, each built on its first request
+ * per type and tuple names. The caller owns it alongside the context and must
+ * free or clear it before freeing the context. Lookups are locked, so threads
+ * may share it, but the metrics themselves live in its context and, as with
+ * any isl_ctx, must only be used from one thread at a time.
+ */
+class MetricCache
+{
+    private:
+        /// @brief Identifies a built metric: its type and tuple names.
+        typedef std::tuple<std::string, std::string, std::string> metric_key;
+
+        isl_ctx *const ctx;
+        std::map<metric_key, isl_pw_aff*> metrics;
+        std::mutex lock;
+    public:
+        explicit MetricCache(isl_ctx *ctx) : ctx(ctx) {}
+
+        ~MetricCache()
+        {
+            this->clear();
+        }
+
+        MetricCache(const MetricCache&) = delete;
+        MetricCache& operator=(const MetricCache&) = delete;
+
+        /// @brief The context the metrics are built in.
+        isl_ctx *get_ctx() const
+        {
+            return ctx;
+        }
+
+        /**
+         * Grabs a metric, building it on the first request.
+         *
+         * @return __isl_keep The cached metric, valid until the cache is
+         *         cleared; copy it to hand it to an __isl_take.
+         */
+        template <typename Metric>
+        __isl_keep isl_pw_aff *get(const std::string& dst_tuple = "", const std::string& src_tuple = "")
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            metric_key key(typeid(Metric).name(), dst_tuple, src_tuple);
+            auto cached = metrics.find(key);
+            if (cached != metrics.end())
+                return cached->second;
+
+            isl_pw_aff *p_metric = build_metric<Metric>(ctx, dst_tuple, src_tuple);
+            metrics[key] = p_metric;
+
+            return p_metric;
+        }
+
+        /// @brief Frees every metric built so far.
+        void clear()
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            for (auto& [key, p_metric] : metrics)
+                isl_pw_aff_free(p_metric);
+            metrics.clear();
+        }
+};
+
+/**
+ * Grabs the metric as an isl_pw_aff over [dst[...] -> src[...]] from a cache.
+ *
+ * @param metrics   The cache of the context to build the metric in.
+ * @param dst_tuple The tuple name of the dsts, or "" for none.
+ * @param src_tuple The tuple name of the srcs, or "" for none.
+ *
+ * @return __isl_keep The cached metric; copy it to hand it to an __isl_take.
+ */
+template <typename Metric>
+__isl_keep isl_pw_aff *metric_pw_aff(
+    MetricCache& metrics, const std::string& dst_tuple = "", const std::string& src_tuple = ""
+) {
+    return metrics.get<Metric>(dst_tuple, src_tuple);
+}
+
+/// @brief Grabs the metric as the distance map the analyses take.
+template <typename Metric>
+__isl_give isl_map *metric_map(
+    MetricCache& metrics, const std::string& dst_tuple = "", const std::string& src_tuple = ""
+) {
+    return isl_map_from_pw_aff(isl_pw_aff_copy(
+        metric_pw_aff<Metric>(metrics, dst_tuple, src_tuple)
+    ));
+}
+
+/// @brief Grabs the metric as a string for the string based analyses.
+template <typename Metric>
+std::string metric_str(
+    MetricCache& metrics, const std::string& dst_tuple = "", const std::string& src_tuple = ""
+) {
+    char *s_metric = isl_pw_aff_to_str(metric_pw_aff<Metric>(metrics, dst_tuple, src_tuple));
+    std::string ret(s_metric);
+    free(s_metric);
+
+    return ret;
+}
+
+/**
+ * Checks that the ISL and native forms of a metric agree on every [dst, src]
+ * pair of a box, as a guard when adding new metrics.
+ *
+ * @param ctx       The context to build the metric in.
+ * @param extent    The box size along every dim.
+ *
+ * @return Whether both forms agree everywhere.
+ */
+template <typename Metric>
+bool check_metric(isl_ctx *ctx, long extent)
+{
+    constexpr std::size_t N = Metric::dims;
+    isl_pw_qpolynomial *p_metric = isl_pw_qpolynomial_from_pw_aff(build_metric<Metric>(ctx));
+    isl_space *p_space = isl_pw_qpolynomial_get_domain_space(p_metric);
+
+    // Walks every [dst, src] pair as a mixed radix counter.
+    std::array<long, 2 * N> coords{};
+    bool agrees = true;
+    while (agrees)
+    {
+        std::array<long, N> dst{}, src{};
+        isl_point *p_point = isl_point_zero(isl_space_copy(p_space));
+        for (std::size_t i = 0; i < 2 * N; i++)
+        {
+            (i < N ? dst[i] : src[i - N]) = coords[i];
+            p_point = isl_point_set_coordinate_val(
+                p_point, isl_dim_set, i, isl_val_int_from_si(ctx, coords[i])
+            );
+        }
+        isl_val *p_dist = isl_pw_qpolynomial_eval(isl_pw_qpolynomial_copy(p_metric), p_point);
+        agrees = isl_val_get_num_si(p_dist) == Metric::distance(dst, src);
+        isl_val_free(p_dist);
+
+        std::size_t i = 0;
+        while (i < 2 * N && ++coords[i] == extent)
+            coords[i++] = 0;
+        if (i == 2 * N)
+            break;
+    }
+
+    isl_space_free(p_space);
+    isl_pw_qpolynomial_free(p_metric);
+
+    return agrees;
+}
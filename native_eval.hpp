@@ -0,0 +1,606 @@
+#pragma once
+
+#include "latency.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <isl/aff.h>
+#include <isl/constraint.h>
+#include <isl/local_space.h>
+#include <isl/polynomial.h>
+#include <isl/set.h>
+#include <isl/val.h>
+
+/**
+ * Native evaluation of piecewise quasi-polynomials, for cost formulas that are
+ * evaluated over many parameter points rather than once.
+ *
+ * A formula is lowered once into flat tables: per piece, the floor divisions
+ * it needs, the constraints guarding it and its polynomial as a Horner tape.
+ * Points are then evaluated a block at a time, every step running over the
+ * whole block in a simple loop the compiler vectorizes; the guards select the
+ * value of their piece without branching per point.
+ *
+ * Guards and divisions run in longs, so they are exact only while every
+ * affine sum they form at a point, coefficients times coords, fits in a long.
+ * Every polynomial is scaled by the lcm of its coefficient denominators, so its
+ * tape only holds integers, and divided by that lcm once at the end. The tape
+ * runs in doubles, so a value is exact only while every partial Horner sum of
+ * the scaled polynomial stays below 2^53 in magnitude. Neither bound is
+ * checked, so use ISL for points or values near them.
+ *
+ * The tables are interpreted rather than compiled, unlike the counting
+ * kernels of codegen.cpp, so lowering a formula costs no compiler run and
+ * needs no toolchain at run time. Lowering costs far more than one ISL
+ * evaluation, so it pays off for a formula evaluated at many points, not for
+ * the single evaluations of BranchTwig, which stay with ISL.
+ */
+
+/// @brief sum coefficient * column + constant over the columns of a block.
+struct native_affine
+{
+    std::vector<std::pair<int, long>> terms;
+    long constant;
+};
+
+/// @brief A column holding floor(numerator / denominator).
+struct native_div
+{
+    native_affine numerator;
+    long denominator;
+};
+
+/// @brief One guard: expr == 0 or expr >= 0.
+struct native_constraint
+{
+    native_affine expr;
+    bool equality;
+};
+
+/// @brief The instructions of a Horner tape, run on a stack of blocks.
+enum class native_op
+{
+    /// @brief Pushes a constant block.
+    push,
+    /// @brief Multiplies the top of the stack by a column.
+    mul_var,
+    /// @brief Pops the top and adds it to the new top.
+    add
+};
+
+struct native_instr
+{
+    native_op op;
+    int column;
+    double constant;
+};
+
+/// @brief One piece of the formula.
+struct native_piece
+{
+    /// @brief The divisions, appended as columns after the point coords in order.
+    std::vector<native_div> divs;
+    /// @brief The guard as a union of conjunctions of constraints.
+    std::vector<std::vector<native_constraint>> guard;
+    /// @brief The polynomial in Horner form, times scale.
+    std::vector<native_instr> tape;
+    /// @brief The stack depth the tape needs.
+    int depth;
+    /// @brief The lcm of the coefficient denominators, divided out at the end.
+    double scale;
+};
+
+/// @brief One term of a polynomial over the columns.
+struct native_term
+{
+    /// @brief The coefficient times the scale of the piece, an integer.
+    double coefficient;
+    std::vector<int> exponents;
+};
+
+/**
+ * Emits the Horner form of a polynomial, nesting over the columns from first
+ * to last, e.g. 3x^2y + x + 2 as (3y * x + 1) * x + 2.
+ *
+ * @param terms     The terms, all with the same exponent on the columns before column.
+ * @param column    The column to factor out next.
+ * @param tape      Receives the instructions.
+ *
+ * @return The stack depth the emitted instructions need.
+ */
+inline int emit_horner(const std::vector<native_term>& terms, std::size_t column, std::vector<native_instr>& tape)
+{
+    const std::size_t n_columns = terms.empty() ? 0 : terms[0].exponents.size();
+    // Skips the columns no term has a power of.
+    int degree = 0;
+    for (; column < n_columns; column++)
+    {
+        for (const native_term& term : terms)
+            degree = std::max(degree, term.exponents[column]);
+        if (degree > 0)
+            break;
+    }
+    if (degree == 0)
+    {
+        double constant = 0;
+        for (const native_term& term : terms)
+            constant += term.coefficient;
+        tape.push_back(native_instr{native_op::push, 0, constant});
+        return 1;
+    }
+
+    // Groups the terms by their power of the column.
+    std::vector<std::vector<native_term>> by_power(degree + 1);
+    for (const native_term& term : terms)
+        by_power[term.exponents[column]].push_back(term);
+
+    int depth = emit_horner(by_power[degree], column + 1, tape);
+    for (int k = degree - 1; k >= 0; k--)
+    {
+        tape.push_back(native_instr{native_op::mul_var, (int) column, 0});
+        if (!by_power[k].empty())
+        {
+            depth = std::max(depth, 1 + emit_horner(by_power[k], column + 1, tape));
+            tape.push_back(native_instr{native_op::add, 0, 0});
+        }
+    }
+
+    return depth;
+}
+
+inline isl_stat collect_piece(isl_set *set, isl_qpolynomial *qp, void *p_pieces)
+{
+    static_cast<std::vector<std::pair<isl_set*, isl_qpolynomial*>>*>(p_pieces)->emplace_back(set, qp);
+    return isl_stat_ok;
+}
+
+inline isl_stat collect_basic_set(isl_basic_set *bset, void *p_conjuncts)
+{
+    static_cast<std::vector<isl_basic_set*>*>(p_conjuncts)->push_back(bset);
+    return isl_stat_ok;
+}
+
+inline isl_stat collect_constraint(isl_constraint *c, void *p_constraints)
+{
+    static_cast<std::vector<isl_constraint*>*>(p_constraints)->push_back(c);
+    return isl_stat_ok;
+}
+
+inline isl_stat collect_term(isl_term *term, void *p_terms)
+{
+    static_cast<std::vector<isl_term*>*>(p_terms)->push_back(term);
+    return isl_stat_ok;
+}
+
+class NativeEvaluator
+{
+    private:
+        /// @brief The points evaluated per pass over the tables.
+        static constexpr std::size_t block = 256;
+
+        int n_param;
+        int n_dims;
+        int n_columns;
+        std::vector<native_piece> pieces;
+
+        /**
+         * Reads an affine expression of ISL into columns, scaled to integer
+         * coefficients by scale.
+         *
+         * @param __isl_keep aff    The expression.
+         * @param scale             The common denominator of its coefficients.
+         * @param div_base          The column of its first div.
+         */
+        native_affine read_affine(isl_aff *aff, isl_val *scale, int div_base) const
+        {
+            native_affine expr{{}, 0};
+            auto scaled = [&](isl_val *v) { return val_to_long(isl_val_mul(v, isl_val_copy(scale))); };
+            for (int i = 0; i < n_param; i++)
+            {
+                long c = scaled(isl_aff_get_coefficient_val(aff, isl_dim_param, i));
+                if (c)
+                    expr.terms.emplace_back(i, c);
+            }
+            for (int i = 0; i < n_dims - n_param; i++)
+            {
+                long c = scaled(isl_aff_get_coefficient_val(aff, isl_dim_in, i));
+                if (c)
+                    expr.terms.emplace_back(n_param + i, c);
+            }
+            for (int i = 0; i < isl_aff_dim(aff, isl_dim_div); i++)
+            {
+                long c = scaled(isl_aff_get_coefficient_val(aff, isl_dim_div, i));
+                if (c)
+                    expr.terms.emplace_back(div_base + i, c);
+            }
+            expr.constant = scaled(isl_aff_get_constant_val(aff));
+
+            return expr;
+        }
+
+        /**
+         * Appends a floor division of ISL to a piece.
+         *
+         * @param __isl_take div    The expression floored, e.g. from isl_local_space_get_div.
+         * @param div_base          The column of the first div it may refer to.
+         * @param piece             The piece to append to.
+         */
+        void add_div(isl_aff *div, int div_base, native_piece& piece) const
+        {
+            if (!div || isl_aff_is_nan(div) == isl_bool_true)
+            {
+                isl_aff_free(div);
+                throw std::invalid_argument("formula has an existential without an explicit division");
+            }
+            // Frees the ISL objects whether or not a coefficient fits.
+            std::unique_ptr<isl_aff, isl_aff *(*)(isl_aff *)> p_div(div, isl_aff_free);
+            std::unique_ptr<isl_val, isl_val *(*)(isl_val *)> p_denominator(
+                isl_aff_get_denominator_val(div), isl_val_free
+            );
+            native_affine numerator = read_affine(div, p_denominator.get(), div_base);
+            long denominator = val_to_long(isl_val_copy(p_denominator.get()));
+            piece.divs.push_back(native_div{numerator, denominator});
+        }
+
+        /// @brief Lowers one conjunction of the domain of a piece.
+        void add_conjunct(isl_basic_set *bset, native_piece& piece) const
+        {
+            // Gives the local divs of the conjunction their own columns.
+            const int div_base = n_dims + piece.divs.size();
+            // Collects the constraints first, so no exception crosses ISL.
+            std::vector<isl_constraint*> constraints;
+            isl_basic_set_foreach_constraint(bset, collect_constraint, &constraints);
+            isl_local_space *p_local = isl_basic_set_get_local_space(bset);
+            isl_basic_set_free(bset);
+
+            std::vector<native_constraint> conjunction;
+            try
+            {
+                for (int i = 0; i < isl_local_space_dim(p_local, isl_dim_div); i++)
+                    add_div(isl_local_space_get_div(p_local, i), div_base, piece);
+                for (isl_constraint *c : constraints)
+                {
+                    native_constraint constraint{{{}, 0}, isl_constraint_is_equality(c) == isl_bool_true};
+                    auto add_terms = [&](isl_dim_type type, int n, int first_column) {
+                        for (int i = 0; i < n; i++)
+                        {
+                            long coefficient = val_to_long(isl_constraint_get_coefficient_val(c, type, i));
+                            if (coefficient)
+                                constraint.expr.terms.emplace_back(first_column + i, coefficient);
+                        }
+                    };
+                    add_terms(isl_dim_param, n_param, 0);
+                    add_terms(isl_dim_set, n_dims - n_param, n_param);
+                    add_terms(isl_dim_div, isl_constraint_dim(c, isl_dim_div), div_base);
+                    constraint.expr.constant = val_to_long(isl_constraint_get_constant_val(c));
+                    conjunction.push_back(constraint);
+                }
+            }
+            catch (...)
+            {
+                for (isl_constraint *c : constraints)
+                    isl_constraint_free(c);
+                isl_local_space_free(p_local);
+                throw;
+            }
+            for (isl_constraint *c : constraints)
+                isl_constraint_free(c);
+            isl_local_space_free(p_local);
+
+            piece.guard.push_back(std::move(conjunction));
+        }
+
+        /// @brief Lowers the polynomial of a piece into a Horner tape.
+        void add_polynomial(isl_qpolynomial *qp, native_piece& piece) const
+        {
+            // Collects the terms first, so no exception crosses ISL.
+            std::vector<isl_term*> terms;
+            isl_qpolynomial_foreach_term(qp, collect_term, &terms);
+            // Makes the lcm of the coefficient denominators, e.g. 6 for M^3/3 + M/6.
+            std::unique_ptr<isl_val, isl_val *(*)(isl_val *)> p_scale(
+                isl_val_one(isl_qpolynomial_get_ctx(qp)), isl_val_free
+            );
+            isl_qpolynomial_free(qp);
+            for (isl_term *term : terms)
+            {
+                isl_val *p_coefficient = isl_term_get_coefficient_val(term);
+                isl_val *p_den = isl_val_get_den_val(p_coefficient);
+                isl_val_free(p_coefficient);
+                isl_val *p_gcd = isl_val_gcd(isl_val_copy(p_scale.get()), isl_val_copy(p_den));
+                p_scale.reset(isl_val_div(isl_val_mul(p_scale.release(), p_den), p_gcd));
+            }
+
+            std::vector<native_term> native_terms;
+            const int div_base = n_dims + piece.divs.size();
+            try
+            {
+                piece.scale = val_to_long(isl_val_copy(p_scale.get()));
+                // Every term shares the divs of the polynomial; reads them once.
+                const int n_div = terms.empty() ? 0 : isl_term_dim(terms[0], isl_dim_div);
+                for (int i = 0; i < n_div; i++)
+                    add_div(isl_term_get_div(terms[0], i), div_base, piece);
+                for (isl_term *term : terms)
+                {
+                    native_term t{0, std::vector<int>(div_base + n_div, 0)};
+                    // Scales the coefficient to an integer.
+                    t.coefficient = val_to_long(isl_val_mul(
+                        isl_term_get_coefficient_val(term), isl_val_copy(p_scale.get())
+                    ));
+                    for (int i = 0; i < n_param; i++)
+                        t.exponents[i] = isl_term_get_exp(term, isl_dim_param, i);
+                    for (int i = 0; i < n_dims - n_param; i++)
+                        t.exponents[n_param + i] = isl_term_get_exp(term, isl_dim_set, i);
+                    for (int i = 0; i < n_div; i++)
+                        t.exponents[div_base + i] = isl_term_get_exp(term, isl_dim_div, i);
+                    native_terms.push_back(std::move(t));
+                }
+            }
+            catch (...)
+            {
+                for (isl_term *term : terms)
+                    isl_term_free(term);
+                throw;
+            }
+            for (isl_term *term : terms)
+                isl_term_free(term);
+
+            // Divs of the domain come first, so every term covers every column.
+            for (native_term& t : native_terms)
+                t.exponents.resize(n_dims + piece.divs.size(), 0);
+            if (native_terms.empty())
+                native_terms.push_back(native_term{0, std::vector<int>(n_dims + piece.divs.size(), 0)});
+            piece.depth = emit_horner(native_terms, 0, piece.tape);
+        }
+
+        /// @brief The scratch blocks of an evaluation, allocated once per call.
+        struct workspace
+        {
+            /// @brief The coords, then the divs, one block per column.
+            std::vector<std::vector<long>> columns;
+            /// @brief The columns as doubles for the polynomials.
+            std::vector<std::vector<double>> real;
+            /// @brief The stack of the Horner tapes.
+            std::vector<std::vector<double>> stack;
+            std::vector<long> acc, mask, conjunct;
+        };
+
+        /// @brief Evaluates up to block points, stored in the coord columns.
+        void evaluate_block(workspace& w, std::size_t n, double *values) const
+        {
+            std::vector<std::vector<long>>& columns = w.columns;
+            std::vector<std::vector<double>>& real = w.real;
+            std::vector<std::vector<double>>& stack = w.stack;
+            std::vector<long>& acc = w.acc;
+            std::vector<long>& mask = w.mask;
+            std::vector<long>& conjunct = w.conjunct;
+            std::fill(values, values + n, 0.0);
+
+            for (const native_piece& piece : pieces)
+            {
+                // Fills in the div columns, in order as later divs may use earlier ones.
+                for (std::size_t d = 0; d < piece.divs.size(); d++)
+                {
+                    const native_div& div = piece.divs[d];
+                    long *const out = columns[n_dims + d].data();
+                    std::fill(acc.begin(), acc.begin() + n, div.numerator.constant);
+                    for (const auto& [column, coefficient] : div.numerator.terms)
+                    {
+                        const long *const in = columns[column].data();
+                        for (std::size_t b = 0; b < n; b++)
+                            acc[b] += coefficient * in[b];
+                    }
+                    // Floors towards negative infinity without branching.
+                    const long den = div.denominator;
+                    for (std::size_t b = 0; b < n; b++)
+                        out[b] = (acc[b] - ((acc[b] % den + den) % den)) / den;
+                }
+
+                // Evaluates the guard as an or of ands of comparisons.
+                std::fill(mask.begin(), mask.begin() + n, 0);
+                for (const std::vector<native_constraint>& constraints : piece.guard)
+                {
+                    std::fill(conjunct.begin(), conjunct.begin() + n, 1);
+                    for (const native_constraint& constraint : constraints)
+                    {
+                        std::fill(acc.begin(), acc.begin() + n, constraint.expr.constant);
+                        for (const auto& [column, coefficient] : constraint.expr.terms)
+                        {
+                            const long *const in = columns[column].data();
+                            for (std::size_t b = 0; b < n; b++)
+                                acc[b] += coefficient * in[b];
+                        }
+                        if (constraint.equality)
+                            for (std::size_t b = 0; b < n; b++)
+                                conjunct[b] &= acc[b] == 0;
+                        else
+                            for (std::size_t b = 0; b < n; b++)
+                                conjunct[b] &= acc[b] >= 0;
+                    }
+                    for (std::size_t b = 0; b < n; b++)
+                        mask[b] |= conjunct[b];
+                }
+                // Skips the polynomial if the block misses the piece altogether.
+                long any = 0;
+                for (std::size_t b = 0; b < n; b++)
+                    any |= mask[b];
+                if (!any)
+                    continue;
+
+                // Runs the Horner tape.
+                for (std::size_t c = 0; c < (std::size_t) n_columns; c++)
+                    for (std::size_t b = 0; b < n; b++)
+                        real[c][b] = columns[c][b];
+                int top = -1;
+                for (const native_instr& instr : piece.tape)
+                {
+                    switch (instr.op)
+                    {
+                        case native_op::push:
+                        {
+                            double *const s = stack[++top].data();
+                            for (std::size_t b = 0; b < n; b++)
+                                s[b] = instr.constant;
+                            break;
+                        }
+                        case native_op::mul_var:
+                        {
+                            double *const s = stack[top].data();
+                            const double *const x = real[instr.column].data();
+                            for (std::size_t b = 0; b < n; b++)
+                                s[b] *= x[b];
+                            break;
+                        }
+                        case native_op::add:
+                        {
+                            double *const s = stack[top - 1].data();
+                            const double *const t = stack[top].data();
+                            for (std::size_t b = 0; b < n; b++)
+                                s[b] += t[b];
+                            top--;
+                            break;
+                        }
+                    }
+                }
+
+                // Selects the value wherever the guard holds, dividing the scale out.
+                const double *const value = stack[0].data();
+                const double scale = piece.scale;
+                for (std::size_t b = 0; b < n; b++)
+                    values[b] = mask[b] ? value[b] / scale : values[b];
+            }
+        }
+    public:
+        /**
+         * Lowers a formula. Points give the params then the set dims of its
+         * domain.
+         *
+         * @param __isl_keep pwqp   The formula.
+         *
+         * @throw std::invalid_argument if a piece has an existential ISL
+         *        cannot express as a division.
+         * @throw std::overflow_error if a coefficient, scaled to an integer,
+         *        does not fit in a long.
+         */
+        explicit NativeEvaluator(isl_pw_qpolynomial *pwqp)
+        {
+            n_param = isl_pw_qpolynomial_dim(pwqp, isl_dim_param);
+            n_dims = n_param + isl_pw_qpolynomial_dim(pwqp, isl_dim_in);
+
+            // Collects the pieces first, so no exception crosses ISL.
+            std::vector<std::pair<isl_set*, isl_qpolynomial*>> isl_pieces;
+            isl_pw_qpolynomial_foreach_piece(pwqp, collect_piece, &isl_pieces);
+            std::size_t p = 0;
+            try
+            {
+                for (; p < isl_pieces.size(); p++)
+                {
+                    native_piece piece{{}, {}, {}, 0, 1};
+                    // Makes every existential of the domain an explicit division.
+                    isl_set *p_domain = isl_set_compute_divs(isl_pieces[p].first);
+                    std::vector<isl_basic_set*> conjuncts;
+                    isl_set_foreach_basic_set(p_domain, collect_basic_set, &conjuncts);
+                    isl_set_free(p_domain);
+                    for (std::size_t c = 0; c < conjuncts.size(); c++)
+                    {
+                        try
+                        {
+                            add_conjunct(conjuncts[c], piece);
+                        }
+                        catch (...)
+                        {
+                            for (c++; c < conjuncts.size(); c++)
+                                isl_basic_set_free(conjuncts[c]);
+                            throw;
+                        }
+                    }
+                    isl_qpolynomial *p_qp = isl_pieces[p].second;
+                    isl_pieces[p].second = nullptr;
+                    add_polynomial(p_qp, piece);
+                    pieces.push_back(std::move(piece));
+                }
+            }
+            catch (...)
+            {
+                isl_qpolynomial_free(isl_pieces[p].second);
+                for (p++; p < isl_pieces.size(); p++)
+                {
+                    isl_set_free(isl_pieces[p].first);
+                    isl_qpolynomial_free(isl_pieces[p].second);
+                }
+                throw;
+            }
+
+            n_columns = n_dims;
+            for (const native_piece& piece : pieces)
+                n_columns = std::max<int>(n_columns, n_dims + piece.divs.size());
+        }
+
+        /// @brief Lowers an affine formula through its quasi-polynomial.
+        explicit NativeEvaluator(isl_pw_aff *pwaff):
+        NativeEvaluator(std::unique_ptr<isl_pw_qpolynomial, isl_pw_qpolynomial *(*)(isl_pw_qpolynomial *)>(
+            isl_pw_qpolynomial_from_pw_aff(isl_pw_aff_copy(pwaff)), isl_pw_qpolynomial_free
+        ).get()) {}
+
+        /// @brief The coords per point: the params, then the set dims.
+        int dims() const
+        {
+            return n_dims;
+        }
+
+        /// @brief The number of pieces lowered.
+        std::size_t size() const
+        {
+            return pieces.size();
+        }
+
+        /**
+         * Evaluates the formula at many points, 0 outside its domain.
+         *
+         * @param points    The coords of every point, one point after another.
+         * @param n_points  The number of points.
+         * @param values    Receives the value at every point.
+         */
+        void evaluate(const long *points, std::size_t n_points, double *values) const
+        {
+            int depth = 1;
+            for (const native_piece& piece : pieces)
+                depth = std::max(depth, piece.depth);
+            workspace w{
+                std::vector<std::vector<long>>(n_columns, std::vector<long>(block)),
+                std::vector<std::vector<double>>(n_columns, std::vector<double>(block)),
+                std::vector<std::vector<double>>(depth, std::vector<double>(block)),
+                std::vector<long>(block), std::vector<long>(block), std::vector<long>(block)
+            };
+            for (std::size_t start = 0; start < n_points; start += block)
+            {
+                const std::size_t n = std::min(block, n_points - start);
+                // Transposes the block into one column per coord.
+                for (int c = 0; c < n_dims; c++)
+                    for (std::size_t b = 0; b < n; b++)
+                        w.columns[c][b] = points[(start + b) * n_dims + c];
+                evaluate_block(w, n, values + start);
+            }
+        }
+
+        /**
+         * Evaluates the formula at one point.
+         *
+         * @param point The params, then the set dims.
+         * @throw std::invalid_argument if the point does not have dims() coords.
+         */
+        double operator()(const std::vector<long>& point) const
+        {
+            if (point.size() != (std::size_t) n_dims)
+                throw std::invalid_argument("point has " + std::to_string(point.size())
+                                            + " coords, the formula takes " + std::to_string(n_dims));
+            double value;
+            evaluate(point.data(), 1, &value);
+            return value;
+        }
+};
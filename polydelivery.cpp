@@ -0,0 +1,338 @@
+/**
+ * Python extension exposing the delivery analyses without a subprocess per
+ * query. Every call takes a batch of jobs as tuples of ISL strings, solves
+ * them on worker threads with the GIL released, and returns NumPy arrays.
+ *
+ * Build:
+ *  c++ -O3 -std=c++17 -shared -fPIC $(python3-config --includes) \
+ *      -I$(python3 -c "import numpy; print(numpy.get_include())") \
+ *      polydelivery.cpp -o polydelivery$(python3-config --extension-suffix) \
+ *      -lbarvinok -lisl -lpolylibgmp -lntl -lgmp -lpthread
+ *
+ * Usage:
+ *  values, ok = polydelivery.analyze_latency([(srcs, dsts, dist), ...], threads=8)
+ */
+// Compiles the drivers below without their demo mains.
+#define POLYDELIVERY_LIBRARY
+// Python.h must come before any standard header.
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+
+#include "jobs.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// @brief The result of one batch, filled in without holding the GIL.
+struct batch_struct
+{
+    /// @brief The solved value per job, 0 where the job failed.
+    std::vector<long> values;
+    /// @brief Whether ISL solved the job without error and it fits in 64 bits.
+    std::vector<unsigned char> ok;
+    /// @brief The exact value per job, or the reason it failed.
+    std::vector<std::string> reprs;
+    /// @brief The counts the solve time is predicted from per job.
+    std::vector<job_features_struct> features;
+    /// @brief The predicted solve time per job in seconds.
+    std::vector<double> predicted;
+    /// @brief The actual solve time per job in seconds.
+    std::vector<double> seconds;
+};
+
+/**
+ * Solves every job on a pool of threads, each pulling the longest predicted
+ * job left, so a few heavy jobs start early instead of straggling at the end.
+ * Touches no Python objects, so it runs with the GIL released.
+ *
+ * @param kind      The kind of the jobs.
+ * @param jobs      The ISL strings per job.
+ * @param n_threads The number of threads, or 0 for one per core.
+ * @param model     The cost model to predict the solve times with.
+ */
+batch_struct solve_batch(
+    const job_kind_struct& kind, const std::vector<std::vector<std::string>>& jobs, unsigned n_threads,
+    const cost_model_struct& model
+) {
+    batch_struct batch{
+        std::vector<long>(jobs.size(), 0), std::vector<unsigned char>(jobs.size(), 0),
+        std::vector<std::string>(jobs.size()), std::vector<job_features_struct>(jobs.size()),
+        std::vector<double>(jobs.size(), 0), std::vector<double>(jobs.size(), 0)
+    };
+    if (n_threads == 0)
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    n_threads = std::min<std::size_t>(n_threads, std::max<std::size_t>(jobs.size(), 1));
+
+    // Runs fn(0), ..., fn(n - 1) on the pool.
+    auto run_pool = [&](const std::function<void(std::size_t)>& fn) {
+        std::atomic<std::size_t> next(0);
+        auto worker = [&]() {
+            for (std::size_t n = next++; n < jobs.size(); n = next++)
+                fn(n);
+        };
+        std::vector<std::thread> pool;
+        for (unsigned t = 1; t < n_threads; t++)
+            pool.emplace_back(worker);
+        worker();
+        for (std::thread& thread : pool)
+            thread.join();
+    };
+
+    // Measures on the pool too, so the reads run in parallel like the solves.
+    run_pool([&](std::size_t i) {
+        batch.features[i] = measure_job(jobs[i], kind.metric_arg);
+        batch.predicted[i] = predict_seconds(model, batch.features[i]);
+    });
+    const std::vector<std::size_t> order = longest_first(batch.predicted);
+
+    run_pool([&](std::size_t n) {
+        const std::size_t i = order[n];
+        auto start = std::chrono::steady_clock::now();
+        batch.ok[i] = solve_job(kind.solve, jobs[i], batch.values[i], batch.reprs[i]);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        batch.seconds[i] = elapsed.count();
+    });
+
+    return batch;
+}
+
+/**
+ * Copies a sequence of tuples of str into plain strings, so the batch can run
+ * without the GIL.
+ *
+ * @param p_jobs    The sequence of jobs.
+ * @param arity     The number of strings per job.
+ * @param jobs      Filled with the strings per job.
+ *
+ * @return Whether the jobs were well formed; sets a Python error otherwise.
+ */
+bool unpack_jobs(PyObject *p_jobs, std::size_t arity, std::vector<std::vector<std::string>>& jobs)
+{
+    PyObject *p_seq = PySequence_Fast(p_jobs, "jobs must be a sequence");
+    if (!p_seq)
+        return false;
+
+    Py_ssize_t n_jobs = PySequence_Fast_GET_SIZE(p_seq);
+    jobs.reserve(n_jobs);
+    for (Py_ssize_t i = 0; i < n_jobs; i++)
+    {
+        PyObject *p_job = PySequence_Fast_GET_ITEM(p_seq, i);
+        if (!PyTuple_Check(p_job) || PyTuple_GET_SIZE(p_job) != (Py_ssize_t) arity)
+        {
+            PyErr_Format(PyExc_TypeError, "job %zd must be a tuple of %zu str", i, arity);
+            Py_DECREF(p_seq);
+            return false;
+        }
+        std::vector<std::string> args;
+        for (std::size_t a = 0; a < arity; a++)
+        {
+            Py_ssize_t len;
+            const char *s_arg = PyUnicode_AsUTF8AndSize(PyTuple_GET_ITEM(p_job, a), &len);
+            if (!s_arg)
+            {
+                Py_DECREF(p_seq);
+                return false;
+            }
+            args.emplace_back(s_arg, len);
+        }
+        jobs.push_back(std::move(args));
+    }
+    Py_DECREF(p_seq);
+
+    return true;
+}
+
+/**
+ * Parses (jobs, threads=0, exact=False, log=None), solves the batch with the
+ * GIL released, and returns (values, ok) as int64 and bool arrays. A job that
+ * does not fit in 64 bits is not ok; with exact=True a third list holds the
+ * exact value of every job as a str, or why it failed. With a log path, the
+ * cost model is refit to the times logged there and the predicted and actual
+ * time of every job appended. A failure of the batch as a whole, such as a
+ * thread that could not start or an unwritable log, raises RuntimeError, or
+ * MemoryError when out of memory.
+ */
+PyObject *run_batch(const char *kind_name, PyObject *args, PyObject *kwargs)
+{
+    static const char *keywords[] = {"jobs", "threads", "exact", "log", nullptr};
+    PyObject *p_jobs;
+    unsigned int n_threads = 0;
+    int want_exact = 0;
+    const char *s_log = nullptr;
+    if (!PyArg_ParseTupleAndKeywords(
+        args, kwargs, "O|Ipz", const_cast<char**>(keywords), &p_jobs, &n_threads, &want_exact, &s_log
+    ))
+        return nullptr;
+
+    const job_kind_struct& kind = *find_job_kind(kind_name);
+    std::vector<std::vector<std::string>> jobs;
+    if (!unpack_jobs(p_jobs, kind.arity, jobs))
+        return nullptr;
+
+    // Nothing may be thrown past the block, which must restore the GIL first.
+    batch_struct batch;
+    bool out_of_memory = false;
+    std::string failure;
+    Py_BEGIN_ALLOW_THREADS
+    try
+    {
+        cost_model_struct model = s_log ? fit_cost_model(read_timings(s_log)) : cost_model_struct();
+        batch = solve_batch(kind, jobs, n_threads, model);
+        if (s_log)
+        {
+            std::vector<timing_struct> timings;
+            for (std::size_t i = 0; i < jobs.size(); i++)
+            {
+                timings.push_back(timing_struct{
+                    kind.name, batch.features[i], batch.predicted[i], batch.seconds[i]
+                });
+            }
+            append_timings(s_log, timings);
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        out_of_memory = true;
+    }
+    catch (const std::exception& e)
+    {
+        failure = e.what();
+        if (failure.empty())
+            failure = "the batch failed";
+    }
+    Py_END_ALLOW_THREADS
+    if (out_of_memory)
+        return PyErr_NoMemory();
+    if (!failure.empty())
+    {
+        PyErr_SetString(PyExc_RuntimeError, failure.c_str());
+        return nullptr;
+    }
+
+    // Hands the results over as flat arrays rather than per-element objects.
+    npy_intp n_jobs = jobs.size();
+    PyObject *p_values = PyArray_SimpleNew(1, &n_jobs, NPY_INT64);
+    PyObject *p_ok = PyArray_SimpleNew(1, &n_jobs, NPY_BOOL);
+    if (!p_values || !p_ok)
+    {
+        Py_XDECREF(p_values);
+        Py_XDECREF(p_ok);
+        return nullptr;
+    }
+    npy_int64 *values = (npy_int64*) PyArray_DATA((PyArrayObject*) p_values);
+    std::copy(batch.values.begin(), batch.values.end(), values);
+    std::memcpy(PyArray_DATA((PyArrayObject*) p_ok), batch.ok.data(), batch.ok.size());
+    if (!want_exact)
+        return Py_BuildValue("(NN)", p_values, p_ok);
+
+    PyObject *p_reprs = PyList_New(n_jobs);
+    if (!p_reprs)
+    {
+        Py_DECREF(p_values);
+        Py_DECREF(p_ok);
+        return nullptr;
+    }
+    for (npy_intp i = 0; i < n_jobs; i++)
+        PyList_SET_ITEM(p_reprs, i, PyUnicode_FromString(batch.reprs[i].c_str()));
+
+    return Py_BuildValue("(NNN)", p_values, p_ok, p_reprs);
+}
+
+PyObject *py_analyze_jumps(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    return run_batch("jumps", args, kwargs);
+}
+
+PyObject *py_analyze_latency(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    return run_batch("latency", args, kwargs);
+}
+
+PyObject *py_cost_mesh_cast(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    return run_batch("mesh_cast", args, kwargs);
+}
+
+PyObject *py_twig_cost(PyObject *self, PyObject *args, PyObject *kwargs)
+{
+    return run_batch("twig", args, kwargs);
+}
+
+/**
+ * Returns the multicast networks of one (srcs, dsts, dist) job as an ISL
+ * string, for inspection rather than bulk use.
+ */
+PyObject *py_identify_mesh_casts(PyObject *self, PyObject *args)
+{
+    const char *s_srcs, *s_dsts, *s_dist;
+    if (!PyArg_ParseTuple(args, "sss", &s_srcs, &s_dsts, &s_dist))
+        return nullptr;
+    std::vector<std::string> job({s_srcs, s_dsts, s_dist});
+
+    std::string networks;
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    isl_ctx *p_ctx = isl_ctx_alloc();
+    isl_options_set_on_error(p_ctx, ISL_ON_ERROR_CONTINUE);
+    std::vector<isl_map*> maps;
+    if (read_maps(p_ctx, job, maps))
+    {
+        isl_map *p_networks = identify_mesh_casts(maps[0], maps[1], maps[2]);
+        char *s_networks = isl_map_to_str(p_networks);
+        if (s_networks)
+            networks = s_networks;
+        free(s_networks);
+        isl_map_free(p_networks);
+    }
+    ok = isl_ctx_last_error(p_ctx) == isl_error_none;
+    isl_ctx_free(p_ctx);
+    Py_END_ALLOW_THREADS
+
+    if (!ok)
+    {
+        PyErr_SetString(PyExc_ValueError, "ISL failed to identify the multicast networks");
+        return nullptr;
+    }
+    return PyUnicode_FromString(networks.c_str());
+}
+
+PyMethodDef polydelivery_methods[] = {
+    {"analyze_jumps", (PyCFunction)(void(*)(void)) py_analyze_jumps, METH_VARARGS | METH_KEYWORDS,
+     "analyze_jumps(jobs, threads=0, exact=False, log=None) -> (values, ok[, reprs])\n"
+     "Total hops per (srcs, dsts, dist) job."},
+    {"analyze_latency", (PyCFunction)(void(*)(void)) py_analyze_latency, METH_VARARGS | METH_KEYWORDS,
+     "analyze_latency(jobs, threads=0, exact=False, log=None) -> (values, ok[, reprs])\n"
+     "Max of the min distances per (srcs, dsts, dist) job."},
+    {"cost_mesh_cast", (PyCFunction)(void(*)(void)) py_cost_mesh_cast, METH_VARARGS | METH_KEYWORDS,
+     "cost_mesh_cast(jobs, threads=0, exact=False, log=None) -> (values, ok[, reprs])\n"
+     "Multicast cost per (srcs, dsts, dist) job."},
+    {"twig_cost", (PyCFunction)(void(*)(void)) py_twig_cost, METH_VARARGS | METH_KEYWORDS,
+     "twig_cost(jobs, threads=0, exact=False, log=None) -> (values, ok[, reprs])\n"
+     "BranchTwig cost per (crease_costs, fold_formula, multicast_costs, dsts) job."},
+    {"identify_mesh_casts", py_identify_mesh_casts, METH_VARARGS,
+     "identify_mesh_casts(srcs, dsts, dist) -> str\n"
+     "The multicast networks of one job."},
+    {nullptr, nullptr, 0, nullptr}
+};
+
+PyModuleDef polydelivery_module = {
+    PyModuleDef_HEAD_INIT, "polydelivery",
+    "Polyhedral data delivery analyses, batched and GIL free.", -1,
+    polydelivery_methods
+};
+
+PyMODINIT_FUNC PyInit_polydelivery(void)
+{
+    import_array();
+    return PyModule_Create(&polydelivery_module);
+}
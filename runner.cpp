@@ -0,0 +1,483 @@
+/**
+ * Runs a job file (see jobs.hpp) on forked worker processes, so a job that
+ * crashes or hangs its worker fails alone instead of taking the batch down.
+ * Workers take the longest predicted job left through a shared counter over
+ * the jobs sorted by predicted time, and hand results back through a ring
+ * buffer per worker in shared memory. The parent drains the rings, kills
+ * workers stuck past the timeout, restarts dead workers and reports their
+ * jobs as failed. The inputs are measured for the predictions on forked
+ * processes too, under the same ceiling and timeout.
+ *
+ * Usage: runner <jobs file> [workers [timeout_seconds [memory_mb [timing_log]]]]
+ *
+ * Prints one line per job in file order: line, ok or failed, value, and the
+ * exact value or the reason the job failed. An exact value or reason too long
+ * to hand back ends in "..." and fails the job. A workers of 0 uses every core; a
+ * timeout or memory of 0 leaves it unbounded. With a timing log, the cost
+ * model is refit to the times logged there and the predicted and actual time
+ * of every job appended.
+ */
+#include "jobs.hpp"
+#include "budget.hpp"
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The atomics below are shared between processes, so must not hide a lock.
+static_assert(std::atomic<int64_t>::is_always_lock_free, "shared counters need lock free atomics");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared counters need lock free atomics");
+
+/// @brief The room for the exact value or failure reason of a result, terminator included.
+const std::size_t result_repr_size = 240;
+/// @brief Ends a repr cut short to fit its slot.
+const std::string truncation_mark = "...";
+/// @brief The number of results a worker may publish ahead of the parent.
+const std::size_t result_ring_size = 64;
+
+/// @brief One result as published by a worker.
+struct result_slot_struct
+{
+    int64_t job;
+    int64_t value;
+    double seconds;
+    uint8_t ok;
+    /// @brief The exact value or why the job failed, terminated, and ending
+    /// in truncation_mark if cut short.
+    char repr[result_repr_size];
+};
+
+/**
+ * @brief A single producer, single consumer ring of results in shared memory.
+ * The worker only advances tail, after the slot is written, and the parent
+ * only advances head, so a worker dying mid write never publishes the slot.
+ */
+struct result_ring_struct
+{
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
+    result_slot_struct slots[result_ring_size];
+};
+
+/// @brief The state of one worker, shared with the parent.
+struct worker_state_struct
+{
+    /// @brief The job being solved, or -1 when between jobs.
+    std::atomic<int64_t> job;
+    /// @brief When the job started, in steady clock nanoseconds.
+    std::atomic<int64_t> started;
+    result_ring_struct ring;
+};
+
+/// @brief The outcome of one job as collected by the parent.
+struct run_result_struct
+{
+    bool done = false;
+    bool ok = false;
+    long value = 0;
+    std::string repr;
+    /// @brief The solve time in seconds, 0 if the job was lost.
+    double seconds = 0;
+    /// @brief Whether the worker died on the job, so seconds only bounds its time.
+    bool censored = false;
+};
+
+/// @brief The steady clock in nanoseconds, comparable across processes.
+int64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+/**
+ * Maps zeroed memory that forked children share with the parent.
+ *
+ * @param n The number of objects.
+ *
+ * @throw std::runtime_error if the memory cannot be mapped.
+ */
+template <typename T>
+T *map_shared(std::size_t n)
+{
+    void *p_memory = mmap(nullptr, n * sizeof(T), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p_memory == MAP_FAILED)
+        throw std::runtime_error("cannot map shared memory");
+
+    T *p_objects = static_cast<T*>(p_memory);
+    for (std::size_t i = 0; i < n; i++)
+        new (&p_objects[i]) T();
+    return p_objects;
+}
+
+/**
+ * Publishes a result, waiting for the parent while the ring is full. A repr
+ * too long for its slot is cut short, marked, and fails the job, so that a
+ * truncated exact value is never reported ok.
+ */
+void push_result(
+    result_ring_struct& ring, int64_t job, long value, bool ok, const std::string& repr, double seconds
+) {
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    while (tail - ring.head.load(std::memory_order_acquire) >= result_ring_size)
+        std::this_thread::yield();
+
+    result_slot_struct& slot = ring.slots[tail % result_ring_size];
+    slot.job = job;
+    slot.value = value;
+    slot.seconds = seconds;
+    if (repr.size() < result_repr_size)
+    {
+        slot.ok = ok;
+        std::memcpy(slot.repr, repr.c_str(), repr.size() + 1);
+    }
+    else
+    {
+        slot.ok = false;
+        const std::string cut = repr.substr(0, result_repr_size - 1 - truncation_mark.size()) + truncation_mark;
+        std::memcpy(slot.repr, cut.c_str(), cut.size() + 1);
+    }
+    ring.tail.store(tail + 1, std::memory_order_release);
+}
+
+/**
+ * Collects every result a worker has published.
+ *
+ * @param ring      The ring of the worker.
+ * @param results   The results per job to fill in.
+ * @param n_done    Counts the jobs collected.
+ *
+ * @return Whether there was anything to collect.
+ */
+bool drain_ring(result_ring_struct& ring, std::vector<run_result_struct>& results, std::size_t& n_done)
+{
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    const uint64_t tail = ring.tail.load(std::memory_order_acquire);
+    for (uint64_t i = head; i < tail; i++)
+    {
+        const result_slot_struct& slot = ring.slots[i % result_ring_size];
+        run_result_struct& result = results[slot.job];
+        if (!result.done)
+            n_done++;
+        result = run_result_struct{true, slot.ok != 0, slot.value, slot.repr, slot.seconds};
+    }
+    ring.head.store(tail, std::memory_order_release);
+
+    return tail != head;
+}
+
+/**
+ * The body of a worker process: solves jobs until none are left.
+ *
+ * @param jobs          The jobs, inherited from the parent.
+ * @param order         The jobs in the order to claim them.
+ * @param next_job      The shared position in order of the next unclaimed job.
+ * @param state         The shared state of this worker.
+ * @param memory_bytes  The address space the worker may grow by, or 0.
+ */
+void run_worker(
+    const std::vector<job_struct>& jobs, const std::vector<std::size_t>& order,
+    std::atomic<int64_t>& next_job, worker_state_struct& state, long memory_bytes
+) {
+    // The ceiling only binds this process, so each worker gets its own.
+    MemoryCeiling ceiling(memory_bytes);
+    for (int64_t n = next_job++; n < (int64_t) jobs.size(); n = next_job++)
+    {
+        const int64_t i = order[n];
+        const int64_t started = now_ns();
+        state.started = started;
+        state.job = i;
+        long value;
+        std::string repr;
+        bool ok = solve_job(jobs[i].kind->solve, jobs[i].args, value, repr);
+        push_result(state.ring, i, value, ok, repr, (now_ns() - started) * 1e-9);
+        state.job = -1;
+    }
+}
+
+/// @brief Forks a worker, which never returns from this call.
+pid_t spawn_worker(
+    const std::vector<job_struct>& jobs, const std::vector<std::size_t>& order,
+    std::atomic<int64_t>& next_job, worker_state_struct& state, long memory_bytes
+) {
+    state.job = -1;
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        run_worker(jobs, order, next_job, state, memory_bytes);
+        // Skips the exit handlers and stdio buffers inherited from the parent.
+        _exit(0);
+    }
+    if (pid < 0)
+        throw std::runtime_error("cannot fork a worker");
+
+    return pid;
+}
+
+/**
+ * Measures every job (see measure_job) on forked processes under the same
+ * memory ceiling and timeout as the workers, so an input that crashes or
+ * hangs the parser only costs its prediction. A job whose measurer died keeps
+ * the default counts.
+ *
+ * @param jobs          The jobs.
+ * @param n_procs       The number of measuring processes.
+ * @param timeout_s     The seconds a measure may take, or 0 for unbounded.
+ * @param memory_bytes  The address space a measurer may grow by, or 0.
+ *
+ * @return The counts per job.
+ */
+std::vector<job_features_struct> measure_jobs(
+    const std::vector<job_struct>& jobs, unsigned n_procs, double timeout_s, long memory_bytes
+) {
+    std::vector<job_features_struct> features(jobs.size());
+    if (jobs.empty())
+        return features;
+
+    job_features_struct *p_features = map_shared<job_features_struct>(jobs.size());
+    std::atomic<int64_t> *p_next = map_shared<std::atomic<int64_t>>(1);
+    worker_state_struct *p_states = map_shared<worker_state_struct>(n_procs);
+    auto spawn = [&](worker_state_struct& state) {
+        state.job = -1;
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            MemoryCeiling ceiling(memory_bytes);
+            for (int64_t i = (*p_next)++; i < (int64_t) jobs.size(); i = (*p_next)++)
+            {
+                state.started = now_ns();
+                state.job = i;
+                p_features[i] = measure_job(jobs[i].args, jobs[i].kind->metric_arg);
+                state.job = -1;
+            }
+            _exit(0);
+        }
+        if (pid < 0)
+            throw std::runtime_error("cannot fork a measurer");
+        return pid;
+    };
+
+    std::vector<pid_t> pids(n_procs);
+    for (unsigned m = 0; m < n_procs; m++)
+        pids[m] = spawn(p_states[m]);
+    unsigned n_alive = n_procs;
+    while (n_alive > 0)
+    {
+        // Kills the measurers stuck on a job past the timeout.
+        if (timeout_s > 0)
+        {
+            const int64_t now = now_ns();
+            for (unsigned m = 0; m < n_procs; m++)
+            {
+                if (pids[m] > 0 && p_states[m].job >= 0
+                    && now - p_states[m].started > (int64_t) (timeout_s * 1e9))
+                    kill(pids[m], SIGKILL);
+            }
+        }
+
+        // Reaps the measurers that ended, restarting the ones that died early.
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+        {
+            unsigned m = 0;
+            while (m < n_procs && pids[m] != pid)
+                m++;
+            if (m == n_procs)
+                continue;
+
+            const bool clean = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+            // Drops whatever a dying measurer may have half written.
+            if (!clean && p_states[m].job >= 0)
+                p_features[p_states[m].job] = job_features_struct();
+            if (!clean && *p_next < (int64_t) jobs.size())
+                pids[m] = spawn(p_states[m]);
+            else
+            {
+                pids[m] = 0;
+                n_alive--;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    features.assign(p_features, p_features + jobs.size());
+    munmap(p_states, n_procs * sizeof(worker_state_struct));
+    munmap(p_next, sizeof(std::atomic<int64_t>));
+    munmap(p_features, jobs.size() * sizeof(job_features_struct));
+
+    return features;
+}
+
+/// @brief Why a worker that ended with status died.
+std::string death_reason(int status, bool timed_out, double timeout_s)
+{
+    if (timed_out)
+        return "timed out after " + std::to_string(timeout_s) + " s";
+    if (WIFSIGNALED(status))
+        return std::string("worker killed by ") + strsignal(WTERMSIG(status));
+    return "worker exited with status " + std::to_string(WEXITSTATUS(status));
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: " << argv[0] << " <jobs file> [workers [timeout_seconds [memory_mb [timing_log]]]]" << std::endl;
+        return 2;
+    }
+    unsigned n_workers = argc > 2 ? atoi(argv[2]) : 0;
+    const double timeout_s = argc > 3 ? atof(argv[3]) : 0;
+    const long memory_bytes = argc > 4 ? atol(argv[4]) * 1024 * 1024 : 0;
+    const std::string log_path = argc > 5 ? argv[5] : "";
+
+    std::vector<job_struct> jobs;
+    try
+    {
+        jobs = read_job_file(argv[1]);
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cerr << argv[1] << ": " << e.what() << std::endl;
+        return 2;
+    }
+    if (n_workers == 0)
+        n_workers = std::max(1u, std::thread::hardware_concurrency());
+    n_workers = std::min<std::size_t>(n_workers, std::max<std::size_t>(jobs.size(), 1));
+
+    auto start = std::chrono::steady_clock::now();
+    // Predicts every solve time to start the heaviest jobs first.
+    const cost_model_struct model = log_path.empty() ? cost_model_struct() : fit_cost_model(read_timings(log_path));
+    const std::vector<job_features_struct> features = measure_jobs(jobs, n_workers, timeout_s, memory_bytes);
+    std::vector<double> predicted;
+    for (const job_features_struct& f : features)
+        predicted.push_back(predict_seconds(model, f));
+    const std::vector<std::size_t> order = longest_first(predicted);
+
+    std::atomic<int64_t> *p_next_job = map_shared<std::atomic<int64_t>>(1);
+    worker_state_struct *p_workers = map_shared<worker_state_struct>(n_workers);
+
+    std::vector<pid_t> pids(n_workers, 0);
+    std::vector<bool> timed_out(n_workers, false);
+    for (unsigned w = 0; w < n_workers; w++)
+        pids[w] = spawn_worker(jobs, order, *p_next_job, p_workers[w], memory_bytes);
+
+    std::vector<run_result_struct> results(jobs.size());
+    std::size_t n_done = 0;
+    unsigned n_alive = n_workers;
+    long n_restarts = 0;
+    while (n_alive > 0)
+    {
+        bool idle = true;
+        for (unsigned w = 0; w < n_workers; w++)
+            idle = !drain_ring(p_workers[w].ring, results, n_done) && idle;
+
+        // Kills the workers stuck on a job past the timeout.
+        if (timeout_s > 0)
+        {
+            const int64_t now = now_ns();
+            for (unsigned w = 0; w < n_workers; w++)
+            {
+                if (pids[w] > 0 && !timed_out[w] && p_workers[w].job >= 0
+                    && now - p_workers[w].started > (int64_t) (timeout_s * 1e9))
+                {
+                    kill(pids[w], SIGKILL);
+                    timed_out[w] = true;
+                }
+            }
+        }
+
+        // Reaps the workers that ended, restarting the ones that died early.
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+        {
+            unsigned w = 0;
+            while (w < n_workers && pids[w] != pid)
+                w++;
+            if (w == n_workers)
+                continue;
+
+            // Whatever it published before dying still counts.
+            drain_ring(p_workers[w].ring, results, n_done);
+            const bool clean = WIFEXITED(status) && WEXITSTATUS(status) == 0 && !timed_out[w];
+            const int64_t job = p_workers[w].job;
+            if (!clean && job >= 0 && !results[job].done)
+            {
+                // Keeps how long the job ran as a lower bound on its time.
+                const double ran_s = timed_out[w] ? timeout_s : (now_ns() - p_workers[w].started) * 1e-9;
+                results[job] = run_result_struct{
+                    true, false, 0, death_reason(status, timed_out[w], timeout_s), ran_s, true
+                };
+                n_done++;
+            }
+            timed_out[w] = false;
+
+            if (!clean && *p_next_job < (int64_t) jobs.size())
+            {
+                pids[w] = spawn_worker(jobs, order, *p_next_job, p_workers[w], memory_bytes);
+                n_restarts++;
+            }
+            else
+            {
+                pids[w] = 0;
+                n_alive--;
+            }
+        }
+
+        if (idle)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // A worker that died between claiming a job and marking it loses the job.
+    for (run_result_struct& result : results)
+    {
+        if (!result.done)
+            result = run_result_struct{true, false, 0, "lost by a crashed worker"};
+    }
+
+    long n_failed = 0;
+    for (std::size_t i = 0; i < jobs.size(); i++)
+    {
+        const run_result_struct& result = results[i];
+        n_failed += !result.ok;
+        std::cout << jobs[i].line_no << "\t" << (result.ok ? "ok" : "failed") << "\t" << result.value
+                  << "\t" << result.repr << std::endl;
+    }
+    if (!log_path.empty())
+    {
+        // Logs the jobs cut short as censored, leaving out only the lost ones.
+        std::vector<timing_struct> timings;
+        for (std::size_t i = 0; i < jobs.size(); i++)
+        {
+            if (results[i].seconds > 0)
+            {
+                timings.push_back(timing_struct{
+                    jobs[i].kind->name, features[i], predicted[i], results[i].seconds, results[i].censored
+                });
+            }
+        }
+        append_timings(log_path, timings);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cerr << "jobs: " << jobs.size() << "\t| failed: " << n_failed << "\t| restarts: " << n_restarts
+              << "\t| workers: " << n_workers << "\t| time: " << elapsed.count() << std::endl;
+
+    munmap(p_workers, n_workers * sizeof(worker_state_struct));
+    munmap(p_next_job, sizeof(std::atomic<int64_t>));
+
+    return n_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,552 @@
+/**
+ * Searches the layouts of one tensor for the Pareto front of its delivery to
+ * the PEs of a workload of workloads.hpp.
+ *
+ * A candidate tiles every data dim over its own mesh axis, in blocks or round
+ * robin, over a power of two number of nodes, then replicates the tile a power
+ * of two times along x. It is scored on total jumps, latency, the links of its
+ * XY routed multicast trees and the elements it stores.
+ *
+ * Candidates are bounded before they are evaluated, and skipped when a point
+ * of the front already beats the bound:
+ *  - every request the requesting node does not hold takes at least one hop
+ *    and one tree link;
+ *  - adding replicas never lengthens a shortest path, so the jumps and latency
+ *    of a tiling bound those of the same tiling with fewer replicas, which are
+ *    searched after it.
+ *
+ * Every evaluated candidate is appended to the checkpoint at the end of each
+ * round; rerunning with the same checkpoint resumes where it stopped. The
+ * checkpoint is headed by the workload, mesh and scale, and refused by a
+ * search of any other.
+ *
+ * Usage: search <workload> [mesh_x mesh_y [scale [threads [checkpoint]]]]
+ *  e.g.  search gemm/os/A 16 16 4 8 gemm_os_A.tsv
+ */
+// Builds in the tile builders and the analyses without their demo mains.
+#define POLYDELIVERY_LIBRARY
+#include "tile.cpp"
+#include "latency.cpp"
+#include "meshcast.cpp"
+#include "workloads.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// @brief The number of objectives a candidate is scored on.
+const int n_objectives = 4;
+/// @brief The jumps, latency, multicast tree links and storage of a candidate.
+typedef std::array<long, n_objectives> objectives;
+/// @brief The names of the objectives, in order.
+const char *const objective_names[n_objectives] = {"jumps", "latency", "multicast", "storage"};
+
+/// @brief One layout of a 2-D tensor over the mesh.
+struct candidate_struct
+{
+    /// @brief The mesh axis of data dim 0; data dim 1 takes the other one.
+    int d0_axis;
+    /// @brief Whether every data dim is dealt round robin rather than in blocks.
+    bool cyclic[2];
+    /// @brief The nodes every data dim spreads over along its axis.
+    int spread[2];
+    /// @brief The copies of the tile along x.
+    int replicas;
+
+    /// @brief Names the tiling, the same for every number of replicas.
+    std::string base_key() const
+    {
+        std::string key = "d0" + std::string(d0_axis == 0 ? "x" : "y");
+        for (int d = 0; d < 2; d++)
+            key += std::string(cyclic[d] ? "/cyclic" : "/block") + std::to_string(spread[d]);
+        return key;
+    }
+
+    /// @brief Names the candidate.
+    std::string key() const
+    {
+        return base_key() + "/r" + std::to_string(replicas);
+    }
+
+    /// @brief The nodes the tile spans along mesh axis.
+    int tile_extent(int axis) const
+    {
+        return spread[axis == d0_axis ? 0 : 1];
+    }
+};
+
+/**
+ * Lists every candidate that fits the mesh, grouped by replicas, most first.
+ *
+ * @param extents   The tensor extents.
+ * @param mesh      The mesh.
+ */
+std::vector<std::vector<candidate_struct>> enumerate_candidates(const std::vector<int>& extents, const mesh_shape& mesh)
+{
+    std::vector<int> replica_counts;
+    for (int r = 1; r <= mesh.x; r *= 2)
+        replica_counts.push_back(r);
+    std::reverse(replica_counts.begin(), replica_counts.end());
+
+    std::vector<std::vector<candidate_struct>> rounds;
+    for (int r : replica_counts)
+    {
+        std::vector<candidate_struct> round;
+        for (int d0_axis : {0, 1})
+        {
+            const int axis_extent[2] = {d0_axis == 0 ? mesh.x / r : mesh.y, d0_axis == 0 ? mesh.y : mesh.x / r};
+            for (int s0 = 1; s0 <= std::min(axis_extent[0], extents[0]); s0 *= 2)
+            for (int s1 = 1; s1 <= std::min(axis_extent[1], extents[1]); s1 *= 2)
+            for (bool c0 : {false, true})
+            for (bool c1 : {false, true})
+            {
+                // Dealing round robin over one node is a block.
+                if ((c0 && s0 == 1) || (c1 && s1 == 1))
+                    continue;
+                round.push_back(candidate_struct{d0_axis, {c0, c1}, {s0, s1}, r});
+            }
+        }
+        rounds.push_back(std::move(round));
+    }
+
+    return rounds;
+}
+
+/**
+ * Builds the src occupancy of a candidate.
+ *
+ * @param ctx           The context to build the layout in.
+ * @param candidate     The candidate.
+ * @param extents       The tensor extents.
+ *
+ * @return The layout as an ISL string.
+ */
+std::string candidate_layout(isl_ctx *ctx, const candidate_struct& candidate, const std::vector<int>& extents)
+{
+    std::vector<isl_basic_map *> features;
+    for (int d = 0; d < 2; d++)
+    {
+        int axis = d == 0 ? candidate.d0_axis : 1 - candidate.d0_axis;
+        features.push_back(candidate.cyclic[d]
+            ? cyclic_tile(d, mesh_space(ctx, "src"), candidate.spread[d], axis)
+            : block_tile(d, mesh_space(ctx, "src"), block_size(extents[d], candidate.spread[d]), axis));
+    }
+    features.push_back(bound(mesh_space(ctx, "src"), isl_dim_in, {candidate.tile_extent(0), candidate.tile_extent(1)}));
+    features.push_back(bound(mesh_space(ctx, "src"), isl_dim_out, extents));
+    isl_basic_map *p_tile = compose_mapping(mesh_space(ctx, "src"), features);
+    isl_map *p_layout = replicate(isl_map_from_basic_map(p_tile), candidate.replicas, 0);
+
+    char *s_layout = isl_map_to_str(p_layout);
+    std::string ret(s_layout);
+    free(s_layout);
+    isl_map_free(p_layout);
+
+    return ret;
+}
+
+/// @brief Counts the points of a set, exactly.
+exact count_points(__isl_take isl_set *set)
+{
+    isl_pw_qpolynomial *p_card = isl_set_card(set);
+    return val_to_exact(isl_pw_qpolynomial_eval(
+        p_card, isl_point_zero(isl_pw_qpolynomial_get_domain_space(p_card))
+    ));
+}
+
+/**
+ * Bounds the objectives of a layout from below without solving any min
+ * distance: every request the requesting node does not hold takes at least
+ * one hop and one tree link. The storage is exact.
+ *
+ * @param ctx           The context to count in.
+ * @param src_occupancy The layout.
+ * @param dst_fill      The requests.
+ */
+objectives cheap_bounds(isl_ctx *ctx, const std::string& src_occupancy, const std::string& dst_fill)
+{
+    isl_map *p_src = isl_map_read_from_str(ctx, src_occupancy.c_str());
+    isl_map *p_dst = isl_map_read_from_str(ctx, dst_fill.c_str());
+    exact storage = count_points(isl_map_wrap(isl_map_copy(p_src)));
+    // Renames the srcs to dsts to find the requests held in place.
+    p_src = isl_map_set_tuple_name(p_src, isl_dim_in, "dst");
+    exact remote = count_points(isl_map_wrap(isl_map_subtract(p_dst, p_src)));
+
+    // Converts once every map is freed.
+    const long n_remote = exact_to_long(remote);
+    return objectives{n_remote, n_remote > 0 ? 1 : 0, n_remote, exact_to_long(storage)};
+}
+
+/**
+ * Scores a layout on every objective. The nearest src of every request is
+ * picked once, as the multicast networks, and the jumps, the latency and the
+ * tree links are all read off that one selection.
+ *
+ * @throw std::overflow_error if an objective does not fit in a long.
+ */
+objectives evaluate(
+    const std::string& src_occupancy, const std::string& dst_fill, const std::string& dist_func, long storage
+) {
+    isl_ctx *p_ctx = isl_ctx_alloc();
+    // Gets { data -> [dst -> src] } for the src picked per request.
+    isl_map *p_networks = identify_mesh_casts(p_ctx, src_occupancy, dst_fill, dist_func);
+
+    // Makes { [data -> dst] -> [dst -> src] } and prices every pair.
+    isl_map *p_picked = isl_map_uncurry(isl_map_copy(p_networks));
+    isl_map *p_pairs = isl_map_range_product(
+        isl_map_range_map(isl_set_unwrap(isl_map_domain(isl_map_copy(p_picked)))), p_picked
+    );
+    isl_pw_multi_aff *p_dist_pma = isl_pw_multi_aff_from_map(isl_map_apply_range(
+        p_pairs, isl_map_read_from_str(p_ctx, dist_func.c_str())
+    ));
+    isl_pw_qpolynomial *p_dist = isl_pw_qpolynomial_from_pw_aff(isl_pw_multi_aff_get_pw_aff(p_dist_pma, 0));
+    isl_pw_multi_aff_free(p_dist_pma);
+
+    // Sums the distances for the jumps and takes their max for the latency.
+    isl_pw_qpolynomial *p_sum = isl_pw_qpolynomial_sum(isl_pw_qpolynomial_sum(isl_pw_qpolynomial_copy(p_dist)));
+    exact jumps = val_to_exact(isl_pw_qpolynomial_eval(
+        p_sum, isl_point_zero(isl_pw_qpolynomial_get_domain_space(p_sum))
+    ));
+    exact latency = val_to_exact(isl_pw_qpolynomial_max(p_dist));
+    exact multicast = val_to_exact(cost_dor_mesh_cast_val(p_networks));
+    isl_ctx_free(p_ctx);
+
+    // Converts once the context is gone.
+    return objectives{exact_to_long(jumps), exact_to_long(latency), exact_to_long(multicast), storage};
+}
+
+/// @brief Whether a is at least as good as b on every objective.
+bool covers(const objectives& a, const objectives& b)
+{
+    for (int i = 0; i < n_objectives; i++)
+    {
+        if (a[i] > b[i])
+            return false;
+    }
+    return true;
+}
+
+/// @brief The candidates no other candidate covers, by key.
+class ParetoFront
+{
+    private:
+        std::vector<std::pair<std::string, objectives>> points;
+    public:
+        /// @brief Whether a point of the front is as good as bound on everything.
+        bool covers_bound(const objectives& bound) const
+        {
+            for (const auto& point : points)
+            {
+                if (covers(point.second, bound))
+                    return true;
+            }
+            return false;
+        }
+
+        /// @brief Adds a point unless covered, dropping the points it covers.
+        void insert(const std::string& key, const objectives& score)
+        {
+            if (covers_bound(score))
+                return;
+            points.erase(std::remove_if(points.begin(), points.end(), [&](const auto& point) {
+                return covers(score, point.second);
+            }), points.end());
+            points.emplace_back(key, score);
+        }
+
+        const std::vector<std::pair<std::string, objectives>>& members() const
+        {
+            return points;
+        }
+};
+
+/// @brief Runs fn(0), ..., fn(n - 1) on a pool of threads.
+void parallel_for(std::size_t n, unsigned n_threads, const std::function<void(std::size_t)>& fn)
+{
+    std::atomic<std::size_t> next(0);
+    auto worker = [&]() {
+        for (std::size_t i = next++; i < n; i = next++)
+            fn(i);
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < n_threads; t++)
+        pool.emplace_back(worker);
+    worker();
+    for (std::thread& thread : pool)
+        thread.join();
+}
+
+/**
+ * Reads the candidates a checkpoint holds. Its first line names the search it
+ * belongs to; a missing or empty file is started with that line instead.
+ *
+ * @param path      The checkpoint file.
+ * @param header    The line naming this search, from checkpoint_header.
+ *
+ * @return The scores of the evaluated candidates by key.
+ * @throw std::runtime_error if the checkpoint belongs to another search or
+ *        cannot be started.
+ */
+std::map<std::string, objectives> read_checkpoint(const std::string& path, const std::string& header)
+{
+    std::map<std::string, objectives> evaluated;
+    std::ifstream in(path);
+    std::string first;
+    if (!std::getline(in, first))
+    {
+        std::ofstream out(path, std::ios::trunc);
+        if (!(out << header << "\n"))
+            throw std::runtime_error("cannot write checkpoint " + path);
+        return evaluated;
+    }
+    if (first != header)
+        throw std::runtime_error("checkpoint " + path + " is for \"" + first + "\", not \"" + header + "\"");
+    std::string key;
+    objectives score;
+    while (in >> key >> score[0] >> score[1] >> score[2] >> score[3])
+        evaluated[key] = score;
+
+    return evaluated;
+}
+
+/// @brief The first line of a checkpoint, naming the workload, mesh and scale searched.
+std::string checkpoint_header(const std::string& name, const mesh_shape& mesh, int scale)
+{
+    return "# search " + name + " " + std::to_string(mesh.x) + " " + std::to_string(mesh.y) + " " +
+           std::to_string(scale);
+}
+
+/**
+ * Reads a whole number argument.
+ *
+ * @return The number, or -1 if the argument is not a number of at least min.
+ */
+long parse_count(const char *s_arg, long min)
+{
+    char *s_end;
+    errno = 0;
+    long value = strtol(s_arg, &s_end, 10);
+    if (s_end == s_arg || *s_end || errno || value < min || value > INT_MAX)
+        return -1;
+
+    return value;
+}
+
+/// @brief Appends evaluated candidates to a checkpoint, one line each.
+void append_checkpoint(const std::string& path, const std::vector<std::pair<std::string, objectives>>& scored)
+{
+    std::ofstream out(path, std::ios::app);
+    for (const auto& [key, score] : scored)
+        out << key << "\t" << score[0] << "\t" << score[1] << "\t" << score[2] << "\t" << score[3] << "\n";
+}
+
+/// @brief Raises the jumps and latency bound of a tiling to those of score.
+void raise_bound(std::map<std::string, objectives>& base_bounds, const std::string& base, const objectives& score)
+{
+    objectives& bound = base_bounds.emplace(base, objectives{0, 0, 0, 0}).first->second;
+    bound[0] = std::max(bound[0], score[0]);
+    bound[1] = std::max(bound[1], score[1]);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: " << argv[0] << " <workload> [mesh_x mesh_y [scale [threads [checkpoint]]]]" << std::endl;
+        return 2;
+    }
+    const std::string name = argv[1];
+    const long mesh_x = argc > 3 ? parse_count(argv[2], 1) : 8;
+    const long mesh_y = argc > 3 ? parse_count(argv[3], 1) : 8;
+    const long scale = argc > 4 ? parse_count(argv[4], 1) : 4;
+    const long threads = argc > 5 ? parse_count(argv[5], 0) : 0;
+    const std::string checkpoint = argc > 6 ? argv[6] : "";
+    if (mesh_x < 0 || mesh_y < 0 || scale < 0 || threads < 0)
+    {
+        std::cerr << "the mesh sizes and scale must be positive numbers, and threads a number" << std::endl;
+        return 2;
+    }
+    const mesh_shape mesh{static_cast<int>(mesh_x), static_cast<int>(mesh_y)};
+    unsigned n_threads = threads;
+    if (n_threads == 0)
+        n_threads = std::max(1u, std::thread::hardware_concurrency());
+    isl_ctx *p_ctx = isl_ctx_alloc();
+
+    // Finds the requests to serve and the extents of the tensor.
+    std::string dst_fill;
+    for (const workload& w : standard_workloads(p_ctx, mesh, scale))
+    {
+        if (w->name == name)
+            dst_fill = w->dst_fill;
+    }
+    if (dst_fill.empty())
+    {
+        std::cerr << "no workload " << name << std::endl;
+        isl_ctx_free(p_ctx);
+        return 2;
+    }
+    std::vector<exact> max_data;
+    isl_set *p_data = isl_map_range(isl_map_read_from_str(p_ctx, dst_fill.c_str()));
+    for (int d = 0; d < 2; d++)
+        max_data.push_back(val_to_exact(isl_set_dim_max_val(isl_set_copy(p_data), d)));
+    isl_set_free(p_data);
+    std::vector<int> extents;
+    for (const exact& max : max_data)
+    {
+        if (!max->fits || max->value >= INT_MAX)
+        {
+            std::cerr << "workload " << name << " has a tensor extent of " << max->repr << std::endl;
+            isl_ctx_free(p_ctx);
+            return 2;
+        }
+        extents.push_back(max->value + 1);
+    }
+    MetricCache metrics(p_ctx);
+    const std::string dist_func = metric_str<Manhattan<2>>(metrics, "dst", "src");
+
+    // Resumes from the checkpoint, if it is of this search.
+    ParetoFront front;
+    std::map<std::string, objectives> evaluated;
+    try
+    {
+        if (!checkpoint.empty())
+            evaluated = read_checkpoint(checkpoint, checkpoint_header(name, mesh, scale));
+    }
+    catch (const std::runtime_error& e)
+    {
+        std::cerr << e.what() << std::endl;
+        metrics.clear();
+        isl_ctx_free(p_ctx);
+        return 2;
+    }
+    for (const auto& [key, score] : evaluated)
+        front.insert(key, score);
+
+    long n_candidates = 0, n_resumed = 0, n_pruned = 0, n_evaluated = 0, n_failed = 0;
+    std::map<std::string, objectives> base_bounds;
+    const std::size_t chunk = 64 * n_threads;
+    for (const std::vector<candidate_struct>& round : enumerate_candidates(extents, mesh))
+    {
+        n_candidates += round.size();
+        std::vector<candidate_struct> todo;
+        for (const candidate_struct& candidate : round)
+        {
+            auto found = evaluated.find(candidate.key());
+            if (found == evaluated.end())
+                todo.push_back(candidate);
+            else
+            {
+                raise_bound(base_bounds, candidate.base_key(), found->second);
+                n_resumed++;
+            }
+        }
+
+        for (std::size_t start = 0; start < todo.size(); start += chunk)
+        {
+            const std::size_t n = std::min(chunk, todo.size() - start);
+            // Lays out and bounds every candidate of the chunk.
+            std::vector<std::string> layouts(n);
+            std::vector<objectives> bounds(n);
+            parallel_for(n, n_threads, [&](std::size_t i) {
+                isl_ctx *p_local = isl_ctx_alloc();
+                try
+                {
+                    layouts[i] = candidate_layout(p_local, todo[start + i], extents);
+                    bounds[i] = cheap_bounds(p_local, layouts[i], dst_fill);
+                }
+                catch (const std::exception& e)
+                {
+                    // Leaves the layout empty, such that the candidate fails.
+                    layouts[i].clear();
+                }
+                isl_ctx_free(p_local);
+            });
+
+            // Skips the candidates the front already beats.
+            std::vector<std::size_t> survivors;
+            for (std::size_t i = 0; i < n; i++)
+            {
+                if (layouts[i].empty())
+                {
+                    n_failed++;
+                    continue;
+                }
+                const std::string base = todo[start + i].base_key();
+                auto known = base_bounds.find(base);
+                if (known != base_bounds.end())
+                {
+                    bounds[i][0] = std::max(bounds[i][0], known->second[0]);
+                    bounds[i][1] = std::max(bounds[i][1], known->second[1]);
+                }
+                raise_bound(base_bounds, base, bounds[i]);
+                if (front.covers_bound(bounds[i]))
+                    n_pruned++;
+                else
+                    survivors.push_back(i);
+            }
+
+            // Evaluates the survivors.
+            std::vector<objectives> scores(survivors.size());
+            std::vector<unsigned char> ok(survivors.size(), 0);
+            parallel_for(survivors.size(), n_threads, [&](std::size_t s) {
+                const std::size_t i = survivors[s];
+                try
+                {
+                    scores[s] = evaluate(layouts[i], dst_fill, dist_func, bounds[i][3]);
+                    ok[s] = 1;
+                }
+                catch (const std::exception& e)
+                {
+                    ok[s] = 0;
+                }
+            });
+
+            std::vector<std::pair<std::string, objectives>> scored;
+            for (std::size_t s = 0; s < survivors.size(); s++)
+            {
+                const candidate_struct& candidate = todo[start + survivors[s]];
+                if (!ok[s])
+                {
+                    n_failed++;
+                    continue;
+                }
+                raise_bound(base_bounds, candidate.base_key(), scores[s]);
+                front.insert(candidate.key(), scores[s]);
+                scored.emplace_back(candidate.key(), scores[s]);
+                n_evaluated++;
+            }
+            if (!checkpoint.empty())
+                append_checkpoint(checkpoint, scored);
+        }
+
+        std::cerr << "replicas: " << (round.empty() ? 0 : round[0].replicas) << "\t| candidates: " << n_candidates
+                  << "\t| pruned: " << n_pruned << "\t| evaluated: " << n_evaluated << "\t| resumed: " << n_resumed
+                  << "\t| failed: " << n_failed << "\t| front: " << front.members().size() << std::endl;
+    }
+
+    // Prints the front.
+    std::cout << "candidate";
+    for (const char *s_objective : objective_names)
+        std::cout << "\t" << s_objective;
+    std::cout << std::endl;
+    for (const auto& [key, score] : front.members())
+    {
+        std::cout << key;
+        for (long value : score)
+            std::cout << "\t" << value;
+        std::cout << std::endl;
+    }
+
+    metrics.clear();
+    isl_ctx_free(p_ctx);
+
+    return 0;
+}
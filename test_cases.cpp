@@ -0,0 +1,637 @@
+/**
+ * Checks the analyses against the expected results of a case file, e.g.
+ * test_cases.yaml, and exits with 1 if any check fails.
+ *
+ * A case file is a YAML list of cases, read with the small subset of YAML the
+ * files use: block lists and mappings, "|" block strings, double quoted and
+ * plain strings, flow lists and mappings, and anchors with their aliases.
+ * Every case names the analyses its expected values check; a null value is not
+ * checked.
+ *
+ * Usage: test_cases [cases.yaml ...]
+ *  e.g.  test_cases test_cases.yaml joint_cases.yaml formula_cases.yaml
+ */
+// Builds in the analyses without their demo mains.
+#define POLYDELIVERY_LIBRARY
+#include "latency.cpp"
+#include "native_eval.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// @brief A node of a case file: a string, a list or a mapping.
+struct yaml_node
+{
+    enum class kind { scalar, sequence, mapping } type = kind::scalar;
+    /// @brief The string of a scalar; "null", "~" and "" are null.
+    std::string scalar;
+    /// @brief The items of a sequence.
+    std::vector<yaml_node> items;
+    /// @brief The fields of a mapping, in file order.
+    std::vector<std::pair<std::string, yaml_node>> fields;
+
+    bool is_null() const
+    {
+        return type == kind::scalar && (scalar.empty() || scalar == "null" || scalar == "~");
+    }
+
+    /// @brief The field called key, or nullptr if there is none.
+    const yaml_node *get(const std::string& key) const
+    {
+        for (const auto& [name, value] : fields)
+        {
+            if (name == key)
+                return &value;
+        }
+        return nullptr;
+    }
+};
+
+/**
+ * @brief Reads the YAML subset of the case files. Throws std::invalid_argument
+ * with the line number on anything outside it.
+ */
+class CaseReader
+{
+    private:
+        std::vector<std::string> lines;
+        std::map<std::string, yaml_node> anchors;
+
+        /// @brief The column of the first non-space character, or -1 if blank.
+        static int indent_of(const std::string& line)
+        {
+            std::size_t at = line.find_first_not_of(' ');
+            if (at == std::string::npos || line[at] == '#')
+                return -1;
+            return at;
+        }
+
+        static std::string trim(const std::string& s)
+        {
+            std::size_t first = s.find_first_not_of(" \t");
+            if (first == std::string::npos)
+                return "";
+            return s.substr(first, s.find_last_not_of(" \t") - first + 1);
+        }
+
+        [[noreturn]] static void fail(std::size_t line, const std::string& what)
+        {
+            throw std::invalid_argument("line " + std::to_string(line + 1) + ": " + what);
+        }
+
+        /// @brief Skips blank and comment lines from i on.
+        std::size_t skip_blank(std::size_t i) const
+        {
+            while (i < lines.size() && indent_of(lines[i]) < 0)
+                i++;
+            return i;
+        }
+
+        /// @brief The position of the ':' ending a mapping key, or npos.
+        static std::size_t key_end(const std::string& content)
+        {
+            if (content.empty() || content[0] == '"' || content[0] == '[' || content[0] == '{')
+                return std::string::npos;
+            std::size_t at = content.find(':');
+            if (at == std::string::npos || (at + 1 < content.size() && content[at + 1] != ' '))
+                return std::string::npos;
+            return at;
+        }
+
+        /// @brief Parses a double quoted string starting at text[at].
+        static std::string parse_quoted(const std::string& text, std::size_t& at, std::size_t line)
+        {
+            std::string out;
+            for (at++; at < text.size() && text[at] != '"'; at++)
+            {
+                if (text[at] == '\\' && at + 1 < text.size())
+                    at++;
+                out += text[at];
+            }
+            if (at >= text.size())
+                fail(line, "unterminated string");
+            at++;
+            return out;
+        }
+
+        /// @brief Parses a flow list, mapping or scalar starting at text[at].
+        yaml_node parse_flow(const std::string& text, std::size_t& at, std::size_t line) const
+        {
+            auto skip = [&]() { while (at < text.size() && text[at] == ' ') at++; };
+            skip();
+            yaml_node node;
+            if (at < text.size() && (text[at] == '[' || text[at] == '{'))
+            {
+                const bool is_list = text[at] == '[';
+                const char close = is_list ? ']' : '}';
+                node.type = is_list ? yaml_node::kind::sequence : yaml_node::kind::mapping;
+                at++;
+                skip();
+                while (at < text.size() && text[at] != close)
+                {
+                    if (is_list)
+                        node.items.push_back(parse_flow(text, at, line));
+                    else
+                    {
+                        std::size_t colon = text.find(':', at);
+                        if (colon == std::string::npos)
+                            fail(line, "flow mapping entry without a key");
+                        std::string key = trim(text.substr(at, colon - at));
+                        at = colon + 1;
+                        node.fields.emplace_back(key, parse_flow(text, at, line));
+                    }
+                    skip();
+                    if (at < text.size() && text[at] == ',')
+                        at++;
+                    skip();
+                }
+                if (at >= text.size())
+                    fail(line, std::string("missing '") + close + "'");
+                at++;
+                return node;
+            }
+            if (at < text.size() && text[at] == '"')
+            {
+                node.scalar = parse_quoted(text, at, line);
+                return node;
+            }
+            std::size_t end = text.find_first_of(",]}", at);
+            if (end == std::string::npos)
+                end = text.size();
+            node.scalar = trim(text.substr(at, end - at));
+            at = end;
+            return node;
+        }
+
+        /**
+         * Parses the value after "key:" or "-" on line i, consuming the lines
+         * it spans.
+         *
+         * @param value     The text after the key.
+         * @param i         The line of the key; set past the value.
+         * @param indent    The indentation of the key.
+         */
+        yaml_node parse_value(std::string value, std::size_t& i, int indent)
+        {
+            const std::size_t line = i;
+            value = trim(value);
+            std::string anchor;
+            if (!value.empty() && value[0] == '&')
+            {
+                std::size_t end = value.find(' ');
+                anchor = value.substr(1, end == std::string::npos ? std::string::npos : end - 1);
+                value = end == std::string::npos ? "" : trim(value.substr(end));
+            }
+
+            yaml_node node;
+            if (!value.empty() && value[0] == '*')
+            {
+                auto found = anchors.find(value.substr(1));
+                if (found == anchors.end())
+                    fail(line, "unknown alias " + value);
+                node = found->second;
+                i++;
+            }
+            else if (value == "|" || value == "|-")
+            {
+                // Keeps the lines indented past the key, less their common indent.
+                std::size_t end = i + 1;
+                int block_indent = -1;
+                while (end < lines.size())
+                {
+                    std::size_t first = lines[end].find_first_not_of(' ');
+                    int at = first == std::string::npos ? -1 : (int) first;
+                    if (at >= 0 && at <= indent)
+                        break;
+                    if (at >= 0 && (block_indent < 0 || at < block_indent))
+                        block_indent = at;
+                    end++;
+                }
+                for (std::size_t k = i + 1; k < end; k++)
+                {
+                    if ((int) lines[k].size() > block_indent && block_indent >= 0)
+                        node.scalar += lines[k].substr(block_indent);
+                    node.scalar += '\n';
+                }
+                i = end;
+            }
+            else if (!value.empty())
+            {
+                std::size_t at = 0;
+                node = parse_flow(value, at, line);
+                if (!trim(value.substr(at)).empty())
+                    fail(line, "trailing text after a value");
+                i++;
+            }
+            else
+            {
+                // Nests a block list or mapping, or is null if nothing is deeper.
+                std::size_t next = skip_blank(i + 1);
+                if (next < lines.size() && indent_of(lines[next]) > indent)
+                {
+                    i = next;
+                    node = parse_block(i, indent_of(lines[next]));
+                }
+                else
+                    i++;
+            }
+
+            if (!anchor.empty())
+                anchors[anchor] = node;
+            return node;
+        }
+
+        /// @brief Parses the block list or mapping at indent from line i on.
+        yaml_node parse_block(std::size_t& i, int indent)
+        {
+            yaml_node node;
+            i = skip_blank(i);
+            const std::string& first = lines[i];
+            const bool is_list = first[indent] == '-' && (first.size() == (std::size_t) indent + 1 || first[indent + 1] == ' ');
+            node.type = is_list ? yaml_node::kind::sequence : yaml_node::kind::mapping;
+
+            while ((i = skip_blank(i)) < lines.size() && indent_of(lines[i]) == indent)
+            {
+                std::string content = lines[i].substr(indent);
+                if (is_list)
+                {
+                    if (content[0] != '-')
+                        fail(i, "expected a list item");
+                    // Reads the item as if the dash were a space.
+                    std::size_t item = content.find_first_not_of(' ', 1);
+                    if (item == std::string::npos)
+                    {
+                        node.items.push_back(parse_value("", i, indent));
+                        continue;
+                    }
+                    lines[i][indent] = ' ';
+                    std::string rest = lines[i].substr(indent + item);
+                    if (key_end(rest) != std::string::npos)
+                        node.items.push_back(parse_block(i, indent + item));
+                    else
+                        node.items.push_back(parse_value(rest, i, indent));
+                }
+                else
+                {
+                    std::size_t colon = key_end(content);
+                    if (colon == std::string::npos)
+                        fail(i, "expected a key");
+                    std::string key = content.substr(0, colon);
+                    node.fields.emplace_back(key, parse_value(content.substr(colon + 1), i, indent));
+                }
+            }
+            if (i < lines.size() && indent_of(lines[i]) > indent)
+                fail(i, "unexpected indentation");
+
+            return node;
+        }
+
+    public:
+        /// @brief Reads the case file at path.
+        yaml_node read(const std::string& path)
+        {
+            std::ifstream in(path);
+            if (!in)
+                throw std::invalid_argument("cannot open " + path);
+            lines.clear();
+            anchors.clear();
+            for (std::string line; std::getline(in, line);)
+                lines.push_back(line);
+
+            std::size_t i = skip_blank(0);
+            if (i == lines.size())
+                return yaml_node{yaml_node::kind::sequence};
+            return parse_block(i, indent_of(lines[i]));
+        }
+};
+
+/// @brief Counts the checks run and reports the ones that fail.
+struct case_tally
+{
+    int passed = 0;
+    int failed = 0;
+
+    /**
+     * Runs one check, failing it on any exception.
+     *
+     * @param name      What is checked, for the report.
+     * @param expected  The expected result.
+     * @param actual    Gives the result as a string.
+     */
+    void check(const std::string& name, const std::string& expected, const std::function<std::string()>& actual)
+    {
+        std::string got;
+        try
+        {
+            got = actual();
+        }
+        catch (const std::exception& e)
+        {
+            got = std::string("error: ") + e.what();
+        }
+        if (got == expected)
+        {
+            passed++;
+            return;
+        }
+        failed++;
+        std::cout << "FAIL " << name << "\t| expected: " << expected << "\t| got: " << got << std::endl;
+    }
+};
+
+/**
+ * Finds the map of one tensor in a union of tensors.
+ *
+ * @param tensors   The union as an ISL string.
+ * @param tensor    The tuple name of the tensor's data.
+ *
+ * @return The map as an ISL string.
+ * @throw std::invalid_argument if no map holds the tensor.
+ */
+std::string tensor_map_str(const std::string& tensors, const std::string& tensor)
+{
+    isl_ctx *p_ctx = isl_ctx_alloc();
+    isl_union_map *p_tensors = isl_union_map_read_from_str(p_ctx, tensors.c_str());
+    struct find_info
+    {
+        const std::string& tensor;
+        isl_map *p_found;
+    } info{tensor, nullptr};
+    isl_union_map_foreach_map(p_tensors, [](isl_map *p_map, void *p_user) -> isl_stat {
+        find_info *p_info = static_cast<find_info*>(p_user);
+        const char *s_name = isl_map_get_tuple_name(p_map, isl_dim_out);
+        if (!p_info->p_found && s_name && p_info->tensor == s_name)
+            p_info->p_found = p_map;
+        else
+            isl_map_free(p_map);
+        return isl_stat_ok;
+    }, &info);
+    isl_union_map_free(p_tensors);
+
+    char *s_map = info.p_found ? isl_map_to_str(info.p_found) : nullptr;
+    std::string map = s_map ? s_map : "";
+    free(s_map);
+    isl_map_free(info.p_found);
+    isl_ctx_free(p_ctx);
+    if (map.empty())
+        throw std::invalid_argument("no map holds tensor " + tensor);
+
+    return map;
+}
+
+/**
+ * Checks the expectations of a case over several tensors.
+ *
+ * @param label     Names the case in the report.
+ * @param c         The case.
+ * @param tally     Records the checks.
+ */
+void check_joint_case(const std::string& label, const yaml_node& c, case_tally& tally)
+{
+    const std::string& src = c.get("p_src")->scalar;
+    const std::string& dst = c.get("p_dst")->scalar;
+    const std::string& dist = c.get("p_dist")->scalar;
+    const yaml_node& expected = *c.get("expected");
+
+    // Analyzes the tensors together once for every check.
+    joint_jumps joint;
+    std::string joint_error;
+    try
+    {
+        std::map<std::string, long> bytes;
+        if (const yaml_node *p_bytes = c.get("bytes"))
+        {
+            for (const auto& [tensor, size] : p_bytes->fields)
+                bytes[tensor] = std::stol(size.scalar);
+        }
+        joint = analyze_joint_jumps(src, dst, dist, bytes);
+    }
+    catch (const std::exception& e)
+    {
+        joint_error = e.what();
+    }
+    auto joint_result = [&]() -> const joint_jumps_struct& {
+        if (!joint)
+            throw std::runtime_error(joint_error);
+        return *joint;
+    };
+
+    const yaml_node *p_tensors = expected.get("tensor_jumps");
+    if (p_tensors && !p_tensors->is_null())
+    {
+        for (const auto& [tensor, jumps] : p_tensors->fields)
+        {
+            const std::string name = tensor;
+            tally.check(label + " tensor_jumps " + name, jumps.scalar, [&]() {
+                for (const tensor_jumps_struct& t : joint_result().tensors)
+                {
+                    if (t.tensor == name)
+                        return t.jumps->repr;
+                }
+                return std::string("missing");
+            });
+            tally.check(label + " alone " + name, jumps.scalar, [&]() {
+                return analyze_jumps_exact(tensor_map_str(src, name), tensor_map_str(dst, name), dist)->repr;
+            });
+        }
+    }
+
+    const yaml_node *p_byte_jumps = expected.get("byte_jumps");
+    if (p_byte_jumps && !p_byte_jumps->is_null())
+    {
+        tally.check(label + " byte_jumps", p_byte_jumps->scalar, [&]() {
+            return joint_result().byte_jumps->repr;
+        });
+    }
+}
+
+/**
+ * Checks a case of p_src, p_dst and p_dist maps.
+ *
+ * @param label     Names the case in the report.
+ * @param c         The case.
+ * @param tally     Records the checks.
+ */
+void check_map_case(const std::string& label, const yaml_node& c, case_tally& tally)
+{
+    const std::string& src = c.get("p_src")->scalar;
+    const std::string& dst = c.get("p_dst")->scalar;
+    const std::string& dist = c.get("p_dist")->scalar;
+    const yaml_node *p_expected = c.get("expected");
+    const yaml_node *p_latency = p_expected->get("latency");
+    if (p_latency && !p_latency->is_null())
+    {
+        tally.check(label + " latency", p_latency->scalar, [&]() {
+            return analyze_latency_exact(src, dst, dist)->repr;
+        });
+        tally.check(label + " bisected latency", p_latency->scalar, [&]() {
+            return std::to_string(analyze_latency_bisect(src, dst, dist));
+        });
+    }
+
+    const yaml_node *p_jumps = p_expected->get("total_jumps");
+    if (p_jumps && !p_jumps->is_null())
+    {
+        tally.check(label + " total_jumps", p_jumps->scalar, [&]() {
+            return analyze_jumps_exact(src, dst, dist)->repr;
+        });
+        tally.check(label + " hops row", p_jumps->scalar, [&]() {
+            return analyze_metric_table(src, dst, dist, {{"hops", dist}})->metrics.at(0).total->repr;
+        });
+    }
+}
+
+/// @brief Reads the coords of a point from a list of integers.
+std::vector<long> read_point(const yaml_node& at)
+{
+    std::vector<long> point;
+    for (const yaml_node& coord : at.items)
+        point.push_back(std::stol(coord.scalar));
+    return point;
+}
+
+/// @brief Prints a value as an integer when it is one, as ISL would.
+std::string real_repr(double value)
+{
+    if (value == std::floor(value) && std::fabs(value) < 9.2e18)
+        return std::to_string((long) value);
+    std::ostringstream out;
+    out.precision(17);
+    out << value;
+    return out.str();
+}
+
+/**
+ * Checks the values of a case of one p_formula at its points.
+ *
+ * @param label     Names the case in the report.
+ * @param c         The case.
+ * @param tally     Records the checks.
+ */
+void check_formula_case(const std::string& label, const yaml_node& c, case_tally& tally)
+{
+    const yaml_node *p_values = c.get("expected")->get("values");
+    if (!p_values || p_values->is_null())
+        return;
+
+    isl_ctx *p_ctx = isl_ctx_alloc();
+    isl_pw_qpolynomial *p_formula = isl_pw_qpolynomial_read_from_str(p_ctx, c.get("p_formula")->scalar.c_str());
+    // Lowers the formula once for every point.
+    std::unique_ptr<NativeEvaluator> p_native;
+    std::string native_error = "cannot read the formula";
+    if (p_formula)
+    {
+        try
+        {
+            p_native.reset(new NativeEvaluator(p_formula));
+        }
+        catch (const std::exception& e)
+        {
+            native_error = e.what();
+        }
+    }
+
+    for (const yaml_node& entry : p_values->items)
+    {
+        const yaml_node *p_at = entry.get("at");
+        const yaml_node *p_value = entry.get("value");
+        if (!p_at || !p_value)
+        {
+            tally.failed++;
+            std::cout << "FAIL " << label << "\t| a value needs at and value" << std::endl;
+            continue;
+        }
+        std::string at;
+        for (const yaml_node& coord : p_at->items)
+            at += (at.empty() ? "" : ", ") + coord.scalar;
+
+        tally.check(label + " native at [" + at + "]", p_value->scalar, [&]() {
+            if (!p_native)
+                throw std::runtime_error(native_error);
+            return real_repr((*p_native)(read_point(*p_at)));
+        });
+        tally.check(label + " isl at [" + at + "]", p_value->scalar, [&]() {
+            if (!p_formula)
+                throw std::runtime_error("cannot read the formula");
+            std::vector<long> coords = read_point(*p_at);
+            isl_size n_param = isl_pw_qpolynomial_dim(p_formula, isl_dim_param);
+            if (coords.size() != (std::size_t) (n_param + isl_pw_qpolynomial_dim(p_formula, isl_dim_in)))
+                throw std::invalid_argument("point does not match the formula");
+            isl_point *p_point = isl_point_zero(isl_pw_qpolynomial_get_domain_space(p_formula));
+            for (std::size_t i = 0; i < coords.size(); i++)
+            {
+                bool is_param = (isl_size) i < n_param;
+                p_point = isl_point_set_coordinate_val(
+                    p_point, is_param ? isl_dim_param : isl_dim_set, is_param ? i : i - n_param,
+                    isl_val_int_from_si(p_ctx, coords[i])
+                );
+            }
+            return val_to_exact(isl_pw_qpolynomial_eval(isl_pw_qpolynomial_copy(p_formula), p_point))->repr;
+        });
+    }
+
+    p_native.reset();
+    isl_pw_qpolynomial_free(p_formula);
+    isl_ctx_free(p_ctx);
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+        paths.push_back(argv[i]);
+    if (paths.empty())
+        paths.push_back("test_cases.yaml");
+
+    case_tally tally;
+    CaseReader reader;
+    for (const std::string& path : paths)
+    {
+        yaml_node cases;
+        try
+        {
+            cases = reader.read(path);
+        }
+        catch (const std::invalid_argument& e)
+        {
+            std::cerr << path << ": " << e.what() << std::endl;
+            return 1;
+        }
+        if (cases.type != yaml_node::kind::sequence)
+        {
+            std::cerr << path << ": expected a list of cases" << std::endl;
+            return 1;
+        }
+
+        for (std::size_t n = 0; n < cases.items.size(); n++)
+        {
+            const yaml_node& c = cases.items[n];
+            const std::string label = path + " #" + std::to_string(n);
+            const yaml_node *p_expected = c.get("expected");
+            if (c.get("p_formula") && p_expected)
+                check_formula_case(label, c, tally);
+            else if (!(c.get("p_src") && c.get("p_dst") && c.get("p_dist") && p_expected))
+            {
+                tally.failed++;
+                std::cout << "FAIL " << label << "\t| unknown case layout" << std::endl;
+            }
+            else if (p_expected->get("tensor_jumps") || p_expected->get("byte_jumps"))
+                check_joint_case(label, c, tally);
+            else
+                check_map_case(label, c, tally);
+        }
+    }
+
+    std::cout << "passed: " << tally.passed << "\t| failed: " << tally.failed << std::endl;
+    return tally.failed == 0 ? 0 : 1;
+}
@@ -1,5 +1,8 @@
+#include "latency.hpp"
 #include "tile.hpp"
 
+// Builds the demo driver unless compiled into the library.
+#ifndef POLYDELIVERY_LIBRARY
 int main(int argc, char const *argv[])
 {
     /** NECESSARY FOR THE LANGUAGE'S GLOBAL ENVIRONMENT **/
@@ -42,6 +45,29 @@ int main(int argc, char const *argv[])
     // Dumps out combined result.
     isl_map_dump(src_occ);
 
+    /** PROGRAMMATIC GENERATION WITH THE MAPPING BUILDER **/
+    // Holds data in 8-long blocks along xs, broadcast over ys.
+    isl_space *mapping_space = isl_map_get_space(src_occ);
+    isl_basic_map *mapping = compose_mapping(isl_space_copy(mapping_space), {
+        bound(isl_space_copy(mapping_space), isl_dim_out, {16}),
+        block_tile(0, isl_space_copy(mapping_space), 8, 0),
+        broadcast(isl_space_copy(mapping_space), 1, 2)
+    });
+    isl_basic_map_dump(mapping);
+    // Splits 8-long blocks along ys into 4-long blocks along xs.
+    isl_basic_map *nested = subtile(0, isl_space_copy(mapping_space), {{1, 8}, {0, 4}});
+    isl_basic_map_dump(nested);
+    // Deals the data round robin over xs instead.
+    isl_basic_map *cyclic = cyclic_tile(0, mapping_space, 2, 0);
+    isl_basic_map_dump(cyclic);
+    // Replicates the mapping twice more along xs.
+    isl_map *replicated = replicate(isl_map_from_basic_map(mapping), 3, 0);
+    isl_map_dump(replicated);
+
+    isl_basic_map_free(nested);
+    isl_basic_map_free(cyclic);
+    isl_map_free(replicated);
+
     // Frees variables not already handled by __isl_take input params.
     isl_map_free(src_occ);
     isl_map_free(dst_fill);
@@ -52,6 +78,27 @@ int main(int argc, char const *argv[])
 
     return 0;
 }
+#endif
+
+/**
+ * Puts back the tuple names of a space, which isl_space_add_dims drops, once
+ * the dims added to a feature are projected out again.
+ *
+ * @param feature   __isl_take  The feature to rename.
+ * @param space     __isl_keep  The space holding the tuple names.
+ */
+isl_basic_map *restore_tuple_ids(
+    isl_basic_map *feature,
+    isl_space *space
+) {
+    for (isl_dim_type type : {isl_dim_in, isl_dim_out})
+    {
+        if (isl_space_has_tuple_id(space, type) == isl_bool_true)
+            feature = isl_basic_map_set_tuple_id(feature, type, isl_space_get_tuple_id(space, type));
+    }
+
+    return feature;
+}
 
 /**
  * Creates an ISL set that restricts the data domain to a tiling split along a
@@ -70,6 +117,24 @@ isl_map *tile(
     isl_space *src_space,
     int n, 
     int axis_dim
+) {
+    // Returns the tiling restriction
+    return isl_map_from_basic_map(block_tile(data_dim, src_space, n, axis_dim));
+}
+
+/**
+ * Creates the single basic map behind tile(), i.e. n*axis <= data < n*axis + n.
+ * 
+ * @param data_dim  __isl_keep  The data axis index.
+ * @param src_space __isl_take  The space in which the axis is defined.
+ * @param n         __isl_keep  The number of elements in a block.
+ * @param axis_dim  __isl_keep  The axis index to tile along.
+ */
+isl_basic_map *block_tile(
+    int data_dim,
+    isl_space *src_space,
+    int n, 
+    int axis_dim
 ) {
     // Allocates local space for the tiling restriction.
     isl_local_space *tile_local_space = isl_local_space_from_space(src_space);
@@ -88,8 +153,198 @@ isl_map *tile(
     isl_basic_map *tile = isl_basic_map_from_constraint(tile_lower);
     tile = isl_basic_map_add_constraint(tile, tile_upper);
 
-    // Returns the tiling restriction
-    return isl_map_from_basic_map(tile);
+    return tile;
+}
+
+/**
+ * Creates an ISL set that deals the data domain out round robin along a
+ * certain axis.
+ * 
+ * Read as: Element data of the data axis in position data_dim goes to
+ * position data mod n along src axis axis_dim.
+ * 
+ * @param data_dim  __isl_keep  The data axis index.
+ * @param src_space __isl_take  The space in which the axis is defined.
+ * @param n         __isl_keep  The number of positions dealt over.
+ * @param axis_dim  __isl_keep  The axis index to deal along.
+ */
+isl_basic_map *cyclic_tile(
+    int data_dim,
+    isl_space *src_space,
+    int n, 
+    int axis_dim
+) {
+    // Adds the round k as an extra data dim, projected out afterwards.
+    int n_out = isl_space_dim(src_space, isl_dim_out);
+    isl_basic_map *cyclic = isl_basic_map_universe(
+        isl_space_add_dims(isl_space_copy(src_space), isl_dim_out, 1)
+    );
+
+    // Creates data = axis + n*k (equiv. to data - axis - n*k = 0)
+    cyclic = add_affine_constraint(cyclic, {
+        {isl_dim_out, data_dim, 1}, {isl_dim_in, axis_dim, -1}, {isl_dim_out, n_out, -n}
+    }, 0, true);
+    // Creates 0 <= axis < n such that axis is data mod n.
+    cyclic = add_affine_constraint(cyclic, {{isl_dim_in, axis_dim, 1}}, 0, false);
+    cyclic = add_affine_constraint(cyclic, {{isl_dim_in, axis_dim, -1}}, n - 1, false);
+
+    // Makes k existential.
+    cyclic = isl_basic_map_project_out(cyclic, isl_dim_out, n_out, 1);
+    cyclic = restore_tuple_ids(cyclic, src_space);
+    isl_space_free(src_space);
+
+    return cyclic;
+}
+
+/**
+ * Creates an ISL set that restricts the data domain to a window whose offset
+ * is affine in several axes, e.g. the input rows h = p + r of a convolution.
+ * 
+ * Read as: data in position data_dim lies in [offset, offset + extent), with
+ * offset = sum coefficient_i * axis_i over the given terms.
+ * 
+ * @param data_dim  __isl_keep  The data axis index.
+ * @param src_space __isl_take  The space in which the axes are defined.
+ * @param terms     __isl_keep  The (axis index, coefficient) per axis.
+ * @param extent    __isl_keep  The window size.
+ */
+isl_basic_map *affine_tile(
+    int data_dim,
+    isl_space *src_space,
+    const std::vector<std::pair<int, int>>& terms,
+    int extent
+) {
+    // Collects the offset of the window.
+    std::vector<std::tuple<isl_dim_type, int, long>> lower({{isl_dim_out, data_dim, 1}});
+    std::vector<std::tuple<isl_dim_type, int, long>> upper({{isl_dim_out, data_dim, -1}});
+    for (const auto& [axis_dim, coefficient] : terms)
+    {
+        lower.emplace_back(isl_dim_in, axis_dim, -coefficient);
+        upper.emplace_back(isl_dim_in, axis_dim, coefficient);
+    }
+
+    isl_basic_map *window = isl_basic_map_universe(src_space);
+    // Creates offset <= data (equiv. to data - offset >= 0)
+    window = add_affine_constraint(window, lower, 0, false);
+    // Creates offset + extent > data (equiv. to offset + extent - data - 1 >= 0)
+    window = add_affine_constraint(window, upper, extent - 1, false);
+
+    return window;
+}
+
+/**
+ * Creates an ISL set that restricts the data domain to nested tiles, every
+ * level splitting the tile of the level above.
+ * 
+ * Read as: For levels (axis_0, n_0), ..., (axis_k, n_k), data in position
+ * data_dim lies in [sum n_i*axis_i, sum n_i*axis_i + n_k), i.e. the n_k-long
+ * block axis_k inside the n_(k-1)-long block axis_(k-1), and so on. Every
+ * inner axis is bounded by 0 <= axis_k < n_(k-1)/n_k so its blocks stay
+ * inside the block above.
+ * 
+ * @param data_dim  __isl_keep  The data axis index.
+ * @param src_space __isl_take  The space in which the axes are defined.
+ * @param levels    __isl_keep  The (axis index, block size) per level, outer
+ *                              level first.
+ * @throw std::invalid_argument if there are no levels or a block size does
+ *                              not divide the one above.
+ */
+isl_basic_map *subtile(
+    int data_dim,
+    isl_space *src_space,
+    const std::vector<std::pair<int, int>>& levels
+) {
+    if (levels.empty())
+    {
+        isl_space_free(src_space);
+        throw std::invalid_argument("subtile needs at least one level");
+    }
+    for (std::size_t k = 1; k < levels.size(); k++)
+    {
+        int outer = levels[k - 1].second, inner = levels[k].second;
+        if (inner <= 0 || outer % inner != 0)
+        {
+            isl_space_free(src_space);
+            throw std::invalid_argument("subtile block of " + std::to_string(inner)
+                + " does not divide the block of " + std::to_string(outer) + " above");
+        }
+    }
+
+    // The innermost block size is the window, offset by every level.
+    isl_basic_map *nested = affine_tile(data_dim, src_space, levels, levels.back().second);
+    // Keeps every inner block inside the block above.
+    for (std::size_t k = 1; k < levels.size(); k++)
+    {
+        int axis_dim = levels[k].first;
+        nested = add_affine_constraint(nested, {{isl_dim_in, axis_dim, 1}}, 0, false);
+        nested = add_affine_constraint(nested, {{isl_dim_in, axis_dim, -1}},
+            levels[k - 1].second / levels[k].second - 1, false);
+    }
+
+    return nested;
+}
+
+/**
+ * Creates an ISL set that lets every position along a certain axis hold the
+ * same data, i.e. bounds the axis without tying it to the data.
+ * 
+ * @param src_space __isl_take  The space in which the axis is defined.
+ * @param axis_dim  __isl_keep  The axis index to broadcast along.
+ * @param extent    __isl_keep  The number of positions along the axis.
+ */
+isl_basic_map *broadcast(
+    isl_space *src_space,
+    int axis_dim,
+    int extent
+) {
+    // Leaves every other src axis unbounded.
+    std::vector<int> extents(axis_dim + 1, 0);
+    extents[axis_dim] = extent;
+
+    return bound(src_space, isl_dim_in, extents);
+}
+
+/**
+ * Creates an ISL set that bounds every axis of one side, i.e.
+ * 0 <= axis_i < extents[i]. An extent of 0 leaves the axis unbounded.
+ * 
+ * @param src_space __isl_take  The space in which the axes are defined.
+ * @param type      __isl_keep  isl_dim_in for the src, isl_dim_out for data.
+ * @param extents   __isl_keep  The extent per axis.
+ */
+isl_basic_map *bound(
+    isl_space *src_space,
+    isl_dim_type type,
+    const std::vector<int>& extents
+) {
+    isl_basic_map *box = isl_basic_map_universe(src_space);
+    for (std::size_t i = 0; i < extents.size(); i++)
+    {
+        if (extents[i] <= 0)
+            continue;
+        box = add_affine_constraint(box, {{type, (int) i, 1}}, 0, false);
+        box = add_affine_constraint(box, {{type, (int) i, -1}}, extents[i] - 1, false);
+    }
+
+    return box;
+}
+
+/**
+ * Combines mapping features into one mapping without parsing, dropping
+ * redundant constraints such that it reaches lexmin simplified.
+ * 
+ * @param src_space __isl_take  The space of the mapping.
+ * @param features  __isl_take  The features to intersect.
+ */
+isl_basic_map *compose_mapping(
+    isl_space *src_space,
+    const std::vector<isl_basic_map *>& features
+) {
+    isl_basic_map *mapping = isl_basic_map_universe(src_space);
+    for (isl_basic_map *feature : features)
+        mapping = isl_basic_map_intersect(mapping, feature);
+
+    return isl_basic_map_remove_redundancies(mapping);
 }
 
 /**
@@ -97,16 +352,59 @@ isl_map *tile(
  * it over a certain axis.
  * 
  * Read as: Replicate the feature n times along the given src axis axis_dim.
+ * The replicas are placed back to back, each shifted by the extent of the
+ * feature along the axis.
  * 
  * @param feature  __isl_take   The binding feature to replicate.
  * @param n        __isl_keep   The number of times to replicate the feature.
  * @param axis_dim __isl_keep   The axis index to replicate along (assumed to be
  *                              an src axis index in the space of feature).
+ * @throw std::invalid_argument if the feature is unbounded or empty along the
+ *                              axis.
  */
 isl_map *replicate(
     isl_map *feature,
     int n,
     int axis_dim
 ) {
-    return nullptr;
-}
\ No newline at end of file
+    // Measures the extent of the feature along the axis.
+    isl_set *srcs = isl_map_domain(isl_map_copy(feature));
+    isl_val *max = isl_set_dim_max_val(isl_set_copy(srcs), axis_dim);
+    isl_val *min = isl_set_dim_min_val(srcs, axis_dim);
+    // An unbounded axis gives +-infinity and an empty feature NaN.
+    if (isl_val_is_int(max) != isl_bool_true || isl_val_is_int(min) != isl_bool_true)
+    {
+        isl_val_free(max);
+        isl_val_free(min);
+        isl_map_free(feature);
+        throw std::invalid_argument("replicate needs a feature bounded along axis "
+            + std::to_string(axis_dim));
+    }
+    long period = isl_val_get_num_si(max) - isl_val_get_num_si(min) + 1;
+    isl_val_free(max);
+    isl_val_free(min);
+
+    // Builds { src' -> src : src'_axis = src_axis + period*k, 0 <= k < n }
+    // with the replica k as an extra src dim, projected out afterwards.
+    isl_space *src_space = isl_space_domain(isl_map_get_space(feature));
+    int n_src = isl_space_dim(src_space, isl_dim_set);
+    isl_space *shift_space = isl_space_map_from_set(src_space);
+    isl_basic_map *shift = isl_basic_map_universe(isl_space_add_dims(
+        isl_space_copy(shift_space), isl_dim_out, 1
+    ));
+    for (int i = 0; i < n_src; i++)
+    {
+        long offset = i == axis_dim ? -period : 0;
+        shift = add_affine_constraint(shift, {
+            {isl_dim_in, i, 1}, {isl_dim_out, i, -1}, {isl_dim_out, n_src, offset}
+        }, 0, true);
+    }
+    shift = add_affine_constraint(shift, {{isl_dim_out, n_src, 1}}, 0, false);
+    shift = add_affine_constraint(shift, {{isl_dim_out, n_src, -1}}, n - 1, false);
+    shift = isl_basic_map_project_out(shift, isl_dim_out, n_src, 1);
+    shift = restore_tuple_ids(shift, shift_space);
+    isl_space_free(shift_space);
+
+    // Every replica holds what the feature holds at its unshifted position.
+    return isl_map_apply_range(isl_map_from_basic_map(shift), feature);
+}
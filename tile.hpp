@@ -1,6 +1,10 @@
+#pragma once
+
 #include <iostream>
 #include <string>
+#include <tuple>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <isl/aff.h>
@@ -20,4 +24,41 @@ isl_map *replicate(
     isl_map *feature,
     int n,
     int axis_dim
-);
\ No newline at end of file
+);
+isl_basic_map *block_tile(
+    int data_dim,
+    isl_space *src_space,
+    int n,
+    int axis_dim
+);
+isl_basic_map *cyclic_tile(
+    int data_dim,
+    isl_space *src_space,
+    int n,
+    int axis_dim
+);
+isl_basic_map *affine_tile(
+    int data_dim,
+    isl_space *src_space,
+    const std::vector<std::pair<int, int>>& terms,
+    int extent
+);
+isl_basic_map *subtile(
+    int data_dim,
+    isl_space *src_space,
+    const std::vector<std::pair<int, int>>& levels
+);
+isl_basic_map *broadcast(
+    isl_space *src_space,
+    int axis_dim,
+    int extent
+);
+isl_basic_map *bound(
+    isl_space *src_space,
+    isl_dim_type type,
+    const std::vector<int>& extents
+);
+isl_basic_map *compose_mapping(
+    isl_space *src_space,
+    const std::vector<isl_basic_map *>& features
+);
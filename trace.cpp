@@ -0,0 +1,512 @@
+/**
+ * Imports explicit (node, datum) occupancy tables, e.g. from traces or mapper
+ * tools, as compact isl_maps for src_occupancy and dst_fill.
+ *
+ * Rows are streamed through a run detector that folds consecutive blocks of
+ * the same shape whose bases advance by a fixed stride into a block with one
+ * more step, level by level. A row stream that walks an affine lattice, e.g.
+ * a tiling written out in loop order, thus collapses into a handful of
+ * affine images of boxes, each turned into one basic map through constraints.
+ * Blocks too small to be worth a disjunct stay behind as explicit rows.
+ */
+#include "latency.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <isl/constraint.h>
+#include <isl/local_space.h>
+
+/// @brief A row of the table: the node coords, then the datum coords.
+typedef std::vector<long> trace_point;
+
+/**
+ * @brief A set of rows as an affine image of a box, i.e. every
+ * base + sum_j i_j * steps[j] with 0 <= i_j < counts[j]. Steps are listed
+ * innermost first.
+ */
+struct lattice_block
+{
+    trace_point base;
+    std::vector<trace_point> steps;
+    std::vector<long> counts;
+
+    /// @brief The number of rows in the block.
+    long size() const
+    {
+        long size = 1;
+        for (long count : counts)
+            size *= count;
+        return size;
+    }
+
+    /// @brief Whether the block has the same steps and counts as another.
+    bool same_shape(const lattice_block& other) const
+    {
+        return steps == other.steps && counts == other.counts;
+    }
+};
+
+/// @brief The result of importing a table.
+struct trace_import_struct
+{
+    /// @brief The coalesced union of the blocks found, owned by the caller.
+    isl_map *const compressed;
+    /// @brief The rows left in blocks smaller than the import's min_block.
+    const std::vector<trace_point> leftovers;
+    /// @brief The number of rows read.
+    const long n_rows;
+    /// @brief The number of blocks in compressed before coalescing.
+    const long n_blocks;
+};
+typedef std::unique_ptr<trace_import_struct> trace_import;
+
+/**
+ * @brief Streams the rows of a table into blocks, then into a coalesced map.
+ * Memory is bounded by the open runs, one per level, plus the leftovers.
+ */
+class TraceCompressor
+{
+    public:
+        /// @brief The number of node coords per row.
+        const int n_node;
+        /// @brief The number of datum coords per row.
+        const int n_data;
+        /// @brief The smallest block kept as a disjunct.
+        const long min_block;
+        /// @brief The context the maps are built in.
+        isl_ctx *const ctx;
+    private:
+        /// @brief A run being detected at one level.
+        struct run_state
+        {
+            bool open = false;
+            lattice_block first;
+            trace_point stride;
+            long count = 0;
+        };
+
+        /// @brief The tuple names of the nodes and the data, or "" for none.
+        const std::string node_tuple, data_tuple;
+        /// @brief One open run per level; a block gains a step per level.
+        std::vector<run_state> levels;
+        /// @brief The union of the blocks emitted so far.
+        isl_map *p_compressed;
+        std::vector<trace_point> leftovers;
+        long n_rows = 0;
+        long n_blocks = 0;
+        /// @brief The blocks unioned into p_compressed since the last coalesce.
+        long n_uncoalesced = 0;
+    public:
+        /**
+         * @brief Constructs an empty compressor.
+         *
+         * @param n_node        The number of node coords per row.
+         * @param n_data        The number of datum coords per row.
+         * @param node_tuple    The tuple name of the nodes, e.g. "src".
+         * @param data_tuple    The tuple name of the data, e.g. "data".
+         * @param min_block     Blocks with fewer rows stay explicit.
+         * @param ctx           The context the maps are built in.
+         */
+        TraceCompressor(
+            int n_node, int n_data, const std::string& node_tuple,
+            const std::string& data_tuple, long min_block, isl_ctx *const ctx
+        ):
+        n_node(n_node), n_data(n_data), min_block(min_block), ctx(ctx),
+        node_tuple(node_tuple), data_tuple(data_tuple), levels(n_node + n_data),
+        p_compressed(isl_map_empty(this->space())) {}
+
+        ~TraceCompressor()
+        {
+            isl_map_free(p_compressed);
+        }
+
+        /// @brief Adds the next row of the table.
+        void push(const trace_point& row)
+        {
+            if (row.size() != (size_t) (n_node + n_data))
+                throw std::invalid_argument("row " + std::to_string(n_rows) + " has the wrong width");
+            n_rows++;
+            this->push_at(0, lattice_block{row, {}, {}});
+        }
+
+        /**
+         * @brief Flushes the open runs and hands the result over. The
+         * compressor is empty afterwards.
+         */
+        trace_import finish()
+        {
+            for (size_t level = 0; level < levels.size(); level++)
+                this->close_at(level);
+            isl_map *p_result = isl_map_coalesce(p_compressed);
+            p_compressed = isl_map_empty(this->space());
+
+            trace_import result = trace_import(new trace_import_struct{
+                p_result, std::move(leftovers), n_rows, n_blocks
+            });
+            leftovers.clear();
+            n_rows = n_blocks = n_uncoalesced = 0;
+
+            return result;
+        }
+
+        /**
+         * @brief Builds the basic map of a block, projecting the box
+         * coordinates i_j out as existentials.
+         */
+        __isl_give isl_basic_map *block_to_basic_map(const lattice_block& block) const
+        {
+            int n_steps = block.steps.size();
+            isl_basic_map *p_block = isl_basic_map_universe(
+                isl_space_alloc(ctx, 0, n_node, n_data + n_steps)
+            );
+            // Creates coord - sum_j step_j * i_j - base = 0 per coord.
+            for (int m = 0; m < n_node + n_data; m++)
+            {
+                std::vector<std::tuple<isl_dim_type, int, long>> terms({
+                    m < n_node ? std::make_tuple(isl_dim_in, m, 1L)
+                               : std::make_tuple(isl_dim_out, m - n_node, 1L)
+                });
+                for (int j = 0; j < n_steps; j++)
+                {
+                    if (block.steps[j][m] != 0)
+                        terms.emplace_back(isl_dim_out, n_data + j, -block.steps[j][m]);
+                }
+                p_block = add_affine_constraint(p_block, terms, -block.base[m], true);
+            }
+            // Creates 0 <= i_j < count_j per step.
+            for (int j = 0; j < n_steps; j++)
+            {
+                p_block = add_affine_constraint(p_block, {{isl_dim_out, n_data + j, 1}}, 0, false);
+                p_block = add_affine_constraint(
+                    p_block, {{isl_dim_out, n_data + j, -1}}, block.counts[j] - 1, false
+                );
+            }
+            p_block = isl_basic_map_project_out(p_block, isl_dim_out, n_data, n_steps);
+
+            return this->name(p_block);
+        }
+    private:
+        /// @brief The [node] -> [data] space of the table.
+        __isl_give isl_space *space() const
+        {
+            isl_space *p_space = isl_space_alloc(ctx, 0, n_node, n_data);
+            if (!node_tuple.empty())
+                p_space = isl_space_set_tuple_name(p_space, isl_dim_in, node_tuple.c_str());
+            if (!data_tuple.empty())
+                p_space = isl_space_set_tuple_name(p_space, isl_dim_out, data_tuple.c_str());
+            return p_space;
+        }
+
+        /// @brief Puts the tuple names back after the dims were changed.
+        __isl_give isl_basic_map *name(__isl_take isl_basic_map *p_block) const
+        {
+            if (!node_tuple.empty())
+                p_block = isl_basic_map_set_tuple_name(p_block, isl_dim_in, node_tuple.c_str());
+            if (!data_tuple.empty())
+                p_block = isl_basic_map_set_tuple_name(p_block, isl_dim_out, data_tuple.c_str());
+            return p_block;
+        }
+
+        /**
+         * @brief Extends the open run at a level with a block, or closes the
+         * run and opens a new one with the block.
+         */
+        void push_at(size_t level, lattice_block block)
+        {
+            if (level == levels.size())
+            {
+                this->emit(block);
+                return;
+            }
+
+            run_state& run = levels[level];
+            if (run.open && run.first.same_shape(block))
+            {
+                trace_point diff(block.base.size());
+                bool moved = false;
+                for (size_t m = 0; m < diff.size(); m++)
+                {
+                    diff[m] = block.base[m] - run.first.base[m];
+                    moved = moved || diff[m] != 0;
+                }
+                // Starts a run on the second block.
+                if (run.count == 1 && moved)
+                {
+                    run.stride = diff;
+                    run.count = 2;
+                    return;
+                }
+                // Extends the run if the block is the next along the stride.
+                bool next = run.count >= 2;
+                for (size_t m = 0; next && m < diff.size(); m++)
+                    next = diff[m] == run.stride[m] * run.count;
+                if (next)
+                {
+                    run.count++;
+                    return;
+                }
+            }
+
+            this->close_at(level);
+            run.first = std::move(block);
+            run.count = 1;
+            run.open = true;
+        }
+
+        /// @brief Hands the open run at a level up as one block.
+        void close_at(size_t level)
+        {
+            run_state& run = levels[level];
+            if (!run.open)
+                return;
+            run.open = false;
+
+            lattice_block block = std::move(run.first);
+            if (run.count >= 2)
+            {
+                block.steps.push_back(run.stride);
+                block.counts.push_back(run.count);
+            }
+            this->push_at(level + 1, std::move(block));
+        }
+
+        /// @brief Adds a finished block to the map, or its rows to the leftovers.
+        void emit(const lattice_block& block)
+        {
+            if (block.size() < min_block)
+            {
+                this->expand(block, 0, block.base);
+                return;
+            }
+
+            p_compressed = isl_map_union(
+                p_compressed, isl_map_from_basic_map(this->block_to_basic_map(block))
+            );
+            n_blocks++;
+            // Keeps the union small while streaming.
+            if (++n_uncoalesced == 64)
+            {
+                p_compressed = isl_map_coalesce(p_compressed);
+                n_uncoalesced = 0;
+            }
+        }
+
+        /// @brief Writes out every row of a block, outermost step first.
+        void expand(const lattice_block& block, size_t depth, trace_point row)
+        {
+            if (depth == block.steps.size())
+            {
+                leftovers.push_back(row);
+                return;
+            }
+            const size_t j = block.steps.size() - 1 - depth;
+            for (long i = 0; i < block.counts[j]; i++)
+            {
+                this->expand(block, depth + 1, row);
+                for (size_t m = 0; m < row.size(); m++)
+                    row[m] += block.steps[j][m];
+            }
+        }
+};
+
+/**
+ * Streams a CSV table of rows "node..., datum..." into a compressor. Empty
+ * lines, comments starting with '#', and header lines are skipped.
+ *
+ * @param in            The stream to read.
+ * @param compressor    The compressor to feed.
+ *
+ * @return The number of rows read.
+ * @throw std::invalid_argument if a row has too few or too many columns.
+ */
+long read_csv_trace(std::istream& in, TraceCompressor& compressor)
+{
+    const size_t width = compressor.n_node + compressor.n_data;
+    trace_point row(width);
+    std::string line;
+    long n_read = 0;
+    for (long line_no = 1; std::getline(in, line); line_no++)
+    {
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || !(isdigit(line[start]) || line[start] == '-'))
+            continue;
+
+        const char *p_cursor = line.c_str() + start;
+        for (size_t m = 0; m < width; m++)
+        {
+            char *p_end;
+            row[m] = strtol(p_cursor, &p_end, 10);
+            if (p_end == p_cursor)
+                throw std::invalid_argument("line " + std::to_string(line_no) + " has too few columns");
+            p_cursor = p_end;
+            while (*p_cursor == ',' || *p_cursor == ' ' || *p_cursor == '\t' || *p_cursor == '\r')
+                p_cursor++;
+        }
+        if (*p_cursor)
+            throw std::invalid_argument("line " + std::to_string(line_no) + " has too many columns");
+        compressor.push(row);
+        n_read++;
+    }
+
+    return n_read;
+}
+
+/**
+ * Streams a binary table of little endian int64 rows "node..., datum..." into
+ * a compressor, a chunk of rows at a time. The values are decoded byte by
+ * byte, so the host may be of either endianness.
+ *
+ * @param in            The stream to read.
+ * @param compressor    The compressor to feed.
+ *
+ * @return The number of rows read.
+ * @throw std::invalid_argument if the table ends within a row.
+ */
+long read_binary_trace(std::istream& in, TraceCompressor& compressor)
+{
+    const size_t width = compressor.n_node + compressor.n_data;
+    const size_t row_bytes = width * sizeof(int64_t);
+    const size_t chunk_rows = 4096;
+    std::vector<unsigned char> chunk(chunk_rows * row_bytes);
+    trace_point row(width);
+    long n_read = 0;
+    while (in)
+    {
+        in.read(reinterpret_cast<char*>(chunk.data()), chunk.size());
+        const size_t n_bytes = in.gcount();
+        if (n_bytes % row_bytes != 0)
+        {
+            throw std::invalid_argument("the table ends " + std::to_string(n_bytes % row_bytes) +
+                                        " bytes into row " + std::to_string(n_read + n_bytes / row_bytes));
+        }
+        const size_t n_chunk = n_bytes / row_bytes;
+        for (size_t r = 0; r < n_chunk; r++)
+        {
+            for (size_t m = 0; m < width; m++)
+            {
+                const unsigned char *p_bytes = chunk.data() + r * row_bytes + m * sizeof(int64_t);
+                uint64_t value = 0;
+                for (int b = sizeof(int64_t) - 1; b >= 0; b--)
+                    value = value << 8 | p_bytes[b];
+                row[m] = static_cast<int64_t>(value);
+            }
+            compressor.push(row);
+        }
+        n_read += n_chunk;
+    }
+
+    return n_read;
+}
+
+/**
+ * Imports a table file, read as CSV if its name ends in .csv and as binary
+ * otherwise.
+ *
+ * @param ctx           The context to build the map in.
+ * @param path          The table file.
+ * @param n_node        The number of node coords per row.
+ * @param n_data        The number of datum coords per row.
+ * @param node_tuple    The tuple name of the nodes, e.g. "src".
+ * @param data_tuple    The tuple name of the data, e.g. "data".
+ * @param min_block     Blocks with fewer rows stay explicit.
+ */
+trace_import import_trace(
+    isl_ctx *const ctx, const std::string& path, int n_node, int n_data,
+    const std::string& node_tuple = "", const std::string& data_tuple = "",
+    long min_block = 4
+) {
+    const bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+    std::ifstream in(path, csv ? std::ios::in : std::ios::in | std::ios::binary);
+    if (!in)
+        throw std::invalid_argument("cannot open " + path);
+
+    TraceCompressor compressor(n_node, n_data, node_tuple, data_tuple, min_block, ctx);
+    if (csv)
+        read_csv_trace(in, compressor);
+    else
+        read_binary_trace(in, compressor);
+
+    return compressor.finish();
+}
+
+/**
+ * Materializes an import as a single map, adding the leftovers as points, for
+ * the analyses that take src_occupancy/dst_fill maps.
+ *
+ * @param import    The import to materialize.
+ */
+__isl_give isl_map *trace_to_map(const trace_import& import)
+{
+    isl_ctx *p_ctx = isl_map_get_ctx(import->compressed);
+    isl_size n_node = isl_map_dim(import->compressed, isl_dim_in);
+    isl_size n_data = isl_map_dim(import->compressed, isl_dim_out);
+    const char *s_node = isl_map_get_tuple_name(import->compressed, isl_dim_in);
+    const char *s_data = isl_map_get_tuple_name(import->compressed, isl_dim_out);
+    TraceCompressor points(n_node, n_data, s_node ? s_node : "", s_data ? s_data : "", 1, p_ctx);
+
+    isl_map *p_map = isl_map_copy(import->compressed);
+    for (const trace_point& row : import->leftovers)
+    {
+        p_map = isl_map_union(p_map, isl_map_from_basic_map(
+            points.block_to_basic_map(lattice_block{row, {}, {}})
+        ));
+    }
+
+    return isl_map_coalesce(p_map);
+}
+
+// Builds the demo driver unless compiled into the library.
+#ifndef POLYDELIVERY_LIBRARY
+int main(int argc, char* argv[])
+{
+    isl_ctx *p_ctx = isl_ctx_alloc();
+
+    // Imports a table file if given as: trace <file> <n_node> <n_data>.
+    if (argc == 4)
+    {
+        trace_import import = import_trace(p_ctx, argv[1], atoi(argv[2]), atoi(argv[3]));
+        std::cout << "rows: " << import->n_rows << " | blocks: " << import->n_blocks
+                  << " | leftovers: " << import->leftovers.size() << std::endl;
+        isl_map_dump(import->compressed);
+        isl_map_free(import->compressed);
+        isl_ctx_free(p_ctx);
+        return 0;
+    }
+
+    // Writes out the src occupancy of the meshcast demo as a table.
+    const long M = 16, N = 16, D = 4;
+    std::stringstream table;
+    table << "xs,ys,a,b" << std::endl;
+    for (long xs = 0; xs < M; xs++)
+        for (long ys = 0; ys < N; ys++)
+            for (long a = D * xs; a < D * xs + D; a++)
+                table << xs << "," << ys << "," << a % M << "," << ys << std::endl;
+    // Adds a few stray rows that fit no run.
+    table << "3,5,7,1" << std::endl << "0,9,2,4" << std::endl;
+
+    TraceCompressor compressor(2, 2, "src", "data", 4, p_ctx);
+    read_csv_trace(table, compressor);
+    trace_import import = compressor.finish();
+    std::cout << "rows: " << import->n_rows << " | blocks: " << import->n_blocks
+              << " | leftovers: " << import->leftovers.size() << std::endl;
+    DUMP(import->compressed);
+
+    isl_map *p_src_occupancy = trace_to_map(import);
+    DUMP(p_src_occupancy);
+
+    isl_map_free(p_src_occupancy);
+    isl_map_free(import->compressed);
+    isl_ctx_free(p_ctx);
+
+    return 0;
+}
+#endif
@@ -0,0 +1,42 @@
+/**
+ * Benchmarks the analyses on the DNN layer workloads of workloads.hpp.
+ *
+ * Usage: workloads [mesh_x mesh_y [scale]]
+ */
+// Builds in the tile builders and the analyses without their demo mains.
+#define POLYDELIVERY_LIBRARY
+#include "tile.cpp"
+#include "latency.cpp"
+#include "meshcast.cpp"
+#include "workloads.hpp"
+
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+
+int main(int argc, char* argv[])
+{
+    const mesh_shape mesh{argc > 2 ? atoi(argv[1]) : 8, argc > 2 ? atoi(argv[2]) : 8};
+    const int scale = argc > 3 ? atoi(argv[3]) : 4;
+    isl_ctx *p_ctx = isl_ctx_alloc();
+    MetricCache metrics(p_ctx);
+
+    std::string dist_func = metric_str<Manhattan<2>>(metrics, "dst", "src");
+    for (const workload& w : standard_workloads(p_ctx, mesh, scale))
+    {
+        clock_t start = clock();
+        long jumps = analyze_jumps(w->src_occupancy, w->dst_fill, dist_func);
+        long latency = analyze_latency(w->src_occupancy, w->dst_fill, dist_func);
+        isl_map *p_networks = identify_mesh_casts(p_ctx, w->src_occupancy, w->dst_fill, dist_func);
+        long multicast = cost_mesh_cast(p_networks, isl_map_read_from_str(p_ctx, dist_func.c_str()));
+        double cpu_time_used = ((double) (clock() - start)) / CLOCKS_PER_SEC;
+
+        std::cout << w->name << "\t| jumps: " << jumps << "\t| latency: " << latency
+                  << "\t| multicast: " << multicast << "\t| time: " << cpu_time_used << std::endl;
+    }
+
+    metrics.clear();
+    isl_ctx_free(p_ctx);
+
+    return 0;
+}
@@ -0,0 +1,359 @@
+#pragma once
+
+#include "tile.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <isl/map.h>
+#include <isl/space.h>
+
+/**
+ * Generates the delivery problems of DNN layers mapped onto a mesh of PEs, as
+ * src_occupancy/dst_fill pairs for the analyses.
+ *
+ * Every tensor has a home layout, its first dim blocked over the mesh x axis
+ * and its second over the y axis. The operands of a layer are delivered from
+ * their home to the layout the dataflow needs, and the results from the PEs
+ * producing them back home.
+ *
+ * Where a dataflow splits the reduction over the mesh (WS and RS), a result is
+ * held as partial sums by a whole row or column of PEs. That is modeled as if
+ * each of those PEs held a full copy: every home node fetches the result from
+ * the nearest one, a one-to-many delivery that ignores the partial sums that
+ * have to be combined first. The workloads benchmark prices that delivery with
+ * the 2-D cost_mesh_cast, so its result deliveries are a lower bound;
+ * analyze_reduction of meshcast.cpp costs the many-to-one reduction itself.
+ */
+
+/// @brief Which tensor stays put in the PEs while a layer computes.
+enum class dataflow
+{
+    /// @brief The weights are tiled over the mesh; inputs stream past them.
+    weight_stationary,
+    /// @brief The outputs are tiled over the mesh; operands stream in.
+    output_stationary,
+    /// @brief Rows stay put: filter rows along x and output rows along y for
+    /// a convolution, rows of the left operand for a GEMM.
+    row_stationary
+};
+
+/// @brief A mesh of x by y PEs.
+struct mesh_shape
+{
+    const int x;
+    const int y;
+};
+
+/// @brief One delivery problem of a layer.
+struct workload_struct
+{
+    /// @brief The layer, dataflow and tensor, e.g. "gemm/ws/A".
+    const std::string name;
+    /// @brief src[xs, ys] -> data[...] as an ISL string.
+    const std::string src_occupancy;
+    /// @brief dst[xd, yd] -> data[...] as an ISL string.
+    const std::string dst_fill;
+};
+typedef std::unique_ptr<workload_struct> workload;
+
+/// @brief The short name of a dataflow.
+std::string dataflow_name(dataflow flow)
+{
+    switch (flow)
+    {
+        case dataflow::weight_stationary:
+            return "ws";
+        case dataflow::output_stationary:
+            return "os";
+        case dataflow::row_stationary:
+        default:
+            return "rs";
+    }
+}
+
+/// @brief The block size splitting extent over parts.
+int block_size(int extent, int parts)
+{
+    return (extent + parts - 1) / parts;
+}
+
+/**
+ * @brief The node[x, y] -> data[d0, d1] space of a layout.
+ *
+ * @param ctx           The context to create the space in.
+ * @param node_tuple    "src" or "dst".
+ */
+__isl_give isl_space *mesh_space(isl_ctx *ctx, const std::string& node_tuple)
+{
+    isl_space *p_space = isl_space_alloc(ctx, 0, 2, 2);
+    p_space = isl_space_set_tuple_name(p_space, isl_dim_in, node_tuple.c_str());
+    return isl_space_set_tuple_name(p_space, isl_dim_out, "data");
+}
+
+/**
+ * Lays a tensor out over the mesh from the tile features.
+ *
+ * @param ctx           The context to build the layout in.
+ * @param node_tuple    "src" or "dst".
+ * @param mesh          The mesh, bounding the nodes.
+ * @param extents       The tensor extents, bounding the data.
+ * @param features      __isl_take The tile features of the layout.
+ *
+ * @return The layout as an ISL string.
+ */
+std::string layout(
+    isl_ctx *ctx, const std::string& node_tuple, const mesh_shape& mesh,
+    const std::vector<int>& extents, std::vector<isl_basic_map *> features
+) {
+    features.push_back(bound(mesh_space(ctx, node_tuple), isl_dim_in, {mesh.x, mesh.y}));
+    features.push_back(bound(mesh_space(ctx, node_tuple), isl_dim_out, extents));
+    isl_basic_map *p_layout = compose_mapping(mesh_space(ctx, node_tuple), features);
+
+    char *s_layout = isl_basic_map_to_str(p_layout);
+    std::string ret(s_layout);
+    free(s_layout);
+    isl_basic_map_free(p_layout);
+
+    return ret;
+}
+
+/// @brief Lays a tensor out at home, first dim over x and second over y.
+std::string home_layout(
+    isl_ctx *ctx, const std::string& node_tuple, const mesh_shape& mesh,
+    const std::vector<int>& extents
+) {
+    return layout(ctx, node_tuple, mesh, extents, {
+        block_tile(0, mesh_space(ctx, node_tuple), block_size(extents[0], mesh.x), 0),
+        block_tile(1, mesh_space(ctx, node_tuple), block_size(extents[1], mesh.y), 1)
+    });
+}
+
+/**
+ * Generates the deliveries of C[m, n] = A[m, k] * B[k, n].
+ *
+ * @param ctx       The context to build the layouts in.
+ * @param layer     The layer name, prefixing the workload names.
+ * @param tensors   The names of A, B and C.
+ * @param M, N, K   The GEMM extents.
+ * @param flow      The dataflow.
+ * @param mesh      The mesh.
+ */
+std::vector<workload> gemm_workloads(
+    isl_ctx *ctx, const std::string& layer, const std::vector<std::string>& tensors,
+    int M, int N, int K, dataflow flow, const mesh_shape& mesh
+) {
+    const std::vector<int> a_extents({M, K}), b_extents({K, N}), c_extents({M, N});
+    auto dst = [&]() { return mesh_space(ctx, "dst"); };
+    auto src = [&]() { return mesh_space(ctx, "src"); };
+
+    // Lays out what every PE reads and writes under the dataflow.
+    std::string a_fill, b_fill, c_occupancy;
+    switch (flow)
+    {
+        case dataflow::weight_stationary:
+        {
+            // B is tiled k over x and n over y; A's k block goes along y.
+            int tk = block_size(K, mesh.x), tn = block_size(N, mesh.y);
+            a_fill = layout(ctx, "dst", mesh, a_extents, {
+                block_tile(1, dst(), tk, 0), broadcast(dst(), 1, mesh.y)
+            });
+            b_fill = layout(ctx, "dst", mesh, b_extents, {
+                block_tile(0, dst(), tk, 0), block_tile(1, dst(), tn, 1)
+            });
+            // Every x holds partial sums of the n block of its y, modeled as
+            // full copies; see the header.
+            c_occupancy = layout(ctx, "src", mesh, c_extents, {
+                block_tile(1, src(), tn, 1), broadcast(src(), 0, mesh.x)
+            });
+            break;
+        }
+        case dataflow::output_stationary:
+        {
+            // C is tiled m over x and n over y; operands go along rows/columns.
+            int tm = block_size(M, mesh.x), tn = block_size(N, mesh.y);
+            a_fill = layout(ctx, "dst", mesh, a_extents, {
+                block_tile(0, dst(), tm, 0), broadcast(dst(), 1, mesh.y)
+            });
+            b_fill = layout(ctx, "dst", mesh, b_extents, {
+                block_tile(1, dst(), tn, 1), broadcast(dst(), 0, mesh.x)
+            });
+            c_occupancy = layout(ctx, "src", mesh, c_extents, {
+                block_tile(0, src(), tm, 0), block_tile(1, src(), tn, 1)
+            });
+            break;
+        }
+        case dataflow::row_stationary:
+        default:
+        {
+            // A is tiled m over x and k over y; B's k block goes along x.
+            int tm = block_size(M, mesh.x), tk = block_size(K, mesh.y);
+            a_fill = layout(ctx, "dst", mesh, a_extents, {
+                block_tile(0, dst(), tm, 0), block_tile(1, dst(), tk, 1)
+            });
+            b_fill = layout(ctx, "dst", mesh, b_extents, {
+                block_tile(0, dst(), tk, 1), broadcast(dst(), 0, mesh.x)
+            });
+            // Every y holds partial sums of the m block of its x, modeled as
+            // full copies; see the header.
+            c_occupancy = layout(ctx, "src", mesh, c_extents, {
+                block_tile(0, src(), tm, 0), broadcast(src(), 1, mesh.y)
+            });
+            break;
+        }
+    }
+
+    const std::string prefix = layer + "/" + dataflow_name(flow) + "/";
+    std::vector<workload> workloads;
+    workloads.emplace_back(new workload_struct{
+        prefix + tensors[0], home_layout(ctx, "src", mesh, a_extents), a_fill
+    });
+    workloads.emplace_back(new workload_struct{
+        prefix + tensors[1], home_layout(ctx, "src", mesh, b_extents), b_fill
+    });
+    workloads.emplace_back(new workload_struct{
+        prefix + tensors[2], c_occupancy, home_layout(ctx, "dst", mesh, c_extents)
+    });
+
+    return workloads;
+}
+
+/**
+ * Generates the deliveries of a convolution, seen along its rows:
+ * O[k, p] += F[k, r] * I[c, p + r], with the channels c and the columns folded
+ * into the data.
+ *
+ * @param ctx       The context to build the layouts in.
+ * @param K         The output channels.
+ * @param C         The input channels.
+ * @param P         The output rows.
+ * @param R         The filter rows.
+ * @param flow      The dataflow.
+ * @param mesh      The mesh.
+ */
+std::vector<workload> conv_workloads(
+    isl_ctx *ctx, int K, int C, int P, int R, dataflow flow, const mesh_shape& mesh
+) {
+    const std::vector<int> f_extents({K, R}), i_extents({C, P + R - 1}), o_extents({K, P});
+    auto dst = [&]() { return mesh_space(ctx, "dst"); };
+    auto src = [&]() { return mesh_space(ctx, "src"); };
+
+    std::string f_fill, i_fill, o_occupancy;
+    switch (flow)
+    {
+        case dataflow::weight_stationary:
+        {
+            // F is tiled k over x and r over y; a y reads the rows its r block touches.
+            int tk = block_size(K, mesh.x), tr = block_size(R, mesh.y);
+            f_fill = layout(ctx, "dst", mesh, f_extents, {
+                block_tile(0, dst(), tk, 0), block_tile(1, dst(), tr, 1)
+            });
+            i_fill = layout(ctx, "dst", mesh, i_extents, {
+                affine_tile(1, dst(), {{1, tr}}, tr + P - 1), broadcast(dst(), 0, mesh.x)
+            });
+            // Every y holds partial sums of the k block of its x, modeled as
+            // full copies; see the header.
+            o_occupancy = layout(ctx, "src", mesh, o_extents, {
+                block_tile(0, src(), tk, 0), broadcast(src(), 1, mesh.y)
+            });
+            break;
+        }
+        case dataflow::output_stationary:
+        {
+            // O is tiled k over x and p over y; a y reads the rows its p block touches.
+            int tk = block_size(K, mesh.x), tp = block_size(P, mesh.y);
+            f_fill = layout(ctx, "dst", mesh, f_extents, {
+                block_tile(0, dst(), tk, 0), broadcast(dst(), 1, mesh.y)
+            });
+            i_fill = layout(ctx, "dst", mesh, i_extents, {
+                affine_tile(1, dst(), {{1, tp}}, tp + R - 1), broadcast(dst(), 0, mesh.x)
+            });
+            o_occupancy = layout(ctx, "src", mesh, o_extents, {
+                block_tile(0, src(), tk, 0), block_tile(1, src(), tp, 1)
+            });
+            break;
+        }
+        case dataflow::row_stationary:
+        default:
+        {
+            // Filter rows go along x and output rows along y, so input rows
+            // go along the diagonals.
+            int tr = block_size(R, mesh.x), tp = block_size(P, mesh.y);
+            f_fill = layout(ctx, "dst", mesh, f_extents, {
+                block_tile(1, dst(), tr, 0), broadcast(dst(), 1, mesh.y)
+            });
+            i_fill = layout(ctx, "dst", mesh, i_extents, {
+                affine_tile(1, dst(), {{0, tr}, {1, tp}}, tr + tp - 1)
+            });
+            // Every x holds partial sums of the p block of its y, modeled as
+            // full copies; see the header.
+            o_occupancy = layout(ctx, "src", mesh, o_extents, {
+                block_tile(1, src(), tp, 1), broadcast(src(), 0, mesh.x)
+            });
+            break;
+        }
+    }
+
+    const std::string prefix = "conv/" + dataflow_name(flow) + "/";
+    std::vector<workload> workloads;
+    workloads.emplace_back(new workload_struct{
+        prefix + "F", home_layout(ctx, "src", mesh, f_extents), f_fill
+    });
+    workloads.emplace_back(new workload_struct{
+        prefix + "I", home_layout(ctx, "src", mesh, i_extents), i_fill
+    });
+    workloads.emplace_back(new workload_struct{
+        prefix + "O", o_occupancy, home_layout(ctx, "dst", mesh, o_extents)
+    });
+
+    return workloads;
+}
+
+/**
+ * Generates the deliveries of a single attention head as its two GEMMs,
+ * S = Q * K^T then O = S * V.
+ *
+ * @param ctx       The context to build the layouts in.
+ * @param S         The sequence length.
+ * @param D         The head dim.
+ * @param flow      The dataflow of both GEMMs.
+ * @param mesh      The mesh.
+ */
+std::vector<workload> attention_workloads(
+    isl_ctx *ctx, int S, int D, dataflow flow, const mesh_shape& mesh
+) {
+    std::vector<workload> workloads = gemm_workloads(
+        ctx, "attention/qk", {"Q", "Kt", "S"}, S, S, D, flow, mesh
+    );
+    for (workload& w : gemm_workloads(ctx, "attention/sv", {"S", "V", "O"}, S, D, S, flow, mesh))
+        workloads.push_back(std::move(w));
+
+    return workloads;
+}
+
+/**
+ * Generates every layer under every dataflow at a typical size for the mesh.
+ *
+ * @param ctx   The context to build the layouts in.
+ * @param mesh  The mesh.
+ * @param scale The tensor extents per PE along each mesh axis.
+ */
+std::vector<workload> standard_workloads(isl_ctx *ctx, const mesh_shape& mesh, int scale = 4)
+{
+    const int extent = scale * std::max(mesh.x, mesh.y);
+    std::vector<workload> workloads;
+    for (dataflow flow : {dataflow::weight_stationary, dataflow::output_stationary, dataflow::row_stationary})
+    {
+        std::vector<std::vector<workload>> layers;
+        layers.push_back(gemm_workloads(ctx, "gemm", {"A", "B", "C"}, extent, extent, extent, flow, mesh));
+        layers.push_back(conv_workloads(ctx, extent, extent, extent, 3, flow, mesh));
+        layers.push_back(attention_workloads(ctx, extent, scale * mesh.y, flow, mesh));
+        for (std::vector<workload>& layer : layers)
+            for (workload& w : layer)
+                workloads.push_back(std::move(w));
+    }
+
+    return workloads;
+}